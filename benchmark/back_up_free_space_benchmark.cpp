@@ -0,0 +1,119 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <vector>
+
+#include "benchmark_data.hpp"
+#include "pb_nav2_plugins/behaviors/back_up_free_space.hpp"
+
+namespace pb_nav2_benchmark
+{
+
+namespace
+{
+
+constexpr float ROBOT_RADIUS = 0.2f;
+constexpr unsigned int HEADING_COUNT = 360;
+constexpr unsigned char LETHAL_COST = 253;
+
+/**
+ * @brief BackUpFreeSpace with the direction searches exposed, configured with the defaults
+ */
+class BackUpFreeSpaceHarness : public pb_nav2_behaviors::BackUpFreeSpace
+{
+public:
+  BackUpFreeSpaceHarness()
+  {
+    robot_radius_ = ROBOT_RADIUS;
+    visualize_ = false;
+    swept_collision_check_ = false;
+    clearance_solver_.setHeadings(HEADING_COUNT);
+  }
+
+  using BackUpFreeSpace::findBestDirection;
+  using BackUpFreeSpace::findClearestDirection;
+
+  pb_nav2_behaviors::DistanceField & distanceField() { return distance_field_; }
+};
+
+/**
+ * @brief The robot in the middle of every costmap, where a rolling costmap keeps it
+ */
+std::vector<geometry_msgs::msg::Pose2D> centerPoses(
+  const std::vector<nav2_msgs::msg::Costmap> & costmaps)
+{
+  std::vector<geometry_msgs::msg::Pose2D> poses;
+  for (const auto & costmap : costmaps) {
+    geometry_msgs::msg::Pose2D pose;
+    pose.x = costmap.metadata.origin.position.x +
+             0.5 * costmap.metadata.size_x * costmap.metadata.resolution;
+    pose.y = costmap.metadata.origin.position.y +
+             0.5 * costmap.metadata.size_y * costmap.metadata.resolution;
+    poses.push_back(pose);
+  }
+  return poses;
+}
+
+/**
+ * @brief The ray sweep of onRun on every stored costmap in turn
+ */
+void BM_FindBestDirection(benchmark::State & state)
+{
+  const float radius = state.range(0) * 1e-2f;
+  const auto & costmaps = BenchmarkData::instance().costmaps();
+  const auto poses = centerPoses(costmaps);
+  BackUpFreeSpaceHarness harness;
+  size_t index = 0;
+  for (auto _ : state) {
+    const float angle =
+      harness.findBestDirection(costmaps[index], poses[index], -M_PI, M_PI, radius, M_PI / 32.0);
+    benchmark::DoNotOptimize(angle);
+    index = (index + 1) % costmaps.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+/**
+ * @brief Building the distance field and solving on it, as direction_solver "distance_field" does
+ */
+void BM_FindClearestDirection(benchmark::State & state)
+{
+  const float radius = state.range(0) * 1e-2f;
+  const auto & costmaps = BenchmarkData::instance().costmaps();
+  const auto poses = centerPoses(costmaps);
+  BackUpFreeSpaceHarness harness;
+  size_t index = 0;
+  for (auto _ : state) {
+    harness.distanceField().build(costmaps[index], LETHAL_COST);
+    const float angle = harness.findClearestDirection(costmaps[index], poses[index], radius);
+    benchmark::DoNotOptimize(angle);
+    index = (index + 1) % costmaps.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void radiusArgs(benchmark::internal::Benchmark * benchmark)
+{
+  benchmark->ArgName("radius_cm")->Arg(100)->Arg(350)->Unit(benchmark::kMicrosecond);
+}
+
+BENCHMARK(BM_FindBestDirection)->Apply(radiusArgs);
+BENCHMARK(BM_FindClearestDirection)->Apply(radiusArgs);
+
+}  // namespace
+
+}  // namespace pb_nav2_benchmark
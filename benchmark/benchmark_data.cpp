@@ -0,0 +1,189 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark_data.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rclcpp/serialization.hpp"
+#include "rclcpp/serialized_message.hpp"
+#include "rosbag2_cpp/reader.hpp"
+#include "sensor_msgs/point_cloud2_iterator.hpp"
+
+namespace pb_nav2_benchmark
+{
+
+namespace
+{
+
+// the synthetic terrain, a disc of ground around the origin with pillars standing on it
+constexpr unsigned int SYNTHETIC_SEED = 42;
+constexpr size_t SYNTHETIC_POINTS = 262144;
+constexpr unsigned int NUM_PILLARS = 24;
+constexpr float GROUND_RADIUS = 6.0f;
+constexpr float OBSTACLE_RATIO = 0.3f;
+constexpr float PILLAR_HEIGHT = 1.0f;
+
+// the synthetic costmap, lethal where the layers would mark with their default intensity window
+constexpr double COSTMAP_SIZE = 10.0;
+constexpr double COSTMAP_RESOLUTION = 0.05;
+constexpr float MIN_OBSTACLE_INTENSITY = 0.1f;
+constexpr float MAX_OBSTACLE_INTENSITY = 2.0f;
+constexpr unsigned char LETHAL_OBSTACLE = 254;
+
+template<typename MessageT>
+MessageT deserialize(const rcutils_uint8_array_t & data)
+{
+  static rclcpp::Serialization<MessageT> serialization;
+  rclcpp::SerializedMessage serialized(data);
+  MessageT message;
+  serialization.deserialize_message(&serialized, &message);
+  return message;
+}
+
+}  // namespace
+
+BenchmarkData & BenchmarkData::instance()
+{
+  static BenchmarkData data;
+  return data;
+}
+
+void BenchmarkData::loadBag(
+  const std::string & uri, const std::string & cloud_topic, const std::string & costmap_topic)
+{
+  rosbag2_cpp::Reader reader;
+  reader.open(uri);
+
+  size_t num_clouds = 0;
+  while (reader.has_next()) {
+    auto message = reader.read_next();
+    if (message->topic_name == cloud_topic) {
+      const auto cloud = deserialize<sensor_msgs::msg::PointCloud2>(*message->serialized_data);
+      sensor_msgs::PointCloud2ConstIterator<float> iter_x(cloud, "x");
+      sensor_msgs::PointCloud2ConstIterator<float> iter_y(cloud, "y");
+      sensor_msgs::PointCloud2ConstIterator<float> iter_z(cloud, "z");
+      sensor_msgs::PointCloud2ConstIterator<float> iter_i(cloud, "intensity");
+      for (; iter_x != iter_x.end(); ++iter_x, ++iter_y, ++iter_z, ++iter_i) {
+        points_.push_back({*iter_x, *iter_y, *iter_z, *iter_i});
+      }
+      ++num_clouds;
+    } else if (message->topic_name == costmap_topic) {
+      costmaps_.push_back(deserialize<nav2_msgs::msg::Costmap>(*message->serialized_data));
+    }
+  }
+
+  if (points_.empty()) {
+    throw std::runtime_error{"No points on " + cloud_topic + " in " + uri};
+  }
+  source_ = uri + " (" + std::to_string(num_clouds) + " clouds, " +
+            std::to_string(costmaps_.size()) + " costmaps)";
+}
+
+void BenchmarkData::fillSynthetic()
+{
+  std::mt19937 generator(SYNTHETIC_SEED);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+  if (points_.empty()) {
+    struct Pillar
+    {
+      float x, y, radius;
+    };
+    std::vector<Pillar> pillars;
+    for (unsigned int i = 0; i < NUM_PILLARS; ++i) {
+      const float distance = 1.0f + 4.5f * unit(generator);
+      const float angle = 2.0f * static_cast<float>(M_PI) * unit(generator);
+      pillars.push_back(
+        {distance * std::cos(angle), distance * std::sin(angle), 0.15f + 0.25f * unit(generator)});
+    }
+
+    // ground and pillar points are drawn in random order, so any prefix is a smaller terrain
+    std::normal_distribution<float> ground_noise(0.0f, 0.02f);
+    points_.reserve(SYNTHETIC_POINTS);
+    for (size_t i = 0; i < SYNTHETIC_POINTS; ++i) {
+      if (unit(generator) < OBSTACLE_RATIO) {
+        const Pillar & pillar = pillars[generator() % NUM_PILLARS];
+        const float angle = 2.0f * static_cast<float>(M_PI) * unit(generator);
+        const float z = PILLAR_HEIGHT * unit(generator);
+        points_.push_back(
+          {pillar.x + pillar.radius * std::cos(angle), pillar.y + pillar.radius * std::sin(angle),
+           z, z});
+      } else {
+        const float distance = GROUND_RADIUS * std::sqrt(unit(generator));
+        const float angle = 2.0f * static_cast<float>(M_PI) * unit(generator);
+        const float z = ground_noise(generator);
+        points_.push_back(
+          {distance * std::cos(angle), distance * std::sin(angle), z,
+           std::min(std::abs(z), 0.5f * MIN_OBSTACLE_INTENSITY)});
+      }
+    }
+  }
+
+  if (costmaps_.empty()) {
+    nav2_msgs::msg::Costmap costmap;
+    const auto size = static_cast<unsigned int>(COSTMAP_SIZE / COSTMAP_RESOLUTION);
+    costmap.header.frame_id = "map";
+    costmap.metadata.resolution = COSTMAP_RESOLUTION;
+    costmap.metadata.size_x = size;
+    costmap.metadata.size_y = size;
+    costmap.metadata.origin.position.x = -0.5 * COSTMAP_SIZE;
+    costmap.metadata.origin.position.y = -0.5 * COSTMAP_SIZE;
+    costmap.data.assign(static_cast<size_t>(size) * size, 0);
+    for (const auto & point : points_) {
+      if (point.intensity < MIN_OBSTACLE_INTENSITY || point.intensity > MAX_OBSTACLE_INTENSITY) {
+        continue;
+      }
+      const double mx = (point.x - costmap.metadata.origin.position.x) / COSTMAP_RESOLUTION;
+      const double my = (point.y - costmap.metadata.origin.position.y) / COSTMAP_RESOLUTION;
+      if (mx >= 0.0 && my >= 0.0 && mx < size && my < size) {
+        costmap.data[static_cast<size_t>(my) * size + static_cast<size_t>(mx)] = LETHAL_OBSTACLE;
+      }
+    }
+    costmaps_.push_back(std::move(costmap));
+  }
+}
+
+sensor_msgs::msg::PointCloud2 BenchmarkData::makeCloud(size_t num_points) const
+{
+  sensor_msgs::msg::PointCloud2 cloud;
+  cloud.header.frame_id = "map";
+  sensor_msgs::PointCloud2Modifier modifier(cloud);
+  modifier.setPointCloud2Fields(
+    4, "x", 1, sensor_msgs::msg::PointField::FLOAT32, "y", 1, sensor_msgs::msg::PointField::FLOAT32,
+    "z", 1, sensor_msgs::msg::PointField::FLOAT32, "intensity", 1,
+    sensor_msgs::msg::PointField::FLOAT32);
+  modifier.resize(num_points);
+
+  sensor_msgs::PointCloud2Iterator<float> iter_x(cloud, "x");
+  sensor_msgs::PointCloud2Iterator<float> iter_y(cloud, "y");
+  sensor_msgs::PointCloud2Iterator<float> iter_z(cloud, "z");
+  sensor_msgs::PointCloud2Iterator<float> iter_i(cloud, "intensity");
+  for (size_t i = 0; i < num_points; ++i, ++iter_x, ++iter_y, ++iter_z, ++iter_i) {
+    const TerrainPoint & point = points_[i % points_.size()];
+    *iter_x = point.x;
+    *iter_y = point.y;
+    *iter_z = point.z;
+    *iter_i = point.intensity;
+  }
+  return cloud;
+}
+
+}  // namespace pb_nav2_benchmark
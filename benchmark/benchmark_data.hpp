@@ -0,0 +1,90 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__BENCHMARK__BENCHMARK_DATA_HPP_
+#define PB_NAV2_PLUGINS__BENCHMARK__BENCHMARK_DATA_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "nav2_msgs/msg/costmap.hpp"
+#include "sensor_msgs/msg/point_cloud2.hpp"
+
+namespace pb_nav2_benchmark
+{
+
+/**
+ * @struct TerrainPoint
+ * @brief A point of a terrain cloud, the intensity is its height above the ground
+ */
+struct TerrainPoint
+{
+  float x, y, z, intensity;
+};
+
+/**
+ * @class BenchmarkData
+ * @brief The clouds and costmaps the benchmarks are replayed on
+ *
+ * Points and costmaps are read from a rosbag2 bag when one is given. Whatever the bag does not
+ * provide is replaced by a seeded synthetic terrain around the origin, so runs on different
+ * machines see the same input.
+ */
+class BenchmarkData
+{
+public:
+  static BenchmarkData & instance();
+
+  /**
+   * @brief Read the clouds and costmaps of a bag
+   * @param uri Path of the bag
+   * @param cloud_topic Topic of the sensor_msgs/PointCloud2 terrain clouds
+   * @param costmap_topic Topic of the nav2_msgs/Costmap costmaps
+   */
+  void loadBag(
+    const std::string & uri, const std::string & cloud_topic, const std::string & costmap_topic);
+
+  /**
+   * @brief Generate the synthetic terrain and costmap if the bag did not provide them
+   */
+  void fillSynthetic();
+
+  /**
+   * @brief A cloud of num_points x, y, z, intensity points in the frame of the costmap
+   *
+   * The points are taken in the order they were recorded, cycling over them when more are asked
+   * for than there are, so a cloud holds whole frames until it runs out of them.
+   */
+  sensor_msgs::msg::PointCloud2 makeCloud(size_t num_points) const;
+
+  /**
+   * @brief The recorded costmaps, or a single one rasterized from the synthetic terrain
+   */
+  const std::vector<nav2_msgs::msg::Costmap> & costmaps() const { return costmaps_; }
+
+  /**
+   * @brief Where the clouds came from, for the benchmark context
+   */
+  const std::string & source() const { return source_; }
+
+private:
+  std::vector<TerrainPoint> points_;
+  std::vector<nav2_msgs::msg::Costmap> costmaps_;
+  std::string source_ = "synthetic";
+};
+
+}  // namespace pb_nav2_benchmark
+
+#endif  // PB_NAV2_PLUGINS__BENCHMARK__BENCHMARK_DATA_HPP_
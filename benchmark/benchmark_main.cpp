@@ -0,0 +1,73 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <string>
+
+#include "benchmark_data.hpp"
+#include "rclcpp/rclcpp.hpp"
+
+namespace
+{
+
+bool parseFlag(const std::string & arg, const std::string & name, std::string & value)
+{
+  const std::string prefix = "--" + name + "=";
+  if (arg.compare(0, prefix.size(), prefix) != 0) {
+    return false;
+  }
+  value = arg.substr(prefix.size());
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  // takes out the --benchmark_* flags, the ones left are ours
+  benchmark::Initialize(&argc, argv);
+
+  std::string bag;
+  std::string cloud_topic = "/terrain_map";
+  std::string costmap_topic = "/local_costmap/costmap_raw";
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (
+      !parseFlag(arg, "bag", bag) && !parseFlag(arg, "cloud_topic", cloud_topic) &&
+      !parseFlag(arg, "costmap_topic", costmap_topic)) {
+      std::fprintf(
+        stderr,
+        "Unknown argument %s\n"
+        "usage: %s [--bag=<path>] [--cloud_topic=<topic>] [--costmap_topic=<topic>] "
+        "[--benchmark_...]\n",
+        arg.c_str(), argv[0]);
+      return 1;
+    }
+  }
+
+  rclcpp::init(1, argv);
+  auto & data = pb_nav2_benchmark::BenchmarkData::instance();
+  if (!bag.empty()) {
+    data.loadBag(bag, cloud_topic, costmap_topic);
+  }
+  data.fillSynthetic();
+  benchmark::AddCustomContext("data", data.source());
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  rclcpp::shutdown();
+  return 0;
+}
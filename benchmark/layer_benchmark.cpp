@@ -0,0 +1,210 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <limits>
+#include <memory>
+
+#include "benchmark_data.hpp"
+#include "nav2_costmap_2d/footprint.hpp"
+#include "nav2_costmap_2d/layered_costmap.hpp"
+#include "nav2_util/lifecycle_node.hpp"
+#include "nav2_util/node_utils.hpp"
+#include "pb_nav2_plugins/layers/intensity_obstacle_layer.hpp"
+#include "pb_nav2_plugins/layers/intensity_voxel_layer.hpp"
+#include "tf2_ros/buffer.h"
+
+namespace pb_nav2_benchmark
+{
+
+namespace
+{
+
+constexpr double MAP_SIZE = 10.0;
+constexpr double ROBOT_RADIUS = 0.2;
+constexpr double SENSOR_HEIGHT = 0.3;
+constexpr double OBSTACLE_RANGE = 6.0;
+constexpr double RAYTRACE_RANGE = 6.5;
+// distance the origin moves per updateOrigin, a robot at 3 m/s with a 10 Hz costmap
+constexpr double ORIGIN_STEP = 0.3;
+
+/**
+ * @brief A layered costmap holding a single layer, configured like Costmap2DROS would
+ *
+ * The layer has no observation sources, it is fed a static observation in the frame of the
+ * costmap so no transform is looked up.
+ */
+template<typename LayerT>
+class LayerHarness
+{
+public:
+  LayerHarness(double resolution, bool rolling_window)
+  : node_(std::make_shared<nav2_util::LifecycleNode>("layer_benchmark")),
+    tf_(node_->get_clock()),
+    costmap_("map", rolling_window, false)
+  {
+    nav2_util::declare_parameter_if_not_declared(
+      node_, "track_unknown_space", rclcpp::ParameterValue(false));
+    nav2_util::declare_parameter_if_not_declared(
+      node_, "transform_tolerance", rclcpp::ParameterValue(0.3));
+
+    const auto size = static_cast<unsigned int>(MAP_SIZE / resolution);
+    costmap_.resizeMap(size, size, resolution, -0.5 * MAP_SIZE, -0.5 * MAP_SIZE);
+    layer_ = std::make_shared<LayerT>();
+    layer_->initialize(&costmap_, "layer", &tf_, node_, nullptr);
+    costmap_.addPlugin(layer_);
+    costmap_.setFootprint(nav2_costmap_2d::makeFootprintFromRadius(ROBOT_RADIUS));
+  }
+
+  void setCloud(const sensor_msgs::msg::PointCloud2 & cloud)
+  {
+    layer_->clearStaticObservations(true, true);
+    geometry_msgs::msg::Point origin;
+    origin.z = SENSOR_HEIGHT;
+    nav2_costmap_2d::Observation observation(
+      origin, cloud, OBSTACLE_RANGE, 0.0, RAYTRACE_RANGE, 0.0);
+    layer_->addStaticObservation(observation, true, true);
+  }
+
+  void updateBounds(double robot_x = 0.0, double robot_y = 0.0)
+  {
+    double min_x = std::numeric_limits<double>::max();
+    double min_y = std::numeric_limits<double>::max();
+    double max_x = std::numeric_limits<double>::lowest();
+    double max_y = std::numeric_limits<double>::lowest();
+    layer_->updateBounds(robot_x, robot_y, 0.0, &min_x, &min_y, &max_x, &max_y);
+    benchmark::DoNotOptimize(min_x);
+    benchmark::DoNotOptimize(max_y);
+  }
+
+  void updateCosts()
+  {
+    nav2_costmap_2d::Costmap2D & master = *costmap_.getCostmap();
+    layer_->updateCosts(master, 0, 0, master.getSizeInCellsX(), master.getSizeInCellsY());
+    benchmark::ClobberMemory();
+  }
+
+  LayerT & layer() { return *layer_; }
+  nav2_costmap_2d::LayeredCostmap & costmap() { return costmap_; }
+
+private:
+  // destroyed bottom up, so the layer goes before the node it keeps a weak pointer to
+  nav2_util::LifecycleNode::SharedPtr node_;
+  tf2_ros::Buffer tf_;
+  nav2_costmap_2d::LayeredCostmap costmap_;
+  std::shared_ptr<LayerT> layer_;
+};
+
+double resolutionArg(const benchmark::State & state) { return state.range(1) * 1e-3; }
+
+void setCounters(benchmark::State & state)
+{
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  const double cells = std::pow(MAP_SIZE / resolutionArg(state), 2);
+  state.counters["cells"] = benchmark::Counter(cells);
+}
+
+/**
+ * @brief Marking and clearing with one cloud, the layer's share of a costmap update
+ */
+template<typename LayerT>
+void BM_UpdateBounds(benchmark::State & state)
+{
+  LayerHarness<LayerT> harness(resolutionArg(state), false);
+  harness.setCloud(BenchmarkData::instance().makeCloud(state.range(0)));
+  for (auto _ : state) {
+    harness.updateBounds();
+  }
+  setCounters(state);
+}
+
+/**
+ * @brief Merging a marked layer into the whole master costmap
+ */
+template<typename LayerT>
+void BM_UpdateCosts(benchmark::State & state)
+{
+  LayerHarness<LayerT> harness(resolutionArg(state), false);
+  harness.setCloud(BenchmarkData::instance().makeCloud(state.range(0)));
+  harness.updateBounds();
+  for (auto _ : state) {
+    harness.updateCosts();
+  }
+  setCounters(state);
+}
+
+/**
+ * @brief Moving the origin of a marked layer by ORIGIN_STEP, back and forth
+ */
+template<typename LayerT>
+void BM_UpdateOrigin(benchmark::State & state)
+{
+  LayerHarness<LayerT> harness(resolutionArg(state), false);
+  harness.setCloud(BenchmarkData::instance().makeCloud(state.range(0)));
+  const double origin_x = harness.layer().getOriginX();
+  const double origin_y = harness.layer().getOriginY();
+  bool shifted = false;
+  for (auto _ : state) {
+    // mark again so every shift moves a full map
+    state.PauseTiming();
+    harness.updateBounds();
+    state.ResumeTiming();
+    shifted = !shifted;
+    const double step = shifted ? ORIGIN_STEP : 0.0;
+    harness.layer().updateOrigin(origin_x + step, origin_y + step);
+  }
+  setCounters(state);
+}
+
+/**
+ * @brief A whole rolling LayeredCostmap::updateMap while the robot drives a circle
+ */
+template<typename LayerT>
+void BM_UpdateMap(benchmark::State & state)
+{
+  LayerHarness<LayerT> harness(resolutionArg(state), true);
+  harness.setCloud(BenchmarkData::instance().makeCloud(state.range(0)));
+  double angle = 0.0;
+  for (auto _ : state) {
+    // ORIGIN_STEP along a circle of 1 m
+    angle += ORIGIN_STEP;
+    harness.costmap().updateMap(std::cos(angle), std::sin(angle), angle);
+  }
+  setCounters(state);
+}
+
+void layerArgs(benchmark::internal::Benchmark * benchmark)
+{
+  benchmark->ArgNames({"points", "resolution_mm"})
+    ->ArgsProduct({{8192, 32768, 131072}, {50, 100}})
+    ->Unit(benchmark::kMillisecond);
+}
+
+using pb_nav2_costmap_2d::IntensityObstacleLayer;
+using pb_nav2_costmap_2d::IntensityVoxelLayer;
+
+BENCHMARK_TEMPLATE(BM_UpdateBounds, IntensityObstacleLayer)->Apply(layerArgs);
+BENCHMARK_TEMPLATE(BM_UpdateCosts, IntensityObstacleLayer)->Apply(layerArgs);
+BENCHMARK_TEMPLATE(BM_UpdateOrigin, IntensityObstacleLayer)->Apply(layerArgs);
+BENCHMARK_TEMPLATE(BM_UpdateMap, IntensityObstacleLayer)->Apply(layerArgs);
+BENCHMARK_TEMPLATE(BM_UpdateBounds, IntensityVoxelLayer)->Apply(layerArgs);
+BENCHMARK_TEMPLATE(BM_UpdateCosts, IntensityVoxelLayer)->Apply(layerArgs);
+BENCHMARK_TEMPLATE(BM_UpdateOrigin, IntensityVoxelLayer)->Apply(layerArgs);
+BENCHMARK_TEMPLATE(BM_UpdateMap, IntensityVoxelLayer)->Apply(layerArgs);
+
+}  // namespace
+
+}  // namespace pb_nav2_benchmark
@@ -17,12 +17,14 @@
 #define PB_NAV2_PLUGINS__BEHAVIORS__BACK_UP_FREE_SPACE_HPP_
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include "nav2_behaviors/plugins/drive_on_heading.hpp"
 #include "nav2_msgs/action/back_up.hpp"
 #include "nav2_msgs/srv/get_costmap.hpp"
+#include "pb_nav2_plugins/behaviors/clearance_direction_solver.hpp"
 #include "rclcpp/rclcpp.hpp"
 #include "visualization_msgs/msg/marker_array.hpp"
 
@@ -31,6 +33,22 @@ using BackUpAction = nav2_msgs::action::BackUp;
 namespace pb_nav2_behaviors
 {
 
+/**
+ * @struct FreePoints
+ * @brief Centers of the free cells found by BackUpFreeSpace::gatherFreePoints, one array per axis
+ */
+struct FreePoints
+{
+  std::vector<float> x, y;
+
+  void clear()
+  {
+    x.clear();
+    y.clear();
+  }
+  size_t size() const { return x.size(); }
+};
+
 /**
  * @class pb_nav2_behaviors::BackUpFreeSpace
  * @brief An enhanced back_up action that move toward free space
@@ -64,41 +82,141 @@ public:
   nav2_behaviors::Status onCycleUpdate() override;
 
 protected:
+  /**
+   * @brief Request the whole costmap from service_name
+   * @param costmap Filled with the costmap
+   * @return Whether the costmap was received in time
+   */
+  bool requestCostmap(nav2_msgs::msg::Costmap & costmap);
+
+  /**
+   * @brief Crop the latest costmap received on costmap_topic around the robot
+   *
+   * The window reaches twice the radius from the robot, so rays of that radius never leave it
+   * and the clearance of their cells is not cut short by its border.
+   *
+   * @param pose The pose of the robot in the frame of the costmap
+   * @param radius The length of the rays
+   * @param window Filled with the cropped costmap
+   * @param keep_window Crop the same cells as the previous window while it still fits, and leave
+   * window untouched when no newer costmap was received
+   * @return Whether a costmap no older than max_costmap_age was received and the robot is inside
+   * of it
+   */
+  bool cropLatestCostmap(
+    const geometry_msgs::msg::Pose2D & pose, float radius, nav2_msgs::msg::Costmap & window,
+    bool keep_window = false);
+
+  /**
+   * @brief Pick target_heading_ on costmap_ with direction_solver
+   * @param pose The pose of the robot in the frame of the costmap
+   */
+  void selectDirection(const geometry_msgs::msg::Pose2D & pose);
+
+  /**
+   * @brief Pick the heading again from the current pose during the maneuver
+   *
+   * With costmap_source "topic" the latest costmap is cropped to the cells of the previous
+   * window, so the distance field is only updated where blocked cells changed. Otherwise the
+   * costmap fetched in onRun is searched again.
+   *
+   * @param pose The pose of the robot in the frame of the costmap
+   */
+  void replanDirection(const geometry_msgs::msg::Pose2D & pose);
+
   /**
    * @brief Gather free points within a specified radius from the center in the costmap.
    *
-   * This function iterates through the costmap and collects points that are free (costmap value is 0)
-   * and within the specified radius from the given center coordinates (center_x, center_y).
+   * This function collects the centers of the cells that are free (costmap value is 0) and within
+   * the specified radius from the pose. Only the cells of the bounding square of the radius are
+   * visited, row by row, and the span of each row inside the circle is computed up front.
    *
    * @param costmap The costmap to search for free points.
-   * @param center_x The x-coordinate of the center point.
-   * @param center_y The y-coordinate of the center point.
+   * @param pose The center of the search.
    * @param radius The radius within which to gather free points.
-   * @return A vector of points that are free and within the specified radius.
+   * @param points Filled with the free points, cleared first.
    */
-  std::vector<geometry_msgs::msg::Point> gatherFreePoints(
+  void gatherFreePoints(
+    const nav2_msgs::msg::Costmap & costmap, geometry_msgs::msg::Pose2D pose, float radius,
+    FreePoints & points);
+
+  /**
+   * @brief Head toward the centroid of the free cells within the radius
+   *
+   * Falls back to findBestDirection when fewer than free_threshold free cells are found, or when
+   * their centroid is within a cell of the robot.
+   *
+   * @param costmap The costmap to search
+   * @param pose The pose of the robot in the frame of the costmap
+   * @param radius The radius within which to gather free points
+   * @return The heading to back up along, in the frame of the costmap
+   */
+  float findFreeCentroidDirection(
     const nav2_msgs::msg::Costmap & costmap, geometry_msgs::msg::Pose2D pose, float radius);
 
+  /**
+   * @brief Pick the middle of the widest sector of clear rays
+   *
+   * With swept_collision_check, a ray is clear when the disc of robot_radius swept along it keeps
+   * its clearance on distance_field_, which has to be built from the lethal cells of the same
+   * costmap, see ClearanceDirectionSolver. Otherwise a ray is clear when none of its cells is at
+   * least inscribed.
+   */
   float findBestDirection(
     const nav2_msgs::msg::Costmap & costmap, geometry_msgs::msg::Pose2D pose, float start_angle,
     float end_angle, float radius, float angle_increment);
 
+  /**
+   * @brief Pick the heading with the most clearance on distance_field_
+   *
+   * distance_field_ has to be built from the same costmap, from its lethal cells only with
+   * swept_collision_check. Falls back to findBestDirection when no heading is clear.
+   *
+   * @param costmap The costmap to search
+   * @param pose The pose of the robot in the frame of the costmap
+   * @param radius The length of the rays
+   * @return The heading to back up along, in the frame of the costmap
+   */
+  float findClearestDirection(
+    const nav2_msgs::msg::Costmap & costmap, geometry_msgs::msg::Pose2D pose, float radius);
+
   void visualize(const geometry_msgs::msg::Point & target_point);
 
   void visualizeline(
     geometry_msgs::msg::Pose2D pose, float radius, float first_safe_angle, float last_unsafe_angle);
 
   rclcpp::Client<nav2_msgs::srv::GetCostmap>::SharedPtr costmap_client_;
+  rclcpp::Subscription<nav2_msgs::msg::Costmap>::SharedPtr costmap_sub_;
+  std::mutex costmap_mutex_;
+  nav2_msgs::msg::Costmap::ConstSharedPtr latest_costmap_;
+  // the message costmap_ was last cropped from
+  nav2_msgs::msg::Costmap::ConstSharedPtr cropped_costmap_;
+  // the costmap searched by onRun, kept to reuse its buffer
+  nav2_msgs::msg::Costmap costmap_;
   std::shared_ptr<rclcpp_lifecycle::LifecyclePublisher<visualization_msgs::msg::MarkerArray>>
     marker_pub_;
   std::shared_ptr<rclcpp_lifecycle::LifecyclePublisher<visualization_msgs::msg::MarkerArray>>
     marker_pub_line_;
+  DistanceField distance_field_;
+  ClearanceDirectionSolver clearance_solver_;
+  FreePoints free_points_;
+  // heading the velocity is turned toward and the heading it points along
+  float target_heading_ = 0.0f, heading_ = 0.0f;
+  double speed_ = 0.0;
+  rclcpp::Time last_replan_;
   // parameters
+  std::string costmap_source_;
   std::string service_name_;
+  std::string costmap_topic_;
+  double max_costmap_age_;
   double twist_x_, twist_y_;
   double max_radius_, robot_radius_;
   int free_threshold_;
   bool visualize_;
+  std::string direction_solver_;
+  int heading_count_;
+  bool swept_collision_check_;
+  double replan_frequency_, replan_heading_rate_;
 };
 
 }  // namespace pb_nav2_behaviors
@@ -0,0 +1,165 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__BEHAVIORS__CLEARANCE_DIRECTION_SOLVER_HPP_
+#define PB_NAV2_PLUGINS__BEHAVIORS__CLEARANCE_DIRECTION_SOLVER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "geometry_msgs/msg/pose2_d.hpp"
+#include "nav2_msgs/msg/costmap.hpp"
+
+namespace pb_nav2_behaviors
+{
+
+/**
+ * @class DistanceField
+ * @brief Euclidean distance from every cell of a costmap to the nearest blocked cell
+ *
+ * Built with the two-pass lower envelope transform of Felzenszwalb and Huttenlocher, so it
+ * costs O(size_x * size_y) whatever the obstacle layout. Cells outside of the map count as
+ * blocked, like a ray leaving the map does in findBestDirection.
+ */
+class DistanceField
+{
+public:
+  /**
+   * @brief Rebuild the field, reusing the buffers of the previous build
+   * @param costmap The costmap to measure
+   * @param lethal_cost Cells with at least this cost are blocked
+   */
+  void build(const nav2_msgs::msg::Costmap & costmap, unsigned char lethal_cost);
+
+  /**
+   * @brief Bring the field up to date with a new version of the costmap it was built from
+   *
+   * Only the columns with a cell that became blocked or free are transformed again, and only the
+   * rows they changed. The result is the same as build. A costmap of another size, resolution
+   * or origin is built from scratch.
+   *
+   * @param costmap The new version of the costmap
+   * @param lethal_cost Cells with at least this cost are blocked, as passed to build
+   * @return The number of cells that changed state, or every cell when built from scratch
+   */
+  size_t update(const nav2_msgs::msg::Costmap & costmap, unsigned char lethal_cost);
+
+  /**
+   * @brief Distance in meters from the center of cell (i, j) to the nearest blocked cell
+   */
+  inline float at(unsigned int i, unsigned int j) const { return distance_[j * size_x_ + i]; }
+
+  unsigned int sizeX() const { return size_x_; }
+  unsigned int sizeY() const { return size_y_; }
+
+private:
+  /**
+   * @brief Squared distance transform of the n samples in f_, written to d_
+   */
+  void transform1D(unsigned int n);
+
+  /**
+   * @brief Squared distances along column i from blocked_, written to column_
+   * @return Whether any of them changed, the rows they changed are flagged in dirty_rows_
+   */
+  bool transformColumn(unsigned int i);
+
+  /**
+   * @brief Distances along row j from column_, written to distance_
+   */
+  void transformRow(unsigned int j);
+
+  unsigned int size_x_ = 0, size_y_ = 0;
+  float resolution_ = 0.0f;
+  double origin_x_ = 0.0, origin_y_ = 0.0;
+  std::vector<float> distance_;
+  // state of the last build or update, to find what changed
+  std::vector<uint8_t> blocked_;
+  std::vector<float> column_;
+  std::vector<uint8_t> dirty_columns_, dirty_rows_;
+  // scratch of the 1D transform
+  std::vector<float> f_, d_, z_;
+  std::vector<int> v_;
+};
+
+/**
+ * @struct DirectionChoice
+ * @brief The heading picked by ClearanceDirectionSolver
+ */
+struct DirectionChoice
+{
+  /// @brief Picked heading in the frame of the costmap
+  float angle;
+  /// @brief Smallest distance to a blocked cell along the picked heading, in meters
+  float clearance;
+  /// @brief First and last heading of the sector of headings as good as the picked one
+  float sector_begin, sector_end;
+  /// @brief False when every heading is blocked right away
+  bool found;
+};
+
+/**
+ * @class ClearanceDirectionSolver
+ * @brief Scores evenly spaced headings by the clearance they keep along a distance field
+ *
+ * Every heading is walked cell by cell with a precomputed unit vector, so no trigonometry is
+ * evaluated per step. The score of a heading is the smallest distance to a blocked cell on the
+ * ray, ignoring the first half of the clearance the robot already has, as every heading starts
+ * there. The middle of the sector of headings that score within half a cell of the best one is
+ * picked, so the robot heads into the center of the widest margin.
+ *
+ * With a robot radius, a heading is only admissible if a disc of that radius swept along the ray
+ * never gets closer to a blocked cell than it is at the start, or than the radius when it starts
+ * further away. A robot that is already touching an obstacle can still move away from it.
+ */
+class ClearanceDirectionSolver
+{
+public:
+  /**
+   * @brief Set the number of headings over the full circle and build the unit-vector tables
+   */
+  void setHeadings(unsigned int num_headings);
+
+  /**
+   * @brief Pick the heading with the most clearance
+   * @param field Distance field of the costmap
+   * @param metadata Geometry of the costmap the field was built from
+   * @param pose Pose of the robot in the frame of the costmap
+   * @param radius Length of the rays
+   * @param robot_radius Radius of the swept disc, 0 for a zero-width ray
+   */
+  DirectionChoice solve(
+    const DistanceField & field, const nav2_msgs::msg::CostmapMetaData & metadata,
+    const geometry_msgs::msg::Pose2D & pose, float radius, float robot_radius = 0.0f);
+
+  /**
+   * @brief The clearance a swept disc has to keep when it starts with start_clearance
+   */
+  static float requiredClearance(float start_clearance, float robot_radius, float resolution);
+
+  /**
+   * @brief Distance to the nearest blocked cell at a point, 0 outside of the map
+   */
+  static float clearanceAt(
+    const DistanceField & field, const nav2_msgs::msg::CostmapMetaData & metadata, float x,
+    float y);
+
+private:
+  std::vector<float> angles_, cos_, sin_, scores_;
+};
+
+}  // namespace pb_nav2_behaviors
+
+#endif  // PB_NAV2_PLUGINS__BEHAVIORS__CLEARANCE_DIRECTION_SOLVER_HPP_
@@ -0,0 +1,118 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__CELL_BATCH_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__CELL_BATCH_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace pb_nav2_costmap_2d
+{
+
+/**
+ * @class CellBatch
+ * @brief Collects the distinct cell indices written during one update
+ *
+ * Duplicates are dropped with a bitmap the size of the layer. The bitmap is cleared cell by cell
+ * while flushing, so a flush costs O(distinct cells) rather than O(map size).
+ */
+class CellBatch
+{
+public:
+  /**
+   * @brief Match the size of the layer, drops any pending cells
+   */
+  void resize(unsigned int size_x, unsigned int size_y)
+  {
+    size_x_ = size_x;
+    bitmap_.assign((static_cast<size_t>(size_x) * size_y + 63) / 64, 0);
+    cells_.clear();
+  }
+
+  /**
+   * @brief Add a cell index, returns false if it is already in the batch
+   */
+  inline bool add(unsigned int index)
+  {
+    uint64_t & word = bitmap_[index >> 6];
+    const uint64_t bit = uint64_t{1} << (index & 63);
+    if (word & bit) {
+      return false;
+    }
+    word |= bit;
+    cells_.push_back(index);
+    return true;
+  }
+
+  /**
+   * @brief Hand every distinct cell to write and empty the batch
+   * @param write Callable taking (unsigned int index), returning true if the cell was written.
+   *        The bounding box of the written cells is available from getBounds afterwards.
+   */
+  template<typename Writer>
+  inline void flush(Writer && write)
+  {
+    min_mx_ = min_my_ = UINT32_MAX;
+    max_mx_ = max_my_ = 0;
+    for (const unsigned int index : cells_) {
+      bitmap_[index >> 6] &= ~(uint64_t{1} << (index & 63));
+      if (write(index)) {
+        const unsigned int my = index / size_x_;
+        const unsigned int mx = index - my * size_x_;
+        min_mx_ = std::min(min_mx_, mx);
+        min_my_ = std::min(min_my_, my);
+        max_mx_ = std::max(max_mx_, mx);
+        max_my_ = std::max(max_my_, my);
+      }
+    }
+    cells_.clear();
+  }
+
+  /**
+   * @brief Cell bounding box of the cells written by the last flush
+   * @return False if the last flush wrote nothing
+   */
+  bool getBounds(
+    unsigned int & min_mx, unsigned int & min_my, unsigned int & max_mx,
+    unsigned int & max_my) const
+  {
+    if (min_mx_ > max_mx_) {
+      return false;
+    }
+    min_mx = min_mx_;
+    min_my = min_my_;
+    max_mx = max_mx_;
+    max_my = max_my_;
+    return true;
+  }
+
+  /**
+   * @brief Pending distinct cells, in insertion order
+   */
+  const std::vector<unsigned int> & cells() const { return cells_; }
+
+  bool empty() const { return cells_.empty(); }
+
+private:
+  unsigned int size_x_ = 0;
+  std::vector<uint64_t> bitmap_;
+  std::vector<unsigned int> cells_;
+  unsigned int min_mx_ = UINT32_MAX, min_my_ = UINT32_MAX, max_mx_ = 0, max_my_ = 0;
+};
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__CELL_BATCH_HPP_
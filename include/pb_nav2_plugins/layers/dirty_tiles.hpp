@@ -0,0 +1,127 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__DIRTY_TILES_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__DIRTY_TILES_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pb_nav2_costmap_2d
+{
+
+/**
+ * @class DirtyTiles
+ * @brief Tracks which square tiles of a layer have to be merged into the master costmap
+ *
+ * LayeredCostmap resets the window of the master before the layers merge into it, so a tile has
+ * to be merged every update for as long as it holds a cell that changes the master: a known
+ * cell, or a cell costlier than free space where merging free space is a no-op. Whether a tile
+ * holds one is kept per tile and only checked again for the tiles written since the last merge,
+ * so an update costs what it wrote and what the layer holds rather than the size of the window.
+ */
+class DirtyTiles
+{
+public:
+  static constexpr unsigned int TILE_SHIFT = 4;
+  static constexpr unsigned int TILE_SIZE = 1u << TILE_SHIFT;
+
+  /**
+   * @brief Match the size of the layer, every tile starts dirty
+   */
+  void resize(unsigned int size_x, unsigned int size_y);
+
+  /**
+   * @brief Flag every tile as written, after the whole layer was
+   */
+  void markAll() { std::fill(flags_.begin(), flags_.end(), DIRTY); }
+
+  /**
+   * @brief Flag the tile of a cell index as written
+   */
+  inline void mark(unsigned int index)
+  {
+    const unsigned int my = index / size_x_;
+    markCell(index - my * size_x_, my);
+  }
+
+  /**
+   * @brief Flag the tile of a cell as written
+   */
+  inline void markCell(unsigned int mx, unsigned int my)
+  {
+    flags_[(my >> TILE_SHIFT) * tiles_x_ + (mx >> TILE_SHIFT)] |= DIRTY;
+  }
+
+  /**
+   * @brief Flag the tiles of a cell rectangle as written, the bounds are inclusive and clamped
+   */
+  void markRect(unsigned int min_mx, unsigned int min_my, unsigned int max_mx, unsigned int max_my);
+
+  /**
+   * @brief Follow shiftMapInPlace of the layer by the same shift
+   *
+   * A tile now holds cells of up to four old tiles, it is flagged as written if any of them may
+   * hold a merged cell. Tiles that reach into the strips that scrolled in are flagged as well.
+   */
+  void shift(int shift_x, int shift_y);
+
+  /**
+   * @brief Check the written tiles again and clear their flags
+   * @param costmap The costmap of the layer
+   * @param merge_free Whether free cells change the master, false when they are merged with max
+   * into a master that holds no unknown cells, such as a master without unknown tracking that no
+   * layer merged into before
+   */
+  void refresh(const unsigned char * costmap, bool merge_free);
+
+  /**
+   * @brief CostmapLayer::updateWithMax over the merged tiles of the window only
+   */
+  void updateWithMax(
+    const unsigned char * costmap, unsigned char * master, int min_i, int min_j, int max_i,
+    int max_j) const;
+
+  /**
+   * @brief CostmapLayer::updateWithOverwrite over the merged tiles of the window only
+   */
+  void updateWithOverwrite(
+    const unsigned char * costmap, unsigned char * master, int min_i, int min_j, int max_i,
+    int max_j) const;
+
+private:
+  enum Flag : uint8_t
+  {
+    MERGED = 1,  ///< @brief The tile holds a cell that changes the master
+    DIRTY = 2    ///< @brief The tile was written since it was last checked
+  };
+
+  /**
+   * @brief Call merge(offset, length) for every run of merged tiles along the rows of the window
+   */
+  template<typename Merge>
+  void forEachMergedSpan(int min_i, int min_j, int max_i, int max_j, Merge && merge) const;
+
+  unsigned int size_x_ = 0, size_y_ = 0;
+  unsigned int tiles_x_ = 0, tiles_y_ = 0;
+  std::vector<uint8_t> flags_;
+  std::vector<uint8_t> shift_scratch_;
+  bool merge_free_ = true;
+};
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__DIRTY_TILES_HPP_
@@ -0,0 +1,206 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__FAR_FIELD_LOD_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__FAR_FIELD_LOD_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "pb_nav2_plugins/layers/cell_batch.hpp"
+#include "pb_nav2_plugins/layers/point_filter.hpp"
+
+namespace pb_nav2_costmap_2d
+{
+
+/**
+ * @class FarFieldLod
+ * @brief Coarse level of the layer for the points and rays beyond a near-field radius
+ *
+ * A coarse cell covers factor x factor cells of the layer. Far marks are collected per coarse
+ * cell, with a bit for each of its fine cells that was hit, and only the fine cells hit are
+ * written, so the coarse level never marks more than the points do. Far clearing rays are traced
+ * once per coarse endpoint cell, to the farthest endpoint that falls in it. Within the near-field
+ * radius of the sensor every point and ray is kept at the resolution of the layer, so far free
+ * space is refined as the robot comes closer and its rays clear the fine cells in between.
+ */
+class FarFieldLod
+{
+public:
+  /// @brief The largest factor, the fine cells of a coarse cell are the bits of one word
+  static constexpr unsigned int MAX_FACTOR = 8;
+
+  /**
+   * @brief Set the coarse level up
+   * @param factor Cells of the layer per coarse cell along each axis, 1 disables the coarse level,
+   * clamped to MAX_FACTOR
+   * @param near_radius Distance from the sensor in meters within which nothing is coarsened
+   */
+  void configure(unsigned int factor, double near_radius)
+  {
+    factor_ = std::clamp(factor, 1u, MAX_FACTOR);
+    near_radius_ = std::max(near_radius, 0.0);
+  }
+
+  bool enabled() const { return factor_ > 1; }
+
+  /**
+   * @brief Go back to marking and clearing at full resolution and free the coarse level
+   */
+  void disable()
+  {
+    factor_ = 1;
+    coarse_marks_.resize(0, 0);
+    fine_hits_.clear();
+    fine_hits_.shrink_to_fit();
+    farthest_ray_.clear();
+    farthest_ray_.shrink_to_fit();
+  }
+
+  /**
+   * @brief Match the size and resolution of the layer
+   */
+  void resize(unsigned int size_x, unsigned int size_y, double resolution)
+  {
+    if (!enabled()) {
+      return;
+    }
+    size_x_ = size_x;
+    size_y_ = size_y;
+    coarse_x_ = (size_x + factor_ - 1) / factor_;
+    coarse_y_ = (size_y + factor_ - 1) / factor_;
+    coarse_marks_.resize(coarse_x_, coarse_y_);
+    fine_hits_.assign(static_cast<size_t>(coarse_x_) * coarse_y_, 0);
+    farthest_ray_.assign(static_cast<size_t>(coarse_x_) * coarse_y_, UINT32_MAX);
+    const double near_cells = near_radius_ / resolution;
+    sq_near_cells_ = near_cells * near_cells;
+  }
+
+  /**
+   * @brief Move the far points of the survivors of a block behind the near ones
+   * @param origin_x World x of the sensor
+   * @param origin_y World y of the sensor
+   * @return The number of near survivors, which come first
+   */
+  size_t partitionNear(
+    const PointBlock & block, uint32_t * survivors, size_t num_survivors, float origin_x,
+    float origin_y) const
+  {
+    const float sq_near = static_cast<float>(near_radius_ * near_radius_);
+    uint32_t * far = std::partition(survivors, survivors + num_survivors, [&](uint32_t i) {
+      const float dx = block.x[i] - origin_x;
+      const float dy = block.y[i] - origin_y;
+      return dx * dx + dy * dy < sq_near;
+    });
+    return static_cast<size_t>(far - survivors);
+  }
+
+  /**
+   * @brief Collect the mark of a far cell in its coarse cell
+   */
+  inline void addFar(unsigned int index)
+  {
+    const unsigned int my = index / size_x_;
+    const unsigned int mx = index - my * size_x_;
+    const unsigned int cy = my / factor_, cx = mx / factor_;
+    const unsigned int coarse = cy * coarse_x_ + cx;
+    fine_hits_[coarse] |= uint64_t{1} << ((my - cy * factor_) * factor_ + (mx - cx * factor_));
+    coarse_marks_.add(coarse);
+  }
+
+  /**
+   * @brief Hand the fine cells hit in every collected coarse cell to a batch and drop the marks
+   */
+  void expandInto(CellBatch & batch)
+  {
+    if (!enabled() || coarse_marks_.empty()) {
+      return;
+    }
+    coarse_marks_.flush([&](unsigned int coarse) {
+      const unsigned int cy = coarse / coarse_x_;
+      const unsigned int cx = coarse - cy * coarse_x_;
+      const unsigned int base = cy * factor_ * size_x_ + cx * factor_;
+      // only bits of fine cells inside the layer are ever set
+      for (uint64_t hits = fine_hits_[coarse]; hits; hits &= hits - 1) {
+        const unsigned int bit = static_cast<unsigned int>(__builtin_ctzll(hits));
+        const unsigned int dy = bit / factor_;
+        batch.add(base + dy * size_x_ + (bit - dy * factor_));
+      }
+      fine_hits_[coarse] = 0;
+      return true;
+    });
+  }
+
+  /**
+   * @brief Keep the near rays and the farthest far ray per coarse endpoint cell, in place
+   * @param rays Rays with x1 and y1 endpoint cells
+   * @param x0 Map x of the sensor origin
+   * @param y0 Map y of the sensor origin
+   */
+  template<typename Ray>
+  void cullFarRays(std::vector<Ray> & rays, unsigned int x0, unsigned int y0)
+  {
+    if (!enabled()) {
+      return;
+    }
+    auto sq_length = [&](const Ray & ray) {
+      const double dx = static_cast<double>(ray.x1) - x0;
+      const double dy = static_cast<double>(ray.y1) - y0;
+      return dx * dx + dy * dy;
+    };
+
+    touched_.clear();
+    size_t kept = 0;
+    for (size_t i = 0; i < rays.size(); ++i) {
+      const Ray ray = rays[i];
+      if (sq_length(ray) <= sq_near_cells_) {
+        rays[kept++] = ray;
+        continue;
+      }
+      const size_t coarse = static_cast<size_t>(ray.y1 / factor_) * coarse_x_ + ray.x1 / factor_;
+      uint32_t & slot = farthest_ray_[coarse];
+      if (slot == UINT32_MAX) {
+        slot = static_cast<uint32_t>(kept);
+        touched_.push_back(coarse);
+        rays[kept++] = ray;
+      } else if (sq_length(ray) > sq_length(rays[slot])) {
+        rays[slot] = ray;
+      }
+    }
+    rays.resize(kept);
+
+    for (const size_t coarse : touched_) {
+      farthest_ray_[coarse] = UINT32_MAX;
+    }
+  }
+
+private:
+  unsigned int factor_ = 1;
+  double near_radius_ = 0.0;
+  double sq_near_cells_ = 0.0;
+  unsigned int size_x_ = 0, size_y_ = 0;
+  unsigned int coarse_x_ = 0, coarse_y_ = 0;
+  /// @brief Coarse cells marked during the current update
+  CellBatch coarse_marks_;
+  /// @brief Per coarse cell, a bit for each of its fine cells hit during the current update
+  std::vector<uint64_t> fine_hits_;
+  /// @brief Per coarse cell, the index of the kept ray ending in it, UINT32_MAX when none
+  std::vector<uint32_t> farthest_ray_;
+  std::vector<size_t> touched_;
+};
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__FAR_FIELD_LOD_HPP_
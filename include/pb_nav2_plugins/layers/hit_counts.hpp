@@ -0,0 +1,137 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__HIT_COUNTS_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__HIT_COUNTS_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "pb_nav2_plugins/layers/rolling_shift.hpp"
+
+namespace pb_nav2_costmap_2d
+{
+
+/**
+ * @class HitCounts
+ * @brief Saturating per-cell hit counters of the hit_count occupancy mode
+ *
+ * Every observation adds its hits to the cells it marks once, a cell is occupied while its count
+ * is at least the threshold. Counts decay by one per decay period and clearing drops them to
+ * zero, so a cell stays occupied without being marked again every update.
+ */
+class HitCounts
+{
+public:
+  /**
+   * @brief Enable the counters
+   * @param increment Hits added per observation that marks a cell
+   * @param threshold Hits at which a cell is occupied
+   * @param max Hits at which a count saturates
+   */
+  void configure(unsigned int increment, unsigned int threshold, unsigned int max)
+  {
+    max_ = std::min(std::max(max, 1u), 255u);
+    threshold_ = std::min(std::max(threshold, 1u), max_);
+    increment_ = std::min(std::max(increment, 1u), max_);
+  }
+
+  /**
+   * @brief Whether the hit_count mode is enabled
+   */
+  bool enabled() const { return threshold_ > 0; }
+
+  /**
+   * @brief Go back to the binary mode and free the counters
+   */
+  void disable()
+  {
+    threshold_ = 0;
+    counts_.clear();
+    counts_.shrink_to_fit();
+  }
+
+  /**
+   * @brief Match the size of the layer, every count starts at zero
+   */
+  void resize(unsigned int size_x, unsigned int size_y)
+  {
+    size_x_ = size_x;
+    size_y_ = size_y;
+    counts_.assign(static_cast<size_t>(size_x) * size_y, 0);
+  }
+
+  void reset() { std::fill(counts_.begin(), counts_.end(), 0); }
+
+  /**
+   * @brief Follow shiftMapInPlace of the layer, the cells that scroll in start at zero
+   */
+  void shift(int shift_x, int shift_y)
+  {
+    shiftMapInPlace(counts_.data(), size_x_, size_y_, shift_x, shift_y, uint8_t{0});
+  }
+
+  /**
+   * @brief Add the hits of one observation to a cell
+   * @return True if the cell is occupied
+   */
+  inline bool hit(unsigned int index)
+  {
+    uint8_t & count = counts_[index];
+    count = static_cast<uint8_t>(std::min(count + increment_, max_));
+    return count >= threshold_;
+  }
+
+  /**
+   * @brief Drop the count of a cell that was seen free
+   */
+  inline void clear(unsigned int index) { counts_[index] = 0; }
+
+  /**
+   * @brief Take a number of hits from every cell
+   * @param steps Hits to take
+   * @param release Callable taking (unsigned int index), called for every cell that was occupied
+   *        and no longer is
+   */
+  template<typename Release>
+  void decay(unsigned int steps, Release && release)
+  {
+    for (size_t i = 0; i < counts_.size(); ++i) {
+      const unsigned int count = counts_[i];
+      if (count == 0) {
+        continue;
+      }
+      const unsigned int decayed = count > steps ? count - steps : 0;
+      counts_[i] = static_cast<uint8_t>(decayed);
+      if (count >= threshold_ && decayed < threshold_) {
+        release(static_cast<unsigned int>(i));
+      }
+    }
+  }
+
+  /**
+   * @brief The counter array, null when the mode is disabled
+   */
+  uint8_t * data() { return counts_.empty() ? nullptr : counts_.data(); }
+
+private:
+  unsigned int size_x_ = 0, size_y_ = 0;
+  unsigned int increment_ = 1, threshold_ = 0, max_ = 255;
+  std::vector<uint8_t> counts_;
+};
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__HIT_COUNTS_HPP_
@@ -16,10 +16,13 @@
 #ifndef PB_NAV2_PLUGINS__LAYERS__INTENSITY_OBSTACLE_LAYER_HPP_
 #define PB_NAV2_PLUGINS__LAYERS__INTENSITY_OBSTACLE_LAYER_HPP_
 
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
 #include "laser_geometry/laser_geometry.hpp"
 #include "rclcpp/rclcpp.hpp"
 #pragma GCC diagnostic push
@@ -30,8 +33,18 @@
 #include "nav2_costmap_2d/costmap_layer.hpp"
 #include "nav2_costmap_2d/footprint.hpp"
 #include "nav2_costmap_2d/layered_costmap.hpp"
-#include "nav2_costmap_2d/observation_buffer.hpp"
 #include "nav_msgs/msg/occupancy_grid.hpp"
+#include "pb_nav2_plugins/layers/cell_batch.hpp"
+#include "pb_nav2_plugins/layers/dirty_tiles.hpp"
+#include "pb_nav2_plugins/layers/far_field_lod.hpp"
+#include "pb_nav2_plugins/layers/hit_counts.hpp"
+#include "pb_nav2_plugins/layers/layer_stats.hpp"
+#include "pb_nav2_plugins/layers/observation_store.hpp"
+#include "pb_nav2_plugins/layers/point_filter.hpp"
+#include "pb_nav2_plugins/layers/ray_culler.hpp"
+#include "pb_nav2_plugins/layers/raytrace_batch.hpp"
+#include "pb_nav2_plugins/layers/scan_projector.hpp"
+#include "pb_nav2_plugins/layers/worker_pool.hpp"
 #include "sensor_msgs/msg/laser_scan.hpp"
 #include "sensor_msgs/msg/point_cloud.hpp"
 #include "sensor_msgs/msg/point_cloud2.hpp"
@@ -101,6 +114,16 @@ public:
    */
   virtual void reset();
 
+  /**
+   * @brief Match the size of the master costmap
+   */
+  virtual void matchSize();
+
+  /**
+   * @brief Update the layer's origin to a new pose, often when in a rolling costmap
+   */
+  virtual void updateOrigin(double new_origin_x, double new_origin_y);
+
   /**
    * @brief If clearing operations should be processed on this layer or not
    */
@@ -125,7 +148,7 @@ public:
    */
   void laserScanCallback(
     sensor_msgs::msg::LaserScan::ConstSharedPtr message,
-    const std::shared_ptr<nav2_costmap_2d::ObservationBuffer> & buffer);
+    const std::shared_ptr<ObservationStore> & buffer);
 
   /**
    * @brief A callback to handle buffering LaserScan messages which need filtering to turn Inf values into range_max.
@@ -134,7 +157,20 @@ public:
    */
   void laserScanValidInfCallback(
     sensor_msgs::msg::LaserScan::ConstSharedPtr message,
-    const std::shared_ptr<nav2_costmap_2d::ObservationBuffer> & buffer);
+    const std::shared_ptr<ObservationStore> & buffer);
+
+  /**
+   * @brief A callback to handle buffering LaserScan messages without projecting them into a
+   * PointCloud2, used by sources with direct_scan_projection
+   * @param message The message returned from a message notifier
+   * @param buffer A pointer to the observation buffer to update
+   * @param projector The beam tables of the source
+   * @param inf_is_valid Whether Inf values are read as range_max
+   */
+  void laserScanDirectCallback(
+    sensor_msgs::msg::LaserScan::ConstSharedPtr message,
+    const std::shared_ptr<ObservationStore> & buffer,
+    const std::shared_ptr<ScanProjector> & projector, bool inf_is_valid);
 
   /**
    * @brief  A callback to handle buffering PointCloud2 messages
@@ -143,7 +179,7 @@ public:
    */
   void pointCloud2Callback(
     sensor_msgs::msg::PointCloud2::ConstSharedPtr message,
-    const std::shared_ptr<nav2_costmap_2d::ObservationBuffer> & buffer);
+    const std::shared_ptr<ObservationStore> & buffer);
 
   // for testing purposes
   void addStaticObservation(nav2_costmap_2d::Observation & obs, bool marking, bool clearing);
@@ -155,16 +191,84 @@ protected:
    * @param marking_observations A reference to a vector that will be populated with the observations
    * @return True if all the observation buffers are current, false otherwise
    */
-  bool getMarkingObservations(
-    std::vector<nav2_costmap_2d::Observation> & marking_observations) const;
+  bool getMarkingObservations(std::vector<StoredObservation> & marking_observations) const;
 
   /**
    * @brief  Get the observations used to clear space
    * @param clearing_observations A reference to a vector that will be populated with the observations
    * @return True if all the observation buffers are current, false otherwise
    */
-  bool getClearingObservations(
-    std::vector<nav2_costmap_2d::Observation> & clearing_observations) const;
+  bool getClearingObservations(std::vector<StoredObservation> & clearing_observations) const;
+
+  /**
+   * @brief Turn a cloud into an observation and store it, preparing it first when
+   * async_preprocessing is enabled
+   */
+  void bufferObservation(
+    const sensor_msgs::msg::PointCloud2::ConstSharedPtr & cloud,
+    const std::shared_ptr<ObservationStore> & buffer);
+
+  /**
+   * @brief Decode, transform and filter the cloud of an observation on the subscription thread
+   *
+   * Runs without the costmap lock, so it only reads what is fixed after onInitialize.
+   *
+   * @param min_intensity Lower bound of the intensity window the marking points are filtered with
+   * @param max_intensity Upper bound of the intensity window the marking points are filtered with
+   */
+  std::shared_ptr<const PreparedCloud> prepareObservation(
+    const StoredObservation & observation, bool marking, bool clearing, double min_intensity,
+    double max_intensity) const;
+
+  /**
+   * @brief Project, transform and filter the beams of a scan
+   * @param projector Beam tables, only ever used by one thread
+   * @param min_intensity Lower bound of the intensity window the marking points are filtered with
+   * @param max_intensity Upper bound of the intensity window the marking points are filtered with
+   */
+  std::shared_ptr<const PreparedCloud> prepareScan(
+    const StoredObservation & observation, const sensor_msgs::msg::LaserScan::ConstSharedPtr & scan,
+    ScanProjector & projector, bool inf_is_valid, bool marking, bool clearing,
+    double min_intensity, double max_intensity) const;
+
+  /**
+   * @brief The prepared cloud of a marking observation, null if there is none or it was filtered
+   * with another intensity window than the current one
+   */
+  const PreparedCloud * preparedMarking(const StoredObservation & marking_observation) const;
+
+  /**
+   * @brief Collect the marks of an observation from its prepared cloud
+   */
+  void markPrepared(const StoredObservation & marking_observation, const PreparedCloud & prepared);
+
+  /**
+   * @brief Collect the cells of a block of prepared marking points
+   * @return The number of points of the block
+   */
+  virtual size_t markPreparedBlock(
+    const StoredObservation & marking_observation, const PointBlock & block);
+
+  /// @brief State of the clearing pass over one observation
+  struct ClearingPass
+  {
+    const StoredObservation * observation = nullptr;
+    /// @brief Sensor origin in world coordinates
+    double ox = 0.0, oy = 0.0, oz = 0.0;
+    /// @brief Sensor origin in cells, used by the 2D layer
+    unsigned int x0 = 0, y0 = 0;
+    /// @brief Sensor origin in continuous voxel coordinates, used by the voxel layer
+    double sensor_x = 0.0, sensor_y = 0.0, sensor_z = 0.0;
+    RaytraceBatch batch;
+  };
+
+  /**
+   * @brief Mark and clear with every observation, clearing before marking
+   *
+   * Marks are only collected here and written once all observations have been traced. In fused
+   * mode a source that both marks and clears is decoded once for both.
+   */
+  void processObservations(double * min_x, double * min_y, double * max_x, double * max_y);
 
   /**
    * @brief  Clear freespace based on one observation
@@ -174,17 +278,120 @@ protected:
    * @param max_x
    * @param max_y
    */
-  virtual void raytraceFreespace(
-    const nav2_costmap_2d::Observation & clearing_observation, double * min_x, double * min_y,
-    double * max_x, double * max_y);
+  void raytraceFreespace(
+    const StoredObservation & clearing_observation, double * min_x, double * min_y, double * max_x,
+    double * max_y);
 
   /**
-   * @brief Process update costmap with raytracing the window bounds
+   * @brief Start clearing with one observation
+   * @return False if the observation cannot be raytraced
    */
-  void updateRaytraceBounds(
-    double ox, double oy, double wx, double wy, double max_range, double min_range, double * min_x,
+  virtual bool beginClearing(
+    const StoredObservation & clearing_observation, ClearingPass & pass, double * min_x,
     double * min_y, double * max_x, double * max_y);
 
+  /**
+   * @brief Collect the clearing rays of a block of points in the global frame
+   */
+  virtual void addClearingBlock(ClearingPass & pass, const PointBlock & block);
+
+  /**
+   * @brief Trace the collected clearing rays and widen the bounds
+   */
+  virtual void endClearing(
+    ClearingPass & pass, double * min_x, double * min_y, double * max_x, double * max_y);
+
+  /**
+   * @brief Collect the marks of one observation
+   */
+  virtual void markObservation(const StoredObservation & marking_observation);
+
+  /**
+   * @brief Clear and collect the marks of a source that both marks and clears in one pass
+   */
+  virtual void markAndClear(
+    const StoredObservation & marking_observation, const StoredObservation & clearing_observation,
+    double * min_x, double * min_y, double * max_x, double * max_y);
+
+  /**
+   * @brief Filter thresholds of a marking observation
+   */
+  PointFilterParams makeMarkingParams(const StoredObservation & marking_observation) const;
+
+  /**
+   * @brief Collect the cells of the points of a block that pass the marking filter
+   * @return The number of points that passed the filter
+   */
+  size_t markBlock(
+    const PointBlock & block, const PointFilterParams & params, const MapGeometry & map);
+
+  /**
+   * @brief Collect the cells of the selected points of a block, the far ones per coarse cell when
+   * far_lod_factor is set
+   * @param origin_x World x of the sensor
+   * @param origin_y World y of the sensor
+   */
+  void addMarks(
+    const PointBlock & block, size_t num_survivors, const MapGeometry & map, float origin_x,
+    float origin_y);
+
+  /**
+   * @brief Trace the collected clearing rays on the worker pool and apply the cleared cells
+   * @param x0 Map x of the sensor origin
+   * @param y0 Map y of the sensor origin
+   * @param max_length Maximum raytrace length in cells
+   * @param min_length Minimum raytrace length in cells
+   */
+  void raytraceInParallel(
+    unsigned int x0, unsigned int y0, unsigned int max_length, unsigned int min_length);
+
+  /**
+   * @brief Store and log the speedup of one parallel clearing pass
+   * @param num_rays Number of rays traced
+   * @param start Time the pass was started
+   * @param busy_ns Summed time the workers spent tracing
+   */
+  void reportClearingSpeedup(
+    size_t num_rays, std::chrono::steady_clock::time_point start, int64_t busy_ns);
+
+  /**
+   * @brief Widen the update window by the cells written by the last flush of a batch
+   */
+  void touchBatchBounds(
+    const CellBatch & batch, double * min_x, double * min_y, double * max_x, double * max_y);
+
+  /**
+   * @brief Drop the clearing observations until clearing_interval has passed and, in the
+   * hit_count mode, the marking observations whose hits were already counted
+   */
+  void selectObservations();
+
+  /**
+   * @brief Take the hits of the decay periods that passed, the cells that are no longer occupied
+   * go back to the default value
+   */
+  void decayHits(double * min_x, double * min_y, double * max_x, double * max_y);
+
+  /**
+   * @brief In the hit_count mode, keep the distinct cells the last observation marked, each of
+   * them takes one hit once the update has cleared
+   */
+  void collectObservationHits();
+
+  /**
+   * @brief Close the stats cycle of the previous update and publish the stats when due
+   */
+  void recordStatsCycle();
+
+  /**
+   * @brief Whether the master may hold unknown cells when this layer merges into it
+   *
+   * The master window is reset to free space when unknown is not tracked, but a layer merged
+   * before this one may still write unknown cells into it, for example a static layer with
+   * track_unknown_space. Only the first layer can rely on the reset.
+   */
+  bool masterMayHoldUnknown() const;
+
   std::vector<geometry_msgs::msg::Point> transformed_footprint_;
   bool footprint_clearing_enabled_;
   /**
@@ -194,6 +401,12 @@ protected:
     double robot_x, double robot_y, double robot_yaw, double * min_x, double * min_y,
     double * max_x, double * max_y);
 
+  /**
+   * @brief Write free space into the transformed footprint, setConvexPolygonCost that fills the
+   * polygon again only when it covers other cells than last time
+   */
+  void clearFootprint();
+
   std::string global_frame_;       ///< @brief The global frame for the costmap
   double min_obstacle_height_;     ///< @brief Min Obstacle Height
   double max_obstacle_height_;     ///< @brief Max Obstacle Height
@@ -208,18 +421,88 @@ protected:
   /// @brief Used to make sure that transforms are available for each sensor
   std::vector<std::shared_ptr<tf2_ros::MessageFilterBase>> observation_notifiers_;
   /// @brief Used to store observations from various sensors
-  std::vector<std::shared_ptr<nav2_costmap_2d::ObservationBuffer>> observation_buffers_;
+  std::vector<std::shared_ptr<ObservationStore>> observation_buffers_;
   /// @brief Used to store observation buffers used for marking obstacles
-  std::vector<std::shared_ptr<nav2_costmap_2d::ObservationBuffer>> marking_buffers_;
+  std::vector<std::shared_ptr<ObservationStore>> marking_buffers_;
   /// @brief Used to store observation buffers used for clearing obstacles
-  std::vector<std::shared_ptr<nav2_costmap_2d::ObservationBuffer>> clearing_buffers_;
+  std::vector<std::shared_ptr<ObservationStore>> clearing_buffers_;
+  /// @brief Observations gathered for the current update, reused between updates
+  std::vector<StoredObservation> marking_observations_, clearing_observations_;
+  /// @brief Read each cloud of a source that both marks and clears only once
+  bool fused_mark_clear_ = false;
+  /// @brief Per clearing observation, the index of the marking observation it is fused with or -1
+  std::vector<int> fused_clearing_;
+  /// @brief Per marking observation, whether it is handled by a fused pass
+  std::vector<bool> fused_marking_;
+  /// @brief Decode, transform and filter clouds as they arrive instead of in updateBounds
+  bool async_preprocessing_ = false;
+  /// @brief Intensity window read by the subscription thread, mirrors the window of the layer
+  std::atomic<double> prepare_min_intensity_{0.0}, prepare_max_intensity_{0.0};
+  /// @brief Beam tables of the update thread, for scans filtered with an old intensity window
+  ScanProjector scan_projector_;
 
   /// @brief Dynamic parameters handler
   rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr dyn_params_handler_;
 
   // Used only for testing purposes
-  std::vector<nav2_costmap_2d::Observation> static_clearing_observations_;
-  std::vector<nav2_costmap_2d::Observation> static_marking_observations_;
+  std::vector<StoredObservation> static_clearing_observations_;
+  std::vector<StoredObservation> static_marking_observations_;
+
+  /// @brief Scratch buffers of the batch marking filter
+  MarkingScratch marking_scratch_;
+  /// @brief Distinct cells marked during the current update
+  CellBatch marking_batch_;
+
+  /// @brief Line endpoint of a clearing ray, in cells and in world coordinates
+  struct ClearingRay
+  {
+    unsigned int x1, y1;
+    double wx, wy;
+  };
+  /// @brief Workers of the parallel clearing mode, null when clearing runs serially
+  std::unique_ptr<WorkerPool> clearing_pool_;
+  /// @brief Rays of the observation being cleared
+  std::vector<ClearingRay> clearing_rays_;
+  /// @brief Keeps the farthest ray per angular bin, disabled when clearing_angular_resolution is 0
+  AngularRayCuller ray_culler_;
+  /// @brief Angular bin width of the ray culler in radians
+  double clearing_angular_resolution_ = 0.0;
+  /// @brief Per-worker bitmasks of traced cells, kept zeroed between passes
+  std::vector<std::vector<uint64_t>> clearing_masks_;
+  /// @brief Speedup of the last parallel clearing pass, busy time over wall time
+  double clearing_speedup_ = 1.0;
+
+  /// @brief Per-cell hit counters, only allocated in the hit_count occupancy mode
+  HitCounts hit_counts_;
+  /// @brief Seconds per hit that a count loses, 0 keeps the counts until they are cleared
+  double hit_decay_time_ = 0.0;
+  rclcpp::Time last_hit_decay_;
+  /// @brief Distinct cells marked by the current observation in the hit_count mode
+  CellBatch observation_batch_;
+  /// @brief Cells marked during the current update, once for every observation that marked them
+  std::vector<unsigned int> observation_hits_;
+  /// @brief Clouds whose hits were counted by the last update
+  std::vector<sensor_msgs::msg::PointCloud2::ConstSharedPtr> counted_clouds_, counted_scratch_;
+  /// @brief Seconds between clearing passes, 0 clears on every update
+  double clearing_interval_ = 0.0;
+  rclcpp::Time last_clearing_;
+
+  /// @brief Coarse marking and clearing beyond near_field_radius, disabled when far_lod_factor is 1
+  FarFieldLod far_lod_;
+
+  /// @brief Tiles written since the last merge and tiles that hold costs to merge
+  DirtyTiles dirty_tiles_;
+  /// @brief Footprint polygon in cells and the cells it filled, reused while the robot stays put
+  std::vector<nav2_costmap_2d::MapLocation> footprint_polygon_, footprint_polygon_scratch_;
+  std::vector<nav2_costmap_2d::MapLocation> footprint_cells_;
+
+  /// @brief Stage timings and point counts, records nothing unless stats_enabled is set
+  LayerStats stats_;
+  rclcpp_lifecycle::LifecyclePublisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr
+    stats_pub_;
+  diagnostic_msgs::msg::DiagnosticArray stats_msg_;
+  rclcpp::Duration stats_publish_period_{0, 0};
+  rclcpp::Time last_stats_publish_;
 
   bool rolling_window_;
   bool was_reset_;
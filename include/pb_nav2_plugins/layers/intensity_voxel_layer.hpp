@@ -16,18 +16,23 @@
 #ifndef PB_NAV2_PLUGINS__LAYERS__INTENSITY_VOXEL_LAYER_HPP_
 #define PB_NAV2_PLUGINS__LAYERS__INTENSITY_VOXEL_LAYER_HPP_
 
+#include <limits>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "laser_geometry/laser_geometry.hpp"
 #include "message_filters/subscriber.h"
 #include "nav2_costmap_2d/layer.hpp"
 #include "nav2_costmap_2d/layered_costmap.hpp"
-#include "nav2_costmap_2d/observation_buffer.hpp"
 #include "nav2_costmap_2d/obstacle_layer.hpp"
 #include "nav2_msgs/msg/voxel_grid.hpp"
 #include "nav2_voxel_grid/voxel_grid.hpp"
 #include "nav_msgs/msg/occupancy_grid.hpp"
 #include "pb_nav2_plugins/layers/intensity_obstacle_layer.hpp"
+#include "pb_nav2_plugins/layers/tiled_voxel_grid.hpp"
+#include "pb_nav2_plugins/layers/vertical_remap.hpp"
+#include "pb_nav2_plugins/layers/voxel_gpu_backend.hpp"
 #include "rclcpp/rclcpp.hpp"
 #include "sensor_msgs/msg/laser_scan.hpp"
 #include "sensor_msgs/msg/point_cloud2.hpp"
@@ -94,6 +99,16 @@ public:
     */
   void reset() override;
 
+  /**
+    * @brief Activate the layer, starting from the snapshot_file when it matches the layer
+    */
+  void activate() override;
+
+  /**
+    * @brief Deactivate the layer, writing the snapshot_file when one is set
+    */
+  void deactivate() override;
+
   /**
     * @brief If clearing operations should be processed on this layer or not
     */
@@ -105,17 +120,179 @@ protected:
     */
   void resetMaps() override;
 
+  /**
+    * @brief Start clearing with one observation
+    */
+  bool beginClearing(
+    const StoredObservation & clearing_observation, ClearingPass & pass, double * min_x,
+    double * min_y, double * max_x, double * max_y) override;
+
+  /**
+    * @brief Collect the voxel clearing rays of a block of points in the global frame
+    */
+  void addClearingBlock(ClearingPass & pass, const PointBlock & block) override;
+
   /**
     * @brief Use raycasting between 2 points to clear freespace
     */
-  void raytraceFreespace(
-    const nav2_costmap_2d::Observation & clearing_observation, double * min_x, double * min_y,
-    double * max_x, double * max_y) override;
+  void endClearing(
+    ClearingPass & pass, double * min_x, double * min_y, double * max_x, double * max_y) override;
+
+  /**
+    * @brief Collect the voxel marks of one observation
+    */
+  void markObservation(const StoredObservation & marking_observation) override;
+
+  /**
+    * @brief Clear and collect the voxel marks of a source that both marks and clears in one pass
+    */
+  void markAndClear(
+    const StoredObservation & marking_observation, const StoredObservation & clearing_observation,
+    double * min_x, double * min_y, double * max_x, double * max_y) override;
+
+  /**
+    * @brief Collect the voxels of the points of a block that pass the marking filter
+    * @return The number of points that passed the filter
+    */
+  size_t markVoxelBlock(const PointBlock & block, const PointFilterParams & params);
+
+  /**
+    * @brief Collect the voxels of a block of prepared marking points
+    */
+  size_t markPreparedBlock(
+    const StoredObservation & marking_observation, const PointBlock & block) override;
+
+  /**
+    * @brief Collect the voxels of the selected points of a block
+    */
+  void markVoxels(const PointBlock & block, size_t num_survivors);
+
+  /**
+    * @brief Levels a column of the selected voxel storage can hold
+    */
+  int maxVoxelLevels() const;
+
+  /**
+    * @brief Offset added to unknown_threshold for the levels a column does not use
+    */
+  int unusedVoxelBits() const;
+
+  /**
+    * @brief Copy every column of the selected voxel storage, up to 16 levels
+    * @param data size_x * size_y columns in the layout of VoxelGrid::getData
+    */
+  void readColumns(uint32_t * data);
+
+  /**
+    * @brief Replace every column of the selected voxel storage
+    * @param data size_x * size_y columns in the layout of VoxelGrid::getData
+    */
+  void writeColumns(const uint32_t * data);
+
+  /**
+    * @brief Move the columns from the old vertical parameters onto the current ones in place of a
+    * matchSize, so the layer keeps what it has seen
+    */
+  void remapLevels(double old_origin_z, double old_z_resolution, int old_size_z);
+
+  /**
+    * @brief Make the costmap cell of a column follow a change of its levels
+    *
+    * A column that is no longer occupied was not seen free, so its cell goes back to the default.
+    */
+  inline void followColumn(unsigned int index, unsigned int marked_count)
+  {
+    const bool occupied = marked_count > static_cast<unsigned int>(mark_threshold_);
+    if (occupied && costmap_[index] != nav2_costmap_2d::LETHAL_OBSTACLE) {
+      costmap_[index] = nav2_costmap_2d::LETHAL_OBSTACLE;
+    } else if (!occupied && costmap_[index] == nav2_costmap_2d::LETHAL_OBSTACLE) {
+      costmap_[index] = default_value_;
+    }
+  }
+
+  /**
+    * @brief Write the costmap and the columns to the snapshot_file
+    */
+  void saveSnapshot();
+
+  /**
+    * @brief Start from the snapshot_file if it holds a map of the same size and frame, remapping
+    * its columns when the vertical parameters changed since it was written
+    */
+  void loadSnapshot();
+
+  /**
+    * @brief Publish the voxel map, or only the columns changed since the last publish
+    */
+  void publishVoxelMap();
+
+  /**
+    * @brief Empty the clearing endpoint cloud for the current update, keeping its capacity
+    */
+  void resetClearingEndpoints();
+
+  /**
+    * @brief Publish the clearing endpoints gathered during the current update as one cloud
+    */
+  void publishClearingEndpoints();
+
+  /**
+    * @brief Trace the collected voxel clearing rays on the worker pool and apply the cleared bits
+    */
+  void raytraceVoxelsInParallel(
+    double sensor_x, double sensor_y, double sensor_z, unsigned int max_length,
+    unsigned int min_length);
+
+  /// @brief Line endpoint of a voxel clearing ray, in map and in world coordinates
+  struct VoxelRay
+  {
+    double x1, y1, z1;
+    double wx, wy, wz;
+  };
+  /// @brief Rays of the observation being cleared
+  std::vector<VoxelRay> clearing_voxel_rays_;
+  /// @brief Per-worker masks of cleared voxel bits per column, kept zeroed between passes
+  std::vector<std::vector<uint32_t>> clearing_column_masks_;
+
+  /// @brief Voxels marked during the current update
+  std::vector<VoxelMark> pending_voxel_marks_;
+  /// @brief Messages refilled in place for every publish
+  nav2_msgs::msg::VoxelGrid voxel_grid_msg_;
+  /// @brief Clearing endpoints of the current update, appended to as the observations are traced
+  sensor_msgs::msg::PointCloud2 clearing_endpoints_;
+  /// @brief Whether the current update gathers its clearing endpoints for publishing
+  bool collect_clearing_endpoints_ = false;
 
   bool publish_voxel_;
   rclcpp_lifecycle::LifecyclePublisher<nav2_msgs::msg::VoxelGrid>::SharedPtr voxel_pub_;
+  /// @brief Publisher of the changed columns between two full voxel maps, null without updates
+  rclcpp_lifecycle::LifecyclePublisher<nav2_msgs::msg::VoxelGrid>::SharedPtr voxel_updates_pub_;
+  nav2_msgs::msg::VoxelGrid voxel_update_msg_;
+  /// @brief Publishes between two full voxel maps, 0 always publishes the full map
+  int voxel_keyframe_interval_ = 0;
+  int voxel_deltas_since_keyframe_ = 0;
+  /// @brief Set when the columns moved or were reset, so an update cannot describe the change
+  bool voxel_keyframe_needed_ = true;
+  /// @brief Minimum time between two voxel map publishes, zero publishes on every update
+  rclcpp::Duration voxel_publish_period_{0, 0};
+  rclcpp::Time last_voxel_publish_;
+  /// @brief Columns changed since the last voxel map publish, inclusive, empty when min > max
+  int voxel_dirty_min_x_ = std::numeric_limits<int>::max();
+  int voxel_dirty_min_y_ = std::numeric_limits<int>::max();
+  int voxel_dirty_max_x_ = std::numeric_limits<int>::min();
+  int voxel_dirty_max_y_ = std::numeric_limits<int>::min();
   nav2_voxel_grid::VoxelGrid voxel_grid_;
+  /// @brief Sparse storage used instead of voxel_grid_ when voxel_storage is tiled, else null
+  std::unique_ptr<TiledVoxelGrid> tiled_voxel_grid_;
+  /// @brief Device storage used instead of voxel_grid_ when voxel_storage is cuda, else null
+  std::unique_ptr<VoxelGpuBackend> gpu_voxel_grid_;
+  /// @brief Transfer buffers of the device storage, reused between updates
+  std::vector<VoxelGpuBackend::Endpoint> gpu_endpoints_;
+  std::vector<VoxelGpuBackend::CellUpdate> gpu_updates_;
+  std::vector<uint8_t> gpu_occupied_;
   double z_resolution_, origin_z_;
+  /// @brief File the grid is written to on deactivate and read from on activate, empty for none
+  std::string snapshot_file_;
   int unknown_threshold_, mark_threshold_, size_z_;
   rclcpp_lifecycle::LifecyclePublisher<sensor_msgs::msg::PointCloud2>::SharedPtr
     clearing_endpoints_pub_;
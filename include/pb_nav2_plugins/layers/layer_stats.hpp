@@ -0,0 +1,167 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__LAYER_STATS_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__LAYER_STATS_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "diagnostic_msgs/msg/diagnostic_status.hpp"
+
+namespace pb_nav2_costmap_2d
+{
+
+/**
+ * @class LayerStats
+ * @brief Per-stage timings and point counts of the update cycles of a layer
+ *
+ * A cycle runs from one updateBounds to the next, so it holds the updateCosts that follows its
+ * updateBounds. The totals of the last window cycles are kept to report rolling percentiles.
+ * While disabled, every recording call returns after testing a single flag and no clock is read.
+ */
+class LayerStats
+{
+public:
+  enum Stage : unsigned int
+  {
+    FETCH,         ///< @brief Gathering the observations of the cycle
+    CLEARING,      ///< @brief Clearing passes, including the marks collected by fused passes
+    MARKING,       ///< @brief Collecting and writing the marks
+    FOOTPRINT,     ///< @brief Footprint clearing, in updateBounds and updateCosts
+    UPDATE_COSTS,  ///< @brief Merging into the master costmap
+    NUM_STAGES
+  };
+
+  /**
+   * @class LayerStats::StageTimer
+   * @brief Adds the time until its destruction to a stage of the current cycle
+   */
+  class StageTimer
+  {
+  public:
+    StageTimer(LayerStats & stats, Stage stage)
+    : stats_(stats.enabled_ ? &stats : nullptr), stage_(stage)
+    {
+      if (stats_) {
+        start_ = std::chrono::steady_clock::now();
+      }
+    }
+
+    ~StageTimer() { stop(); }
+
+    /**
+     * @brief Add the time until now and stop, before the end of the scope
+     */
+    void stop()
+    {
+      if (stats_) {
+        stats_->cycle_ns_[stage_] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                       std::chrono::steady_clock::now() - start_)
+                                       .count();
+        stats_ = nullptr;
+      }
+    }
+
+    StageTimer(const StageTimer &) = delete;
+    StageTimer & operator=(const StageTimer &) = delete;
+
+  private:
+    LayerStats * stats_;
+    Stage stage_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  /**
+   * @brief Enable or disable recording and drop what was recorded
+   * @param enabled Whether cycles are recorded
+   * @param window Number of cycles the percentiles are taken over
+   * @param source_names Names of the observation sources, indexed like StoredObservation::source
+   */
+  void configure(bool enabled, size_t window, const std::vector<std::string> & source_names);
+
+  inline bool enabled() const { return enabled_; }
+
+  /**
+   * @brief Count the points a marking pass read from a source and the ones it accepted
+   * @param source Index of the source, negative for static observations
+   */
+  inline void addPoints(int source, size_t points_in, size_t points_accepted)
+  {
+    if (!enabled_) {
+      return;
+    }
+    const size_t index = source < 0 ? sources_.size() - 1 : static_cast<size_t>(source);
+    sources_[index].cycle_in += points_in;
+    sources_[index].cycle_accepted += points_accepted;
+  }
+
+  /**
+   * @brief Count the clearing rays traced in the current cycle
+   */
+  inline void addRays(size_t rays)
+  {
+    if (enabled_) {
+      cycle_rays_ += rays;
+    }
+  }
+
+  /**
+   * @brief Close the current cycle and move its totals into the window
+   */
+  void endCycle();
+
+  /**
+   * @brief Number of closed cycles in the window
+   */
+  size_t cycles() const { return count_; }
+
+  /**
+   * @brief Write the rolling percentiles and the counts of the last cycle as key values
+   */
+  void fillStatus(diagnostic_msgs::msg::DiagnosticStatus & status) const;
+
+private:
+  /**
+   * @brief The q quantile of the last cycles of a ring, in milliseconds
+   */
+  double percentile(const std::vector<int64_t> & ring, double q) const;
+
+  struct SourceCounts
+  {
+    std::string name;
+    size_t cycle_in = 0, cycle_accepted = 0;
+    size_t last_in = 0, last_accepted = 0;
+  };
+
+  bool enabled_ = false;
+  size_t window_ = 0;
+  /// @brief Cycles in the rings, at most window_, and the ring slot of the next cycle
+  size_t count_ = 0, next_ = 0;
+  int64_t cycle_ns_[NUM_STAGES] = {};
+  size_t cycle_rays_ = 0, last_rays_ = 0;
+  /// @brief Per stage and for the whole cycle, the nanoseconds of the last window_ cycles
+  std::vector<int64_t> stage_rings_[NUM_STAGES];
+  std::vector<int64_t> total_ring_;
+  /// @brief One entry per source plus a last one for the static observations
+  std::vector<SourceCounts> sources_;
+  mutable std::vector<int64_t> sorted_;
+};
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__LAYER_STATS_HPP_
@@ -0,0 +1,259 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__MARKING_KERNEL_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__MARKING_KERNEL_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "pb_nav2_plugins/layers/point_filter.hpp"
+#include "sensor_msgs/msg/point_cloud2.hpp"
+#include "sensor_msgs/point_cloud2_iterator.hpp"
+
+namespace pb_nav2_costmap_2d
+{
+
+/**
+ * @struct CloudLayout
+ * @brief Byte layout of the x, y, z and intensity fields of a PointCloud2, resolved once per cloud
+ */
+struct CloudLayout
+{
+  uint32_t point_step = 0;
+  uint32_t x_offset = 0;
+  uint32_t y_offset = 0;
+  uint32_t z_offset = 0;
+  uint32_t intensity_offset = 0;
+  /// @brief PointField datatype of the intensity field
+  uint8_t intensity_datatype = 0;
+  /// @brief x, y and z are little-endian FLOAT32 and the intensity is a FLOAT32, UINT8 or UINT16
+  /// field, all readable straight from the raw bytes
+  bool raw = false;
+  /// @brief The point starts with a packed x, y, z, intensity FLOAT32 block
+  bool packed_xyzi = false;
+};
+
+/**
+ * @brief Packed point layout of the common x, y, z, intensity FLOAT32 clouds
+ */
+struct PackedPointXYZI
+{
+  float x;
+  float y;
+  float z;
+  float intensity;
+};
+
+/**
+ * @brief Size in bytes of the intensity datatypes read from the raw bytes, 0 for the others
+ */
+inline uint32_t rawIntensitySize(uint8_t datatype)
+{
+  switch (datatype) {
+    case sensor_msgs::msg::PointField::FLOAT32:
+      return sizeof(float);
+    case sensor_msgs::msg::PointField::UINT16:
+      return sizeof(uint16_t);
+    case sensor_msgs::msg::PointField::UINT8:
+      return sizeof(uint8_t);
+    default:
+      return 0;
+  }
+}
+
+/**
+ * @brief Resolve the field offsets and point stride of a cloud
+ * @param cloud The cloud to inspect
+ * @return The resolved layout, raw is false when the iterator path must be used
+ */
+inline CloudLayout resolveCloudLayout(const sensor_msgs::msg::PointCloud2 & cloud)
+{
+  CloudLayout layout;
+  layout.point_step = cloud.point_step;
+
+  int found = 0;
+  bool all_raw = true;
+  for (const auto & field : cloud.fields) {
+    uint32_t size = sizeof(float);
+    uint32_t * offset = nullptr;
+    if (field.name == "x") {
+      offset = &layout.x_offset;
+    } else if (field.name == "y") {
+      offset = &layout.y_offset;
+    } else if (field.name == "z") {
+      offset = &layout.z_offset;
+    } else if (field.name == "intensity") {
+      offset = &layout.intensity_offset;
+      layout.intensity_datatype = field.datatype;
+      size = rawIntensitySize(field.datatype);
+    } else {
+      continue;
+    }
+    *offset = field.offset;
+    if (offset != &layout.intensity_offset) {
+      all_raw = all_raw && field.datatype == sensor_msgs::msg::PointField::FLOAT32;
+    }
+    all_raw = all_raw && size > 0 && field.offset + size <= cloud.point_step;
+    ++found;
+  }
+
+  layout.raw = found == 4 && all_raw && !cloud.is_bigendian &&
+               cloud.data.size() >= static_cast<size_t>(cloud.width) * cloud.height *
+                                      cloud.point_step;
+  layout.packed_xyzi = layout.raw &&
+                       layout.intensity_datatype == sensor_msgs::msg::PointField::FLOAT32 &&
+                       layout.x_offset == 0 && layout.y_offset == 4 && layout.z_offset == 8 &&
+                       layout.intensity_offset == 12;
+  return layout;
+}
+
+/**
+ * @brief Visit the points of a raw cloud, reading the intensity as IntensityT
+ *
+ * Instantiated once per intensity datatype, so the per-point loop has no branch on the layout.
+ */
+template<typename IntensityT, typename Visitor>
+inline void forEachRawPoint(
+  const CloudLayout & layout, const uint8_t * data, size_t num_points, Visitor && visit)
+{
+  float x, y, z;
+  IntensityT intensity;
+  for (size_t i = 0; i < num_points; ++i, data += layout.point_step) {
+    std::memcpy(&x, data + layout.x_offset, sizeof(float));
+    std::memcpy(&y, data + layout.y_offset, sizeof(float));
+    std::memcpy(&z, data + layout.z_offset, sizeof(float));
+    std::memcpy(&intensity, data + layout.intensity_offset, sizeof(IntensityT));
+    visit(x, y, z, static_cast<float>(intensity));
+  }
+}
+
+/**
+ * @brief Visit the points of a cloud through PointCloud2ConstIterator, reading the intensity as
+ * IntensityT
+ */
+template<typename IntensityT, typename Visitor>
+inline void forEachIteratedPoint(const sensor_msgs::msg::PointCloud2 & cloud, Visitor && visit)
+{
+  sensor_msgs::PointCloud2ConstIterator<float> iter_x(cloud, "x");
+  sensor_msgs::PointCloud2ConstIterator<float> iter_y(cloud, "y");
+  sensor_msgs::PointCloud2ConstIterator<float> iter_z(cloud, "z");
+  sensor_msgs::PointCloud2ConstIterator<IntensityT> iter_i(cloud, "intensity");
+
+  for (; iter_x != iter_x.end(); ++iter_x, ++iter_y, ++iter_z, ++iter_i) {
+    visit(*iter_x, *iter_y, *iter_z, static_cast<float>(*iter_i));
+  }
+}
+
+/**
+ * @brief Visit every point of a cloud as (x, y, z, intensity)
+ *
+ * The layout is resolved once for the whole cloud and the loop is picked by the datatype of the
+ * intensity field. Packed x, y, z, intensity FLOAT32 clouds are read as one 16 byte block per
+ * point, other clouds with FLOAT32 coordinates and a FLOAT32, UINT8 or UINT16 intensity are read
+ * at their resolved offsets, and anything else falls back to the PointCloud2ConstIterator path,
+ * which reads the intensity as the type of its PointField datatype.
+ *
+ * @param cloud The cloud to walk
+ * @param visit Callable taking (float x, float y, float z, float intensity)
+ */
+template<typename Visitor>
+inline void forEachPoint(const sensor_msgs::msg::PointCloud2 & cloud, Visitor && visit)
+{
+  const CloudLayout layout = resolveCloudLayout(cloud);
+  const size_t num_points = static_cast<size_t>(cloud.width) * cloud.height;
+  const uint8_t * data = cloud.data.data();
+
+  if (layout.packed_xyzi) {
+    PackedPointXYZI point;
+    for (size_t i = 0; i < num_points; ++i, data += layout.point_step) {
+      std::memcpy(&point, data, sizeof(point));
+      visit(point.x, point.y, point.z, point.intensity);
+    }
+    return;
+  }
+
+  if (layout.raw) {
+    switch (layout.intensity_datatype) {
+      case sensor_msgs::msg::PointField::UINT8:
+        forEachRawPoint<uint8_t>(layout, data, num_points, visit);
+        return;
+      case sensor_msgs::msg::PointField::UINT16:
+        forEachRawPoint<uint16_t>(layout, data, num_points, visit);
+        return;
+      default:  // FLOAT32
+        forEachRawPoint<float>(layout, data, num_points, visit);
+        return;
+    }
+  }
+
+  switch (layout.intensity_datatype) {
+    case sensor_msgs::msg::PointField::INT8:
+      forEachIteratedPoint<int8_t>(cloud, visit);
+      return;
+    case sensor_msgs::msg::PointField::UINT8:
+      forEachIteratedPoint<uint8_t>(cloud, visit);
+      return;
+    case sensor_msgs::msg::PointField::INT16:
+      forEachIteratedPoint<int16_t>(cloud, visit);
+      return;
+    case sensor_msgs::msg::PointField::UINT16:
+      forEachIteratedPoint<uint16_t>(cloud, visit);
+      return;
+    case sensor_msgs::msg::PointField::INT32:
+      forEachIteratedPoint<int32_t>(cloud, visit);
+      return;
+    case sensor_msgs::msg::PointField::UINT32:
+      forEachIteratedPoint<uint32_t>(cloud, visit);
+      return;
+    case sensor_msgs::msg::PointField::FLOAT64:
+      forEachIteratedPoint<double>(cloud, visit);
+      return;
+    default:  // FLOAT32
+      forEachIteratedPoint<float>(cloud, visit);
+      return;
+  }
+}
+
+/**
+ * @brief Decode a cloud into SoA point blocks for the batch filter
+ * @param cloud The cloud to walk
+ * @param block Scratch block, reused between calls
+ * @param visit Callable taking (PointBlock &), called for every full block and the tail. It may
+ *        modify the block in place, the block is refilled afterwards
+ */
+template<typename BlockVisitor>
+inline void forEachPointBlock(
+  const sensor_msgs::msg::PointCloud2 & cloud, PointBlock & block, BlockVisitor && visit)
+{
+  block.size = 0;
+  forEachPoint(cloud, [&](float x, float y, float z, float intensity) {
+    block.x[block.size] = x;
+    block.y[block.size] = y;
+    block.z[block.size] = z;
+    block.intensity[block.size] = intensity;
+    if (++block.size == PointBlock::CAPACITY) {
+      visit(block);
+      block.size = 0;
+    }
+  });
+  if (block.size > 0) {
+    visit(block);
+  }
+}
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__MARKING_KERNEL_HPP_
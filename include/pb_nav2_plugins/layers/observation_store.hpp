@@ -0,0 +1,235 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__OBSERVATION_STORE_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__OBSERVATION_STORE_HPP_
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "geometry_msgs/msg/point.hpp"
+#include "nav2_costmap_2d/observation.hpp"
+#include "pb_nav2_plugins/layers/point_filter.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_lifecycle/lifecycle_node.hpp"
+#include "sensor_msgs/msg/laser_scan.hpp"
+#include "sensor_msgs/msg/point_cloud2.hpp"
+#include "tf2_ros/buffer.h"
+
+namespace pb_nav2_costmap_2d
+{
+
+class SharedObservationCache;
+
+/**
+ * @struct PreparedCloud
+ * @brief A cloud decoded into the global frame as it arrived, so the update only has to map it
+ */
+struct PreparedCloud
+{
+  /// @brief Points that passed the height window, intensity window and obstacle range
+  std::vector<PointBlock> marking_blocks;
+  /// @brief Every point of the cloud, for clearing
+  std::vector<PointBlock> clearing_blocks;
+  /// @brief Which of the two were prepared
+  bool marking = false, clearing = false;
+  /// @brief Intensity window the marking points were filtered with
+  double min_intensity = 0.0, max_intensity = 0.0;
+  /// @brief Number of points of the cloud
+  size_t points_in = 0;
+  /// @brief The scan the points were projected from by the direct scan path, which is all there
+  /// is to prepare them again from as its observation carries no points
+  sensor_msgs::msg::LaserScan::ConstSharedPtr scan;
+  bool scan_inf_is_valid = false;
+};
+
+/**
+ * @struct StoredObservation
+ * @brief A cloud as it was received plus what is needed to use it in the global frame
+ *
+ * The cloud is shared with the subscription and never copied. Its points are moved into the
+ * global frame with transform and checked against the height window where they are consumed.
+ */
+struct StoredObservation
+{
+  /// @brief The cloud in its own frame
+  sensor_msgs::msg::PointCloud2::ConstSharedPtr cloud;
+  /// @brief Transform from the frame of the cloud into the global frame
+  PointTransform transform;
+  /// @brief Origin of the sensor in the global frame
+  geometry_msgs::msg::Point origin;
+  double min_obstacle_height, max_obstacle_height;
+  double obstacle_max_range, obstacle_min_range;
+  double raytrace_max_range, raytrace_min_range;
+  /// @brief Index of the observation source in its layer, -1 for static observations
+  int source = -1;
+  /// @brief The cloud decoded ahead of the update, null unless async_preprocessing is enabled
+  std::shared_ptr<const PreparedCloud> prepared;
+
+  /**
+   * @brief Wrap an observation whose cloud already is in the global frame, the cloud is copied
+   */
+  static StoredObservation fromObservation(const nav2_costmap_2d::Observation & obs);
+
+  /**
+   * @brief Whether a point of the cloud, moved into the global frame, lies in the height window
+   */
+  inline bool inHeightWindow(float gz) const
+  {
+    return gz >= min_obstacle_height && gz <= max_obstacle_height;
+  }
+};
+
+/**
+ * @class ObservationStore
+ * @brief Layer-owned replacement of nav2_costmap_2d::ObservationBuffer
+ *
+ * Keeps the shared pointer of every incoming cloud together with the sensor to global transform
+ * at its stamp, instead of transforming and deep-copying the cloud on arrival. Expiry and the
+ * current check follow ObservationBuffer.
+ */
+class ObservationStore
+{
+public:
+  /**
+   * @brief Constructs an observation store
+   * @param parent Node used for the clock and the logger
+   * @param topic_name The topic of the observations, used for logging
+   * @param observation_keep_time How long to keep observations, 0 keeps only the latest one
+   * @param expected_update_rate How often observations are expected, 0 disables the check
+   * @param min_obstacle_height Minimum height of a point in the global frame
+   * @param max_obstacle_height Maximum height of a point in the global frame
+   * @param obstacle_max_range The range to which the sensor should be trusted for inserting obstacles
+   * @param obstacle_min_range The range from which the sensor should be trusted for inserting obstacles
+   * @param raytrace_max_range The range to which the sensor should be trusted for raytracing
+   * @param raytrace_min_range The range from which the sensor should be trusted for raytracing
+   * @param tf2_buffer A reference to a tf2 Buffer
+   * @param global_frame The frame to transform observations into
+   * @param sensor_frame The frame of the sensor origin, empty to use the frame of the cloud
+   * @param tf_tolerance The amount of time to wait for a transform to be available
+   */
+  ObservationStore(
+    const rclcpp_lifecycle::LifecycleNode::WeakPtr & parent, std::string topic_name,
+    double observation_keep_time, double expected_update_rate, double min_obstacle_height,
+    double max_obstacle_height, double obstacle_max_range, double obstacle_min_range,
+    double raytrace_max_range, double raytrace_min_range, tf2_ros::Buffer & tf2_buffer,
+    std::string global_frame, std::string sensor_frame, tf2::Duration tf_tolerance);
+
+  /**
+   * @brief Store a cloud, looking up its transform into the global frame
+   * @param cloud The cloud, kept by reference
+   */
+  void bufferCloud(const sensor_msgs::msg::PointCloud2::ConstSharedPtr & cloud);
+
+  /**
+   * @brief Build the observation of a cloud without storing it, needs no lock
+   * @param cloud The cloud, kept by reference
+   * @param obs The observation to fill
+   * @return False if the transform of the cloud could not be looked up
+   */
+  bool makeObservation(
+    const sensor_msgs::msg::PointCloud2::ConstSharedPtr & cloud, StoredObservation & obs) const;
+
+  /**
+   * @brief Store an observation built by makeObservation
+   */
+  void addObservation(StoredObservation && obs);
+
+  /**
+   * @brief Append the observations that are still valid, newest first
+   * @param observations The vector to append to
+   */
+  void getObservations(std::vector<StoredObservation> & observations);
+
+  /**
+   * @brief Check if the store is being updated at its expected rate
+   */
+  bool isCurrent() const;
+
+  /**
+   * @brief Lock the store for reading or writing
+   */
+  inline void lock() { lock_.lock(); }
+
+  /**
+   * @brief Unlock the store
+   */
+  inline void unlock() { lock_.unlock(); }
+
+  /**
+   * @brief Reset the last updated timestamp
+   */
+  void resetLastUpdated();
+
+  /**
+   * @brief Set the source index given to the stored observations
+   */
+  void setSource(int source) { source_ = source; }
+
+  int source() const { return source_; }
+
+  /**
+   * @brief Set the cache the observations of this store are shared through, null to not share
+   */
+  void setSharedCache(std::shared_ptr<SharedObservationCache> cache)
+  {
+    shared_cache_ = std::move(cache);
+  }
+
+  const std::shared_ptr<SharedObservationCache> & sharedCache() const { return shared_cache_; }
+
+  /**
+   * @brief Set whether the layer marks and clears with the observations of this store
+   */
+  void setRoles(bool marking, bool clearing)
+  {
+    marking_ = marking;
+    clearing_ = clearing;
+  }
+
+  bool isMarking() const { return marking_; }
+  bool isClearing() const { return clearing_; }
+
+private:
+  /**
+   * @brief Drop the observations that are older than the keep time
+   */
+  void purgeStaleObservations();
+
+  rclcpp::Clock::SharedPtr clock_;
+  rclcpp::Logger logger_{rclcpp::get_logger("nav2_costmap_2d")};
+  tf2_ros::Buffer & tf2_buffer_;
+  const rclcpp::Duration observation_keep_time_;
+  const rclcpp::Duration expected_update_rate_;
+  rclcpp::Time last_updated_;
+  std::string global_frame_;
+  std::string sensor_frame_;
+  std::list<StoredObservation> observation_list_;
+  std::string topic_name_;
+  double min_obstacle_height_, max_obstacle_height_;
+  std::recursive_mutex lock_;
+  double obstacle_max_range_, obstacle_min_range_, raytrace_max_range_, raytrace_min_range_;
+  tf2::Duration tf_tolerance_;
+  int source_ = -1;
+  std::shared_ptr<SharedObservationCache> shared_cache_;
+  bool marking_ = false, clearing_ = false;
+};
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__OBSERVATION_STORE_HPP_
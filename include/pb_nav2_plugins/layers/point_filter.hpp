@@ -0,0 +1,204 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__POINT_FILTER_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__POINT_FILTER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pb_nav2_costmap_2d
+{
+
+/**
+ * @struct PointBlock
+ * @brief A fixed-size block of points in SoA layout, the unit of work of the batch filter
+ */
+struct PointBlock
+{
+  static constexpr size_t CAPACITY = 256;
+
+  alignas(32) float x[CAPACITY];
+  alignas(32) float y[CAPACITY];
+  alignas(32) float z[CAPACITY];
+  alignas(32) float intensity[CAPACITY];
+  size_t size = 0;
+};
+
+/**
+ * @struct MarkingScratch
+ * @brief Reusable buffers of the batch filter, one per layer
+ */
+struct MarkingScratch
+{
+  PointBlock block;
+  uint32_t survivors[PointBlock::CAPACITY];
+  unsigned int cells[PointBlock::CAPACITY];
+};
+
+/**
+ * @struct PointTransform
+ * @brief Rigid transform from the frame of a stored cloud into the global frame
+ *
+ * Applied in single precision, like the PointCloud2 transform of ObservationBuffer.
+ */
+struct PointTransform
+{
+  float rotation[9];  ///< @brief Row-major rotation matrix
+  float translation[3];
+  bool identity;
+
+  /**
+   * @brief The identity transform, for clouds that already are in the global frame
+   */
+  static PointTransform makeIdentity()
+  {
+    return PointTransform{{1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f},
+      {0.0f, 0.0f, 0.0f}, true};
+  }
+
+  /**
+   * @brief Build the transform from a translation and a unit quaternion
+   */
+  static PointTransform fromTranslationRotation(
+    double tx, double ty, double tz, double qx, double qy, double qz, double qw)
+  {
+    PointTransform tf;
+    tf.rotation[0] = static_cast<float>(1.0 - 2.0 * (qy * qy + qz * qz));
+    tf.rotation[1] = static_cast<float>(2.0 * (qx * qy - qz * qw));
+    tf.rotation[2] = static_cast<float>(2.0 * (qx * qz + qy * qw));
+    tf.rotation[3] = static_cast<float>(2.0 * (qx * qy + qz * qw));
+    tf.rotation[4] = static_cast<float>(1.0 - 2.0 * (qx * qx + qz * qz));
+    tf.rotation[5] = static_cast<float>(2.0 * (qy * qz - qx * qw));
+    tf.rotation[6] = static_cast<float>(2.0 * (qx * qz - qy * qw));
+    tf.rotation[7] = static_cast<float>(2.0 * (qy * qz + qx * qw));
+    tf.rotation[8] = static_cast<float>(1.0 - 2.0 * (qx * qx + qy * qy));
+    tf.translation[0] = static_cast<float>(tx);
+    tf.translation[1] = static_cast<float>(ty);
+    tf.translation[2] = static_cast<float>(tz);
+    tf.identity = false;
+    return tf;
+  }
+
+  inline void apply(float x, float y, float z, float & gx, float & gy, float & gz) const
+  {
+    if (identity) {
+      gx = x;
+      gy = y;
+      gz = z;
+      return;
+    }
+    gx = rotation[0] * x + rotation[1] * y + rotation[2] * z + translation[0];
+    gy = rotation[3] * x + rotation[4] * y + rotation[5] * z + translation[1];
+    gz = rotation[6] * x + rotation[7] * y + rotation[8] * z + translation[2];
+  }
+};
+
+/**
+ * @struct PointFilterParams
+ * @brief Per-observation thresholds of the height window, intensity window and range check
+ */
+struct PointFilterParams
+{
+  float min_height;
+  float max_height;
+  float min_intensity;
+  float max_intensity;
+  float origin_x;
+  float origin_y;
+  float origin_z;
+  float sq_min_range;
+  float sq_max_range;
+};
+
+/**
+ * @struct MapGeometry
+ * @brief The part of a Costmap2D needed to turn world coordinates into cell indices
+ */
+struct MapGeometry
+{
+  double origin_x;
+  double origin_y;
+  double resolution;
+  unsigned int size_x;
+  unsigned int size_y;
+};
+
+/**
+ * @brief Build the filter thresholds of one observation
+ *
+ * The height and intensity bounds are rounded inwards to the nearest float so that comparing
+ * float values against them gives the same answer as comparing against the double parameters.
+ */
+PointFilterParams makePointFilterParams(
+  double min_height, double max_height, double min_intensity, double max_intensity,
+  double origin_x, double origin_y, double origin_z, double min_range, double max_range);
+
+/**
+ * @brief Move the points of a block into the global frame, in place
+ */
+void transformPointBlock(PointBlock & block, const PointTransform & transform);
+
+/**
+ * @brief Keep the points of a block that pass the height window, intensity window and range check
+ *
+ * A point is kept when min_height <= z <= max_height, min_intensity <= intensity <= max_intensity
+ * and sq_min_range <= squared distance to the origin < sq_max_range. The block is processed with
+ * AVX2 or SSE2 on x86 and NEON on aarch64, the scalar loop is used elsewhere.
+ *
+ * @param block The points to filter
+ * @param params The thresholds of the observation
+ * @param survivors Output array of at least block.size entries, filled with block indices
+ * @return The number of surviving points
+ */
+size_t filterPointBlock(
+  const PointBlock & block, const PointFilterParams & params, uint32_t * survivors);
+
+/**
+ * @brief Select every point of a block, for blocks that were filtered before
+ * @return block.size
+ */
+size_t selectAllPoints(const PointBlock & block, uint32_t * survivors);
+
+/**
+ * @brief Append the surviving points of a block to a list of packed blocks
+ * @param block The filtered block
+ * @param survivors Block indices returned by filterPointBlock
+ * @param num_survivors Number of entries in survivors
+ * @param blocks The blocks to append to, every block but the last one is full
+ */
+void appendSurvivors(
+  const PointBlock & block, const uint32_t * survivors, size_t num_survivors,
+  std::vector<PointBlock> & blocks);
+
+/**
+ * @brief Turn surviving points into 2D cell indices, dropping points outside of the map
+ *
+ * Uses the same double precision arithmetic as Costmap2D::worldToMap.
+ *
+ * @param block The filtered block
+ * @param survivors Block indices returned by filterPointBlock
+ * @param num_survivors Number of entries in survivors
+ * @param map The map to project into
+ * @param cells Output array of at least num_survivors entries
+ * @return The number of cell indices written
+ */
+size_t projectToCells(
+  const PointBlock & block, const uint32_t * survivors, size_t num_survivors,
+  const MapGeometry & map, unsigned int * cells);
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__POINT_FILTER_HPP_
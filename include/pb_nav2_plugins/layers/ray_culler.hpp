@@ -0,0 +1,136 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__RAY_CULLER_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__RAY_CULLER_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace pb_nav2_costmap_2d
+{
+
+/**
+ * @class AngularRayCuller
+ * @brief Keeps only the farthest clearing ray per angular bin around the sensor origin
+ *
+ * Rays are binned by azimuth, and by elevation as well when use_elevation is set. A ray that
+ * shares a bin with a longer one clears a subset of the same cells at the configured bin width,
+ * so only the longest ray of each bin needs to be traced.
+ */
+class AngularRayCuller
+{
+public:
+  /**
+   * @brief Set the bin width, a width of zero or less disables culling
+   * @param bin_width Angular width of a bin in radians
+   * @param use_elevation Bin by elevation as well as by azimuth
+   */
+  void configure(double bin_width, bool use_elevation)
+  {
+    bin_width_ = bin_width;
+    azimuth_bins_ = 0;
+    elevation_bins_ = 1;
+    if (bin_width_ > 0.0) {
+      azimuth_bins_ = static_cast<unsigned int>(std::ceil(2.0 * M_PI / bin_width_));
+      if (use_elevation) {
+        elevation_bins_ = static_cast<unsigned int>(std::ceil(M_PI / bin_width_)) + 1;
+      }
+    }
+    use_elevation_ = use_elevation && azimuth_bins_ > 0;
+    best_ray_.assign(static_cast<size_t>(azimuth_bins_) * elevation_bins_, EMPTY);
+    best_sq_dist_.assign(best_ray_.size(), 0.0);
+    touched_bins_.clear();
+  }
+
+  bool enabled() const { return azimuth_bins_ > 0; }
+
+  /**
+   * @brief Offer a ray
+   * @param ray Index of the ray in the caller's ray list
+   * @param dx X extent of the ray from the sensor origin
+   * @param dy Y extent of the ray from the sensor origin
+   * @param dz Z extent of the ray from the sensor origin, ignored without elevation binning
+   */
+  inline void add(uint32_t ray, double dx, double dy, double dz)
+  {
+    const double sq_planar = dx * dx + dy * dy;
+    unsigned int bin = azimuthBin(std::atan2(dy, dx));
+    double sq_dist = sq_planar;
+    if (use_elevation_) {
+      bin = bin * elevation_bins_ + elevationBin(std::atan2(dz, std::sqrt(sq_planar)));
+      sq_dist += dz * dz;
+    }
+
+    if (best_ray_[bin] == EMPTY) {
+      touched_bins_.push_back(bin);
+    } else if (sq_dist <= best_sq_dist_[bin]) {
+      return;
+    }
+    best_ray_[bin] = ray;
+    best_sq_dist_[bin] = sq_dist;
+  }
+
+  /**
+   * @brief Drop every ray that is not the farthest of its bin and empty the bins
+   * @param rays The ray list the offered indices refer to, the kept rays stay in their order
+   */
+  template<typename Ray>
+  void cull(std::vector<Ray> & rays)
+  {
+    kept_.clear();
+    for (const unsigned int bin : touched_bins_) {
+      kept_.push_back(best_ray_[bin]);
+      best_ray_[bin] = EMPTY;
+    }
+    touched_bins_.clear();
+    std::sort(kept_.begin(), kept_.end());
+
+    // kept_[i] >= i, so compacting front to back never overwrites a ray that is still needed
+    for (size_t i = 0; i < kept_.size(); ++i) {
+      rays[i] = rays[kept_[i]];
+    }
+    rays.resize(kept_.size());
+  }
+
+private:
+  static constexpr uint32_t EMPTY = UINT32_MAX;
+
+  inline unsigned int azimuthBin(double azimuth) const
+  {
+    auto bin = static_cast<unsigned int>((azimuth + M_PI) / bin_width_);
+    return std::min(bin, azimuth_bins_ - 1);
+  }
+
+  inline unsigned int elevationBin(double elevation) const
+  {
+    auto bin = static_cast<unsigned int>((elevation + M_PI / 2.0) / bin_width_);
+    return std::min(bin, elevation_bins_ - 1);
+  }
+
+  double bin_width_ = 0.0;
+  bool use_elevation_ = false;
+  unsigned int azimuth_bins_ = 0;
+  unsigned int elevation_bins_ = 1;
+  std::vector<uint32_t> best_ray_;
+  std::vector<double> best_sq_dist_;
+  std::vector<unsigned int> touched_bins_;
+  std::vector<uint32_t> kept_;
+};
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__RAY_CULLER_HPP_
@@ -0,0 +1,105 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__RAYTRACE_BATCH_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__RAYTRACE_BATCH_HPP_
+
+#include <algorithm>
+
+namespace pb_nav2_costmap_2d
+{
+
+/**
+ * @class RaytraceBatch
+ * @brief The constants of one clearing observation and the extent of the rays traced for it
+ *
+ * Replaces the per-ray updateRaytraceBounds call. Instead of clipping every ray to the raytrace
+ * range with a hypot, the batch keeps the bounding box of the origin and of the endpoints that
+ * are at least min_range away, and clamps it to the square of half-width max_range around the
+ * origin once. Every clipped ray lies in that box, so it is a superset of the per-ray bounds.
+ */
+class RaytraceBatch
+{
+public:
+  /**
+   * @param ox X of the sensor origin in world coordinates
+   * @param oy Y of the sensor origin in world coordinates
+   * @param max_range Raytrace max range of the observation in meters
+   * @param min_range Raytrace min range of the observation in meters
+   * @param cell_max_range max_range converted with Costmap2D::cellDistance
+   * @param cell_min_range min_range converted with Costmap2D::cellDistance
+   */
+  RaytraceBatch(
+    double ox, double oy, double max_range, double min_range, unsigned int cell_max_range,
+    unsigned int cell_min_range)
+  : ox_(ox),
+    oy_(oy),
+    max_range_(max_range),
+    sq_min_range_(min_range * min_range),
+    cell_max_range_(cell_max_range),
+    cell_min_range_(cell_min_range),
+    min_dx_(0.0),
+    min_dy_(0.0),
+    max_dx_(0.0),
+    max_dy_(0.0),
+    empty_(true)
+  {
+  }
+
+  RaytraceBatch() : RaytraceBatch(0.0, 0.0, 0.0, 0.0, 0, 0) {}
+
+  unsigned int cellMaxRange() const { return cell_max_range_; }
+  unsigned int cellMinRange() const { return cell_min_range_; }
+
+  /**
+   * @brief Account for a ray ending at (wx, wy)
+   */
+  inline void addEndpoint(double wx, double wy)
+  {
+    const double dx = wx - ox_, dy = wy - oy_;
+    if (dx * dx + dy * dy < sq_min_range_) {
+      return;
+    }
+    empty_ = false;
+    min_dx_ = std::min(min_dx_, dx);
+    min_dy_ = std::min(min_dy_, dy);
+    max_dx_ = std::max(max_dx_, dx);
+    max_dy_ = std::max(max_dy_, dy);
+  }
+
+  /**
+   * @brief Widen the bounds by the traced extent of all rays added so far
+   */
+  void touchBounds(double * min_x, double * min_y, double * max_x, double * max_y) const
+  {
+    if (empty_) {
+      return;
+    }
+    *min_x = std::min(*min_x, ox_ + std::max(min_dx_, -max_range_));
+    *min_y = std::min(*min_y, oy_ + std::max(min_dy_, -max_range_));
+    *max_x = std::max(*max_x, ox_ + std::min(max_dx_, max_range_));
+    *max_y = std::max(*max_y, oy_ + std::min(max_dy_, max_range_));
+  }
+
+private:
+  double ox_, oy_;
+  double max_range_, sq_min_range_;
+  unsigned int cell_max_range_, cell_min_range_;
+  double min_dx_, min_dy_, max_dx_, max_dy_;
+  bool empty_;
+};
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__RAYTRACE_BATCH_HPP_
@@ -0,0 +1,85 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__ROLLING_SHIFT_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__ROLLING_SHIFT_HPP_
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace pb_nav2_costmap_2d
+{
+
+/**
+ * @brief Scroll a row-major map in place by a whole number of cells
+ *
+ * The cell at (x, y) receives the value that was at (x + shift_x, y + shift_y), and the strips
+ * that scroll in are set to fill_value. This is what copying the overlap out, resetting the map
+ * and copying the overlap back does, without the temporary map and without resetting the cells
+ * that are overwritten anyway. Rows are visited in the order that never reads an overwritten row,
+ * and each row is moved with a single memmove.
+ *
+ * @param data The map, size_x * size_y values
+ * @param size_x Width of the map in cells
+ * @param size_y Height of the map in cells
+ * @param shift_x Cells the window moves along x
+ * @param shift_y Cells the window moves along y
+ * @param fill_value Value of the cells that scroll in
+ */
+template<typename T>
+void shiftMapInPlace(
+  T * data, unsigned int size_x, unsigned int size_y, int shift_x, int shift_y, T fill_value)
+{
+  const unsigned int abs_x = static_cast<unsigned int>(std::abs(shift_x));
+  const unsigned int abs_y = static_cast<unsigned int>(std::abs(shift_y));
+
+  // no overlap left, everything scrolls in
+  if (abs_x >= size_x || abs_y >= size_y) {
+    std::fill(data, data + size_x * size_y, fill_value);
+    return;
+  }
+
+  const unsigned int row_length = size_x - abs_x;
+  const unsigned int src_x = shift_x > 0 ? abs_x : 0;
+  const unsigned int dst_x = shift_x > 0 ? 0 : abs_x;
+  // the columns of every kept row that scroll in
+  const unsigned int fill_x = shift_x > 0 ? row_length : 0;
+
+  auto move_row = [&](unsigned int y) {
+    T * row = data + y * size_x;
+    const T * src = data + static_cast<size_t>(static_cast<int>(y) + shift_y) * size_x;
+    std::memmove(row + dst_x, src + src_x, row_length * sizeof(T));
+    std::fill(row + fill_x, row + fill_x + abs_x, fill_value);
+  };
+
+  const unsigned int kept_rows = size_y - abs_y;
+  if (shift_y >= 0) {
+    // rows are read from above, so walk upwards and fill the top strip last
+    for (unsigned int y = 0; y < kept_rows; ++y) {
+      move_row(y);
+    }
+    std::fill(data + kept_rows * size_x, data + size_y * size_x, fill_value);
+  } else {
+    // rows are read from below, so walk downwards and fill the bottom strip last
+    for (unsigned int y = size_y; y-- > abs_y;) {
+      move_row(y);
+    }
+    std::fill(data, data + abs_y * size_x, fill_value);
+  }
+}
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__ROLLING_SHIFT_HPP_
@@ -0,0 +1,110 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__SCAN_PROJECTOR_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__SCAN_PROJECTOR_HPP_
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "pb_nav2_plugins/layers/point_filter.hpp"
+#include "sensor_msgs/msg/laser_scan.hpp"
+
+namespace pb_nav2_costmap_2d
+{
+
+/**
+ * @class ScanProjector
+ * @brief Projects the beams of a LaserScan into point blocks with cached cos and sin tables
+ *
+ * Keeps the points laser_geometry::LaserProjection::projectLaser keeps, in the frame of the scan,
+ * without building a PointCloud2. The tables are rebuilt when angle_min, angle_increment or the
+ * number of beams change, which for a given sensor is never. A projector is used by one thread.
+ */
+class ScanProjector
+{
+public:
+  /**
+   * @brief Visit the valid beams of a scan as point blocks
+   *
+   * A beam is valid when range_min <= range < range_max. With inf_is_valid a positive infinity
+   * reads as a hit just short of range_max, as the inf filtering callback of the layer does. The
+   * intensity of a beam is read from the intensities of the scan, and is 0 when it has none.
+   *
+   * @param scan The scan to project
+   * @param inf_is_valid Whether positive infinities are hits at range_max
+   * @param block Scratch block, reused between calls
+   * @param visit Callable taking (PointBlock &), called for every full block and the tail
+   */
+  template<typename BlockVisitor>
+  void forEachBlock(
+    const sensor_msgs::msg::LaserScan & scan, bool inf_is_valid, PointBlock & block,
+    BlockVisitor && visit)
+  {
+    updateTables(scan);
+
+    // a tenth of a millimeter, like the inf filtering callback
+    const float inf_range = scan.range_max - 0.0001f;
+    const bool has_intensities = scan.intensities.size() >= scan.ranges.size();
+    block.size = 0;
+    for (size_t i = 0; i < scan.ranges.size(); ++i) {
+      float range = scan.ranges[i];
+      if (inf_is_valid && std::isinf(range) && range > 0) {
+        range = inf_range;
+      }
+      if (!(range >= scan.range_min && range < scan.range_max)) {
+        continue;
+      }
+      block.x[block.size] = range * cos_[i];
+      block.y[block.size] = range * sin_[i];
+      block.z[block.size] = 0.0f;
+      block.intensity[block.size] = has_intensities ? scan.intensities[i] : 0.0f;
+      if (++block.size == PointBlock::CAPACITY) {
+        visit(block);
+        block.size = 0;
+      }
+    }
+    if (block.size > 0) {
+      visit(block);
+    }
+  }
+
+private:
+  void updateTables(const sensor_msgs::msg::LaserScan & scan)
+  {
+    if (
+      scan.angle_min == angle_min_ && scan.angle_increment == angle_increment_ &&
+      scan.ranges.size() == cos_.size())
+    {
+      return;
+    }
+    angle_min_ = scan.angle_min;
+    angle_increment_ = scan.angle_increment;
+    cos_.resize(scan.ranges.size());
+    sin_.resize(scan.ranges.size());
+    for (size_t i = 0; i < scan.ranges.size(); ++i) {
+      const double angle = static_cast<double>(scan.angle_min) + i * scan.angle_increment;
+      cos_[i] = static_cast<float>(std::cos(angle));
+      sin_[i] = static_cast<float>(std::sin(angle));
+    }
+  }
+
+  float angle_min_ = NAN, angle_increment_ = NAN;
+  std::vector<float> cos_, sin_;
+};
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__SCAN_PROJECTOR_HPP_
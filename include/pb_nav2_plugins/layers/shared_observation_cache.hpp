@@ -0,0 +1,137 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__SHARED_OBSERVATION_CACHE_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__SHARED_OBSERVATION_CACHE_HPP_
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "pb_nav2_plugins/layers/observation_store.hpp"
+#include "sensor_msgs/msg/point_cloud2.hpp"
+
+namespace pb_nav2_costmap_2d
+{
+
+/**
+ * @class SharedObservationCache
+ * @brief Observations of one source shared by every layer instance of the process that has it
+ *
+ * Layers whose sources take the same topic into the same global frame with the same settings get
+ * the same cache. The first layer to receive a message looks its transform up and prepares it, the
+ * others take that observation, which shares the cloud and the prepared points by pointer, and
+ * drop their own copy of the message. The cache only holds weak references to the last few
+ * messages, a cloud is freed as soon as no layer keeps it.
+ */
+class SharedObservationCache
+{
+public:
+  /// @brief What a layer needs of a shared observation
+  struct Needs
+  {
+    /// @brief Whether the observation has to be prepared
+    bool prepared = false;
+    /// @brief Roles the prepared cloud has to cover
+    bool marking = false, clearing = false;
+    /// @brief Intensity window the marking points have to be filtered with
+    double min_intensity = 0.0, max_intensity = 0.0;
+  };
+
+  /**
+   * @brief The cache of a source, created when no layer holds it yet
+   * @param key Key of the source, see makeKey
+   */
+  static std::shared_ptr<SharedObservationCache> forKey(const std::string & key);
+
+  /**
+   * @brief Key of the observations of a source, every setting that shapes them is part of it
+   * @param kind How the messages become clouds, sources of different kinds never share
+   */
+  static std::string makeKey(
+    const std::string & kind, const std::string & topic, const std::string & global_frame,
+    const std::string & sensor_frame, double min_obstacle_height, double max_obstacle_height,
+    double obstacle_max_range, double obstacle_min_range, double raytrace_max_range,
+    double raytrace_min_range);
+
+  /**
+   * @brief Take the observation of a message from the cache, or build it and share it
+   *
+   * Layers that receive the same message at the same time wait for the one building it.
+   *
+   * @param cloud The cloud of the message as received by the calling layer
+   * @param needs What the calling layer needs of the observation
+   * @param build Callable taking (StoredObservation &) that builds the observation of the cloud,
+   *        returning false if it cannot be built
+   * @param obs The observation to fill, its source is left to the caller
+   * @return False if the observation could not be built
+   */
+  template<typename Build>
+  bool share(
+    const sensor_msgs::msg::PointCloud2 & cloud, const Needs & needs, Build && build,
+    StoredObservation & obs)
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (find(cloud, needs, obs)) {
+      return true;
+    }
+    if (!build(obs)) {
+      return false;
+    }
+    insert(cloud, obs);
+    return true;
+  }
+
+private:
+  /// @brief Messages remembered, enough for layers that fall a few messages behind each other
+  static constexpr size_t HISTORY = 4;
+
+  /// @brief A shared observation without the references that would keep it alive
+  struct Entry
+  {
+    builtin_interfaces::msg::Time stamp;
+    std::string frame_id;
+    uint64_t num_points = 0;
+    StoredObservation observation;
+    std::weak_ptr<const sensor_msgs::msg::PointCloud2> cloud;
+    std::weak_ptr<const PreparedCloud> prepared;
+  };
+
+  /**
+   * @brief Whether an entry holds the observation of the same message
+   */
+  static bool sameMessage(const Entry & entry, const sensor_msgs::msg::PointCloud2 & cloud);
+
+  /**
+   * @brief Fill the observation of a message if it is still alive and covers the needs
+   */
+  bool find(
+    const sensor_msgs::msg::PointCloud2 & cloud, const Needs & needs,
+    StoredObservation & obs) const;
+
+  /**
+   * @brief Remember the observation of a message in place of the oldest one
+   */
+  void insert(const sensor_msgs::msg::PointCloud2 & cloud, const StoredObservation & obs);
+
+  std::mutex mutex_;
+  std::array<Entry, HISTORY> entries_;
+  size_t next_ = 0;
+};
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__SHARED_OBSERVATION_CACHE_HPP_
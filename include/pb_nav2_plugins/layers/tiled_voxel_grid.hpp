@@ -0,0 +1,198 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__TILED_VOXEL_GRID_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__TILED_VOXEL_GRID_HPP_
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "pb_nav2_plugins/layers/vertical_remap.hpp"
+
+namespace pb_nav2_costmap_2d
+{
+
+/**
+ * @class TiledVoxelGrid
+ * @brief Sparse replacement of nav2_voxel_grid::VoxelGrid for large maps and tall columns
+ *
+ * Columns are grouped into square tiles that are only allocated once a voxel in them is marked or
+ * cleared, and tiles whose columns are all back to the default state can be released. A column
+ * keeps its levels in two 64 bit words, so up to MAX_LEVELS levels are supported. The default
+ * state of zero is unknown, as a VoxelGrid column after reset, and the levels above those of the
+ * grid count as unknown up to the 16 levels of a VoxelGrid column, so the clearing thresholds
+ * behave the same. Lines are traced with the same integer stepping as VoxelGrid.
+ */
+class TiledVoxelGrid
+{
+public:
+  /// @brief Columns along each side of a tile, as a power of two
+  static constexpr unsigned int TILE_SHIFT = 6;
+  static constexpr unsigned int TILE_SIZE = 1u << TILE_SHIFT;
+  static constexpr unsigned int MAX_LEVELS = 64;
+
+  /**
+   * @brief One column, marked holds the high half of a VoxelGrid column and seen the levels that
+   * were marked or cleared, the ones whose low half is not an unknown bit
+   */
+  struct Column
+  {
+    uint64_t marked;
+    uint64_t seen;
+  };
+
+  /**
+   * @brief Drop every tile and take the new size, all columns start in the default state
+   */
+  void resize(unsigned int size_x, unsigned int size_y, unsigned int size_z);
+
+  /**
+   * @brief Return every column to the default state, releasing all tiles
+   */
+  void reset();
+
+  unsigned int sizeX() const { return size_x_; }
+  unsigned int sizeY() const { return size_y_; }
+  unsigned int sizeZ() const { return size_z_; }
+
+  /**
+   * @brief Mark the voxel at (x, y, z), allocating its tile when needed
+   */
+  void markVoxel(unsigned int x, unsigned int y, unsigned int z);
+
+  /**
+   * @brief The number of marked levels of the column at the costmap index
+   */
+  unsigned int markedCount(unsigned int index) const;
+
+  /**
+   * @brief Clear the voxels along a line and update the 2D costmap like VoxelGrid does
+   * @param x0 Start of the line in map cells
+   * @param y0 Start of the line in map cells
+   * @param z0 Start of the line in map cells
+   * @param x1 End of the line in map cells
+   * @param y1 End of the line in map cells
+   * @param z1 End of the line in map cells
+   * @param map_2d The costmap, indexed like the columns
+   * @param unknown_threshold Maximum unknown levels of a column that is set to free_cost
+   * @param mark_threshold Maximum marked levels of a column that is cleared in the costmap
+   * @param free_cost Cost of a cleared cell
+   * @param unknown_cost Cost of a cleared cell with too many unknown levels
+   * @param max_length Maximum length of the line in cells
+   * @param min_length Length at the start of the line that is skipped, in cells
+   */
+  void clearVoxelLineInMap(
+    double x0, double y0, double z0, double x1, double y1, double z1, unsigned char * map_2d,
+    unsigned int unknown_threshold, unsigned int mark_threshold, unsigned char free_cost,
+    unsigned char unknown_cost, unsigned int max_length = UINT_MAX, unsigned int min_length = 0);
+
+  /**
+   * @brief Move the window by whole columns, see shiftMapInPlace
+   *
+   * Only the columns of allocated tiles are moved, the ones that scroll in are in the
+   * default state.
+   */
+  void shift(int shift_x, int shift_y);
+
+  /**
+   * @brief Move the levels of every column onto new vertical parameters, in place
+   * @param remap The levels each new level takes
+   * @param size_z The new number of levels
+   */
+  void remapLevels(const VerticalRemap & remap, unsigned int size_z);
+
+  /**
+   * @brief Release the tiles whose columns are all in the default state
+   * @return The number of tiles released
+   */
+  size_t releaseEmptyTiles();
+
+  /**
+   * @brief Write a window of the grid in the layout of VoxelGrid::getData, up to 16 levels
+   * @param data width * height columns, row-major
+   * @param x0 First column of the window
+   * @param y0 First row of the window
+   * @param width Columns of the window
+   * @param height Rows of the window
+   */
+  void toVoxelGridData(
+    uint32_t * data, unsigned int x0, unsigned int y0, unsigned int width,
+    unsigned int height) const;
+
+  /**
+   * @brief Write the whole grid in the layout of VoxelGrid::getData, up to 16 levels
+   * @param data size_x * size_y columns
+   */
+  void toVoxelGridData(uint32_t * data) const { toVoxelGridData(data, 0, 0, size_x_, size_y_); }
+
+  /**
+   * @brief Replace the grid by columns in the layout of VoxelGrid::getData
+   * @param data size_x * size_y columns, tiles are only allocated for the ones that are used
+   */
+  void fromVoxelGridData(const uint32_t * data);
+
+  /**
+   * @brief The number of tiles that are currently allocated
+   */
+  size_t allocatedTiles() const { return allocated_tiles_; }
+
+private:
+  struct Tile
+  {
+    Column columns[TILE_SIZE * TILE_SIZE];
+    /// @brief Columns that are not in the default state
+    unsigned int used_columns;
+  };
+
+  inline size_t tileIndex(unsigned int x, unsigned int y) const
+  {
+    return static_cast<size_t>(y >> TILE_SHIFT) * tiles_x_ + (x >> TILE_SHIFT);
+  }
+
+  static inline unsigned int columnIndex(unsigned int x, unsigned int y)
+  {
+    return ((y & (TILE_SIZE - 1)) << TILE_SHIFT) | (x & (TILE_SIZE - 1));
+  }
+
+  Tile & tileAt(unsigned int x, unsigned int y);
+
+  void clearVoxel(
+    unsigned int x, unsigned int y, unsigned int z, unsigned char * map_2d,
+    unsigned int unknown_threshold, unsigned int mark_threshold, unsigned char free_cost,
+    unsigned char unknown_cost);
+
+  /// @brief Levels of a VoxelGrid column, the ones above size_z_ count as unknown like there
+  static constexpr unsigned int VOXEL_GRID_LEVELS = 16;
+
+  /**
+   * @brief The number of unknown levels of a column, counted like VoxelGrid does
+   */
+  inline unsigned int unknownCount(const Column & column) const
+  {
+    return std::max(size_z_, VOXEL_GRID_LEVELS) -
+           static_cast<unsigned int>(__builtin_popcountll(column.seen));
+  }
+
+  unsigned int size_x_ = 0, size_y_ = 0, size_z_ = 0;
+  unsigned int tiles_x_ = 0, tiles_y_ = 0;
+  std::vector<std::unique_ptr<Tile>> tiles_;
+  size_t allocated_tiles_ = 0;
+};
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__TILED_VOXEL_GRID_HPP_
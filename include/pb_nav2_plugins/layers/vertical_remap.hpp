@@ -0,0 +1,123 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__VERTICAL_REMAP_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__VERTICAL_REMAP_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace pb_nav2_costmap_2d
+{
+
+/**
+ * @class VerticalRemap
+ * @brief Moves the levels of voxel columns onto new vertical parameters
+ *
+ * A new level takes the old level its center falls in, and every old level whose center falls in
+ * it, so no occupied level is lost when the levels grow or shrink. Both halves of a column are
+ * remapped alike, and levels that no old level covers, as well as the levels above the new ones,
+ * come out unknown.
+ */
+class VerticalRemap
+{
+public:
+  /// @brief Levels a remap handles, the most any voxel storage holds
+  static constexpr unsigned int MAX_LEVELS = 64;
+  /// @brief Levels of a column in the layout of VoxelGrid::getData
+  static constexpr unsigned int COLUMN_LEVELS = 16;
+
+  VerticalRemap(
+    double old_origin_z, double old_resolution, unsigned int old_levels, double new_origin_z,
+    double new_resolution, unsigned int new_levels)
+  {
+    old_levels = std::min(old_levels, MAX_LEVELS);
+    new_levels = std::min(new_levels, MAX_LEVELS);
+    sources_.assign(new_levels, 0);
+
+    auto level = [](double z, double origin, double resolution, unsigned int levels) {
+      const double index = std::floor((z - origin) / resolution);
+      return index >= 0.0 && index < levels ? static_cast<int>(index) : -1;
+    };
+    for (unsigned int z = 0; z < new_levels; ++z) {
+      const int source =
+        level(new_origin_z + (z + 0.5) * new_resolution, old_origin_z, old_resolution, old_levels);
+      if (source >= 0) {
+        sources_[z] |= uint64_t{1} << source;
+      }
+    }
+    for (unsigned int z = 0; z < old_levels; ++z) {
+      const int target =
+        level(old_origin_z + (z + 0.5) * old_resolution, new_origin_z, new_resolution, new_levels);
+      if (target >= 0) {
+        sources_[target] |= uint64_t{1} << z;
+      }
+    }
+
+    for (unsigned int z = 0; z < COLUMN_LEVELS; ++z) {
+      if (z >= new_levels || sources_[z] == 0) {
+        unknown_ |= 1u << z;
+      }
+    }
+
+    identity_ = old_levels == new_levels;
+    for (unsigned int z = 0; z < new_levels && identity_; ++z) {
+      identity_ = sources_[z] == uint64_t{1} << z;
+    }
+  }
+
+  /**
+   * @brief Whether every level stays where it is
+   */
+  bool identity() const { return identity_; }
+
+  /**
+   * @brief Remap one half of a column, bit z standing for level z
+   *
+   * The bits of levels no old level covers come out cleared.
+   */
+  inline uint64_t remapBits(uint64_t bits) const
+  {
+    uint64_t remapped = 0;
+    for (size_t z = 0; z < sources_.size(); ++z) {
+      if (bits & sources_[z]) {
+        remapped |= uint64_t{1} << z;
+      }
+    }
+    return remapped;
+  }
+
+  /**
+   * @brief Remap a column in the layout of VoxelGrid::getData, the levels no old level covers
+   * come out unknown
+   */
+  inline uint32_t remapColumn(uint32_t column) const
+  {
+    return (static_cast<uint32_t>(remapBits(column >> 16) & 0xffff) << 16) |
+           (static_cast<uint32_t>(remapBits(column & 0xffff) & 0xffff) | unknown_);
+  }
+
+private:
+  /// @brief Per new level, the old levels it takes
+  std::vector<uint64_t> sources_;
+  /// @brief Low half bits of the levels that come out unknown, their high half bits stay cleared
+  uint32_t unknown_ = 0;
+  bool identity_ = false;
+};
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__VERTICAL_REMAP_HPP_
@@ -0,0 +1,136 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__VOXEL_GPU_BACKEND_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__VOXEL_GPU_BACKEND_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pb_nav2_costmap_2d
+{
+
+/// @brief A voxel to mark once every observation has been traced
+struct VoxelMark
+{
+  unsigned int mx, my, mz;
+};
+
+/**
+ * @class VoxelGpuBackend
+ * @brief Dense voxel columns resident on a CUDA device, the storage of voxel_storage "cuda"
+ *
+ * The columns have the layout of nav2_voxel_grid::VoxelGrid::getData and never leave the device
+ * but to be published. Marks and clearing rays are uploaded once per update, and only the costmap
+ * cells the device decided are copied back. Lines are traced with the same integer stepping as
+ * VoxelGrid, one thread per ray. Clearing only removes bits, so the costmap cell of a column is
+ * decided by its state after every ray, as in the parallel CPU clearing.
+ *
+ * The header does not depend on CUDA. Without PB_NAV2_WITH_CUDA, create always fails and the
+ * layer keeps its CPU storage.
+ */
+class VoxelGpuBackend
+{
+public:
+  /// @brief Line endpoint of a clearing ray in continuous voxel coordinates
+  struct Endpoint
+  {
+    double x, y, z;
+  };
+
+  /// @brief Costmap cell decided by the device
+  struct CellUpdate
+  {
+    uint32_t index;
+    uint32_t cost;
+  };
+
+  virtual ~VoxelGpuBackend() = default;
+
+  /**
+   * @brief Open the backend on the first CUDA device
+   * @param error Why no backend was created
+   * @return The backend, null when the build has no CUDA support or no device is present
+   */
+  static std::unique_ptr<VoxelGpuBackend> create(std::string & error);
+
+  /**
+   * @brief Drop the columns and take the new size, all columns start in the default state
+   */
+  virtual void resize(unsigned int size_x, unsigned int size_y, unsigned int size_z) = 0;
+
+  /**
+   * @brief Return every column to the default state, every level unknown as after VoxelGrid::reset
+   */
+  virtual void reset() = 0;
+
+  /**
+   * @brief Move the window by whole columns like shiftMapInPlace, the columns that scroll in are
+   * in the default state
+   */
+  virtual void shift(int shift_x, int shift_y) = 0;
+
+  /**
+   * @brief Mark voxels, then tell for a list of columns whether they hold more marked levels than
+   * mark_threshold
+   * @param voxels Voxels to mark
+   * @param columns Costmap indices of the columns to check
+   * @param mark_threshold Maximum marked levels of a column that is not occupied
+   * @param occupied Filled with one entry per column, non-zero when the column is occupied
+   */
+  virtual void markVoxels(
+    const std::vector<VoxelMark> & voxels, const std::vector<unsigned int> & columns,
+    unsigned int mark_threshold, std::vector<uint8_t> & occupied) = 0;
+
+  /**
+   * @brief Clear the voxels along lines from a sensor, see VoxelGrid::clearVoxelLineInMap
+   * @param x0 Sensor origin in continuous voxel coordinates
+   * @param y0 Sensor origin in continuous voxel coordinates
+   * @param z0 Sensor origin in continuous voxel coordinates
+   * @param endpoints Line endpoints in continuous voxel coordinates
+   * @param unknown_threshold Maximum unknown levels of a column that is set to free_cost
+   * @param mark_threshold Maximum marked levels of a column that is cleared in the costmap
+   * @param free_cost Cost of a cleared cell
+   * @param unknown_cost Cost of a cleared cell with too many unknown levels
+   * @param max_length Maximum length of a line in cells
+   * @param min_length Length at the start of a line that is skipped, in cells
+   * @param updates Filled with the costmap cells to write, each cell at most once
+   */
+  virtual void clearLines(
+    double x0, double y0, double z0, const std::vector<Endpoint> & endpoints,
+    unsigned int unknown_threshold, unsigned int mark_threshold, unsigned char free_cost,
+    unsigned char unknown_cost, unsigned int max_length, unsigned int min_length,
+    std::vector<CellUpdate> & updates) = 0;
+
+  /**
+   * @brief Copy a window of the columns to the host, in the layout of VoxelGrid::getData
+   * @param data width * height columns, row-major
+   */
+  virtual void download(
+    uint32_t * data, unsigned int x0, unsigned int y0, unsigned int width,
+    unsigned int height) = 0;
+
+  /**
+   * @brief Replace every column by columns from the host, in the layout of VoxelGrid::getData
+   * @param data size_x * size_y columns, row-major
+   */
+  virtual void upload(const uint32_t * data) = 0;
+};
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__VOXEL_GPU_BACKEND_HPP_
@@ -0,0 +1,61 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__VOXEL_SNAPSHOT_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__VOXEL_SNAPSHOT_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace pb_nav2_costmap_2d
+{
+
+/**
+ * @struct VoxelSnapshot
+ * @brief The costmap and voxel columns of a voxel layer as kept on disk, to start from after a
+ * restart instead of an unknown map
+ *
+ * The file holds a short header, the costmap and the columns in the layout of
+ * VoxelGrid::getData, in the byte order of the machine that wrote it.
+ */
+struct VoxelSnapshot
+{
+  std::string global_frame;
+  unsigned int size_x = 0, size_y = 0, size_z = 0;
+  double resolution = 0.0, z_resolution = 0.0;
+  double origin_x = 0.0, origin_y = 0.0, origin_z = 0.0;
+  /// @brief size_x * size_y costs
+  std::vector<unsigned char> costmap;
+  /// @brief size_x * size_y columns
+  std::vector<uint32_t> columns;
+
+  /**
+   * @brief Write the snapshot, replacing the file only once it is complete
+   * @param error Why the snapshot could not be written
+   * @return False if the snapshot could not be written
+   */
+  bool save(const std::string & path, std::string & error) const;
+
+  /**
+   * @brief Read a snapshot written by save
+   * @param error Why the snapshot could not be read
+   * @return False if the file is missing, truncated or not a snapshot
+   */
+  bool load(const std::string & path, std::string & error);
+};
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__VOXEL_SNAPSHOT_HPP_
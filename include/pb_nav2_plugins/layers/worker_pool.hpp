@@ -0,0 +1,81 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PB_NAV2_PLUGINS__LAYERS__WORKER_POOL_HPP_
+#define PB_NAV2_PLUGINS__LAYERS__WORKER_POOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pb_nav2_costmap_2d
+{
+
+/**
+ * @class WorkerPool
+ * @brief A fixed set of persistent threads that run batches of indexed tasks
+ */
+class WorkerPool
+{
+public:
+  /// @brief Task callback, called with (task index, worker index)
+  using Task = std::function<void(size_t, size_t)>;
+
+  /**
+   * @brief Start the worker threads
+   * @param num_threads Number of workers, at least one is started
+   */
+  explicit WorkerPool(size_t num_threads);
+
+  /**
+   * @brief Stop and join the worker threads
+   */
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool & operator=(const WorkerPool &) = delete;
+
+  /**
+   * @brief Number of workers, worker indices passed to tasks are below this value
+   */
+  size_t size() const { return threads_.size(); }
+
+  /**
+   * @brief Run task for every index in [0, num_tasks) and block until all of them finished
+   */
+  void run(size_t num_tasks, const Task & task);
+
+private:
+  void workerLoop(size_t worker);
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+
+  const Task * task_ = nullptr;
+  size_t num_tasks_ = 0;
+  std::atomic<size_t> next_task_{0};
+  size_t generation_ = 0;
+  size_t active_workers_ = 0;
+  bool stop_ = false;
+};
+
+}  // namespace pb_nav2_costmap_2d
+
+#endif  // PB_NAV2_PLUGINS__LAYERS__WORKER_POOL_HPP_
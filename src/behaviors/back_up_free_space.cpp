@@ -15,7 +15,9 @@
 
 #include "pb_nav2_plugins/behaviors/back_up_free_space.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <utility>
 
 namespace pb_nav2_behaviors
 {
@@ -30,24 +32,75 @@ void BackUpFreeSpace::onConfigure()
   nav2_util::declare_parameter_if_not_declared(node, "global_frame", rclcpp::ParameterValue("map"));
   nav2_util::declare_parameter_if_not_declared(node, "robot_radius", rclcpp::ParameterValue(0.1));
   nav2_util::declare_parameter_if_not_declared(node, "max_radius", rclcpp::ParameterValue(1.0));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "costmap_source", rclcpp::ParameterValue(std::string("service")));
   nav2_util::declare_parameter_if_not_declared(
     node, "service_name", rclcpp::ParameterValue(std::string("local_costmap/get_costmap")));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "costmap_topic", rclcpp::ParameterValue(std::string("local_costmap/costmap_raw")));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "max_costmap_age", rclcpp::ParameterValue(1.0));
   nav2_util::declare_parameter_if_not_declared(node, "free_threshold", rclcpp::ParameterValue(5));
   nav2_util::declare_parameter_if_not_declared(node, "visualize", rclcpp::ParameterValue(false));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "direction_solver", rclcpp::ParameterValue(std::string("ray_sweep")));
+  nav2_util::declare_parameter_if_not_declared(node, "heading_count", rclcpp::ParameterValue(360));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "swept_collision_check", rclcpp::ParameterValue(false));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "replan_frequency", rclcpp::ParameterValue(0.0));
+  nav2_util::declare_parameter_if_not_declared(
+    node, "replan_heading_rate", rclcpp::ParameterValue(1.0));
 
   node->get_parameter("global_frame", global_frame_);
   node->get_parameter("robot_radius", robot_radius_);
   node->get_parameter("max_radius", max_radius_);
+  node->get_parameter("costmap_source", costmap_source_);
   node->get_parameter("service_name", service_name_);
+  node->get_parameter("costmap_topic", costmap_topic_);
+  node->get_parameter("max_costmap_age", max_costmap_age_);
   node->get_parameter("free_threshold", free_threshold_);
   node->get_parameter("visualize", visualize_);
+  node->get_parameter("direction_solver", direction_solver_);
+  node->get_parameter("heading_count", heading_count_);
+  node->get_parameter("swept_collision_check", swept_collision_check_);
+  node->get_parameter("replan_frequency", replan_frequency_);
+  node->get_parameter("replan_heading_rate", replan_heading_rate_);
 
   if (max_radius_ < robot_radius_) {
     RCLCPP_WARN(logger_, "max_radius < robot_radius. Adjusting max_radius.");
     max_radius_ = robot_radius_;
   }
 
-  costmap_client_ = node->create_client<nav2_msgs::srv::GetCostmap>(service_name_);
+  if (
+    direction_solver_ != "ray_sweep" && direction_solver_ != "distance_field" &&
+    direction_solver_ != "free_centroid") {
+    RCLCPP_WARN(
+      logger_, "Unknown direction_solver '%s', using 'ray_sweep'.", direction_solver_.c_str());
+    direction_solver_ = "ray_sweep";
+  }
+  if (heading_count_ < 1) {
+    RCLCPP_WARN(logger_, "heading_count < 1. Adjusting heading_count to 1.");
+    heading_count_ = 1;
+  }
+  clearance_solver_.setHeadings(heading_count_);
+
+  if (costmap_source_ == "topic") {
+    // same QoS as the costmap_raw publisher of nav2_costmap_2d
+    costmap_sub_ = node->create_subscription<nav2_msgs::msg::Costmap>(
+      costmap_topic_, rclcpp::QoS(rclcpp::KeepLast(1)).transient_local().reliable(),
+      [this](nav2_msgs::msg::Costmap::ConstSharedPtr msg) {
+        std::lock_guard<std::mutex> lock(costmap_mutex_);
+        latest_costmap_ = std::move(msg);
+      });
+  } else {
+    if (costmap_source_ != "service") {
+      RCLCPP_WARN(
+        logger_, "Unknown costmap_source '%s', using 'service'.", costmap_source_.c_str());
+      costmap_source_ = "service";
+    }
+    costmap_client_ = node->create_client<nav2_msgs::srv::GetCostmap>(service_name_);
+  }
 
   if (visualize_) {
     marker_pub_ = node->template create_publisher<visualization_msgs::msg::MarkerArray>(
@@ -63,6 +116,9 @@ void BackUpFreeSpace::onConfigure()
 void BackUpFreeSpace::onCleanup()
 {
   costmap_client_.reset();
+  costmap_sub_.reset();
+  latest_costmap_.reset();
+  cropped_costmap_.reset();
   marker_pub_.reset();
   marker_pub_line_.reset();
 }
@@ -70,24 +126,6 @@ void BackUpFreeSpace::onCleanup()
 nav2_behaviors::Status BackUpFreeSpace::onRun(
   const std::shared_ptr<const BackUpAction::Goal> command)
 {
-  while (!costmap_client_->wait_for_service(std::chrono::seconds(1))) {
-    if (!rclcpp::ok()) {
-      RCLCPP_ERROR(logger_, "Interrupted while waiting for the service. Exiting.");
-      return nav2_behaviors::Status::FAILED;
-    }
-    RCLCPP_WARN(logger_, "service not available, waiting again...");
-  }
-
-  auto request = std::make_shared<nav2_msgs::srv::GetCostmap::Request>();
-  auto result = costmap_client_->async_send_request(request);
-  if (result.wait_for(std::chrono::seconds(1)) == std::future_status::timeout) {
-    RCLCPP_ERROR(logger_, "Interrupted while waiting for the service. Exiting.");
-    return nav2_behaviors::Status::FAILED;
-  }
-
-  // get costmap
-  auto costmap = result.get()->map;
-
   if (!nav2_util::getCurrentPose(
         initial_pose_, *tf_, global_frame_, robot_base_frame_, transform_tolerance_)) {
     RCLCPP_ERROR(logger_, "Initial robot pose is not available.");
@@ -100,16 +138,29 @@ nav2_behaviors::Status BackUpFreeSpace::onRun(
   pose.y = initial_pose_.pose.position.y;
   pose.theta = tf2::getYaw(initial_pose_.pose.orientation);
 
+  // get costmap
+  if (costmap_source_ == "topic") {
+    if (!cropLatestCostmap(pose, max_radius_, costmap_)) {
+      return nav2_behaviors::Status::FAILED;
+    }
+  } else if (!requestCostmap(costmap_)) {
+    return nav2_behaviors::Status::FAILED;
+  }
+
   // Find the best direction to back up
-  float best_angle = findBestDirection(costmap, pose, -M_PI, M_PI, max_radius_, M_PI / 32.0);
+  selectDirection(pose);
+  const float best_angle = target_heading_;
 
   // Calculate move command
-  twist_x_ = std::cos(best_angle) * command->speed;
-  twist_y_ = std::sin(best_angle) * command->speed;
+  heading_ = target_heading_;
+  speed_ = command->speed;
+  twist_x_ = std::cos(heading_) * speed_;
+  twist_y_ = std::sin(heading_) * speed_;
   command_x_ = command->target.x;
   command_time_allowance_ = command->time_allowance;
 
   end_time_ = clock_->now() + command_time_allowance_;
+  last_replan_ = clock_->now();
 
   if (!nav2_util::getCurrentPose(
         initial_pose_, *tf_, global_frame_, robot_base_frame_, transform_tolerance_)) {
@@ -160,15 +211,33 @@ nav2_behaviors::Status BackUpFreeSpace::onCycleUpdate()
     return nav2_behaviors::Status::SUCCEEDED;
   }
 
-  auto cmd_vel = std::make_unique<geometry_msgs::msg::Twist>();
-  cmd_vel->linear.y = twist_y_;
-  cmd_vel->linear.x = twist_x_;
-
   geometry_msgs::msg::Pose2D pose;
   pose.x = current_pose.pose.position.x;
   pose.y = current_pose.pose.position.y;
   pose.theta = tf2::getYaw(current_pose.pose.orientation);
 
+  if (
+    replan_frequency_ > 0.0 &&
+    (clock_->now() - last_replan_).seconds() >= 1.0 / replan_frequency_) {
+    replanDirection(pose);
+  }
+
+  // turn the velocity toward the latest heading at no more than replan_heading_rate
+  const float heading_error =
+    std::atan2(std::sin(target_heading_ - heading_), std::cos(target_heading_ - heading_));
+  const float max_turn = replan_heading_rate_ / cycle_frequency_;
+  if (replan_heading_rate_ <= 0.0 || std::fabs(heading_error) <= max_turn) {
+    heading_ = target_heading_;
+  } else {
+    heading_ += std::copysign(max_turn, heading_error);
+  }
+  twist_x_ = std::cos(heading_) * speed_;
+  twist_y_ = std::sin(heading_) * speed_;
+
+  auto cmd_vel = std::make_unique<geometry_msgs::msg::Twist>();
+  cmd_vel->linear.y = twist_y_;
+  cmd_vel->linear.x = twist_x_;
+
   if (!isCollisionFree(distance, cmd_vel.get(), pose)) {
     stopRobot();
     RCLCPP_WARN(logger_, "Collision Ahead - Exiting DriveOnHeading");
@@ -180,6 +249,144 @@ nav2_behaviors::Status BackUpFreeSpace::onCycleUpdate()
   return nav2_behaviors::Status::RUNNING;
 }
 
+void BackUpFreeSpace::selectDirection(const geometry_msgs::msg::Pose2D & pose)
+{
+  // the swept disc already accounts for robot_radius, measuring it from the inscribed cost as
+  // well would count the footprint twice on an inflated costmap, so only lethal cells block it
+  if (swept_collision_check_) {
+    distance_field_.update(costmap_, 254);
+  } else if (direction_solver_ == "distance_field") {
+    distance_field_.update(costmap_, 253);
+  }
+
+  if (direction_solver_ == "distance_field") {
+    target_heading_ = findClearestDirection(costmap_, pose, max_radius_);
+  } else if (direction_solver_ == "free_centroid") {
+    target_heading_ = findFreeCentroidDirection(costmap_, pose, max_radius_);
+  } else {
+    target_heading_ = findBestDirection(costmap_, pose, -M_PI, M_PI, max_radius_, M_PI / 32.0);
+  }
+}
+
+void BackUpFreeSpace::replanDirection(const geometry_msgs::msg::Pose2D & pose)
+{
+  last_replan_ = clock_->now();
+  // without a newer costmap only the pose changed, the service is not asked again
+  if (costmap_source_ == "topic" && !cropLatestCostmap(pose, max_radius_, costmap_, true)) {
+    return;
+  }
+  const float previous_heading = target_heading_;
+  selectDirection(pose);
+  RCLCPP_DEBUG(logger_, "replanned heading from %f to %f", previous_heading, target_heading_);
+}
+
+bool BackUpFreeSpace::requestCostmap(nav2_msgs::msg::Costmap & costmap)
+{
+  while (!costmap_client_->wait_for_service(std::chrono::seconds(1))) {
+    if (!rclcpp::ok()) {
+      RCLCPP_ERROR(logger_, "Interrupted while waiting for the service. Exiting.");
+      return false;
+    }
+    RCLCPP_WARN(logger_, "service not available, waiting again...");
+  }
+
+  auto request = std::make_shared<nav2_msgs::srv::GetCostmap::Request>();
+  auto result = costmap_client_->async_send_request(request);
+  if (result.wait_for(std::chrono::seconds(1)) == std::future_status::timeout) {
+    RCLCPP_ERROR(logger_, "Interrupted while waiting for the service. Exiting.");
+    return false;
+  }
+
+  costmap = std::move(result.get()->map);
+  return true;
+}
+
+bool BackUpFreeSpace::cropLatestCostmap(
+  const geometry_msgs::msg::Pose2D & pose, float radius, nav2_msgs::msg::Costmap & window,
+  bool keep_window)
+{
+  nav2_msgs::msg::Costmap::ConstSharedPtr full;
+  {
+    std::lock_guard<std::mutex> lock(costmap_mutex_);
+    full = latest_costmap_;
+  }
+  if (!full) {
+    RCLCPP_ERROR(logger_, "No costmap received on %s yet.", costmap_topic_.c_str());
+    return false;
+  }
+
+  const auto & metadata = full->metadata;
+  const double resolution = metadata.resolution;
+  if (resolution <= 0.0 || full->data.size() < size_t{metadata.size_x} * metadata.size_y) {
+    RCLCPP_ERROR(logger_, "Received an invalid costmap on %s.", costmap_topic_.c_str());
+    return false;
+  }
+
+  // a stalled costmap publisher must not leave the robot backing up into what it missed
+  if (max_costmap_age_ > 0.0) {
+    const double age =
+      (clock_->now() - rclcpp::Time(full->header.stamp, clock_->get_clock_type())).seconds();
+    if (age > max_costmap_age_) {
+      RCLCPP_ERROR(
+        logger_, "The latest costmap on %s is %.2f s old, more than max_costmap_age %.2f s.",
+        costmap_topic_.c_str(), age, max_costmap_age_);
+      return false;
+    }
+  }
+
+  if (keep_window && full == cropped_costmap_) {
+    return true;
+  }
+
+  int x0, y0, x1, y1;
+  bool kept = false;
+  if (keep_window && window.metadata.resolution == metadata.resolution) {
+    // the cells of the window, when it still lines up with the cells of the costmap
+    const double wx = (window.metadata.origin.position.x - metadata.origin.position.x) / resolution;
+    const double wy = (window.metadata.origin.position.y - metadata.origin.position.y) / resolution;
+    x0 = static_cast<int>(std::lround(wx));
+    y0 = static_cast<int>(std::lround(wy));
+    x1 = x0 + static_cast<int>(window.metadata.size_x);
+    y1 = y0 + static_cast<int>(window.metadata.size_y);
+    kept = std::fabs(wx - x0) < 1e-3 && std::fabs(wy - y0) < 1e-3 && x0 >= 0 && y0 >= 0 &&
+           x1 <= static_cast<int>(metadata.size_x) && y1 <= static_cast<int>(metadata.size_y);
+  }
+
+  if (!kept) {
+    const double reach = 2.0 * radius;
+    const double mx = (pose.x - metadata.origin.position.x) / resolution;
+    const double my = (pose.y - metadata.origin.position.y) / resolution;
+    x0 = std::max(static_cast<int>(std::floor(mx - reach / resolution)), 0);
+    y0 = std::max(static_cast<int>(std::floor(my - reach / resolution)), 0);
+    x1 = std::min(
+      static_cast<int>(std::ceil(mx + reach / resolution)) + 1, static_cast<int>(metadata.size_x));
+    y1 = std::min(
+      static_cast<int>(std::ceil(my + reach / resolution)) + 1, static_cast<int>(metadata.size_y));
+    if (x0 >= x1 || y0 >= y1) {
+      RCLCPP_ERROR(
+        logger_, "Robot is outside of the costmap received on %s.", costmap_topic_.c_str());
+      return false;
+    }
+  }
+
+  window.header = full->header;
+  if (!kept) {
+    // a kept window keeps its geometry bit for bit, so the distance field can be updated in place
+    window.metadata = metadata;
+    window.metadata.size_x = x1 - x0;
+    window.metadata.size_y = y1 - y0;
+    window.metadata.origin.position.x = metadata.origin.position.x + x0 * resolution;
+    window.metadata.origin.position.y = metadata.origin.position.y + y0 * resolution;
+  }
+  window.data.resize(size_t{window.metadata.size_x} * window.metadata.size_y);
+  for (int y = y0; y < y1; ++y) {
+    auto row = full->data.begin() + static_cast<size_t>(y) * metadata.size_x;
+    std::copy(row + x0, row + x1, window.data.begin() + static_cast<size_t>(y - y0) * (x1 - x0));
+  }
+  cropped_costmap_ = full;
+  return true;
+}
+
 float BackUpFreeSpace::findBestDirection(
   const nav2_msgs::msg::Costmap & costmap, geometry_msgs::msg::Pose2D pose, float start_angle,
   float end_angle, float radius, float angle_increment)
@@ -203,6 +410,13 @@ float BackUpFreeSpace::findBestDirection(
   float map_min_y = origin_y;
   float map_max_y = origin_y + (size_y * resolution);
 
+  float required_clearance = 0.0f;
+  if (swept_collision_check_) {
+    required_clearance = ClearanceDirectionSolver::requiredClearance(
+      ClearanceDirectionSolver::clearanceAt(distance_field_, costmap.metadata, pose.x, pose.y),
+      robot_radius_, resolution);
+  }
+
   for (float angle = start_angle; angle <= end_angle; angle += angle_increment) {
     bool is_safe = true;
 
@@ -215,7 +429,11 @@ float BackUpFreeSpace::findBestDirection(
         int j = static_cast<int>((y - origin_y) / resolution);
 
         if (i >= 0 && i < size_x && j >= 0 && j < size_y) {
-          if (costmap.data[i + j * size_x] >= 253) {
+          const bool blocked =
+            swept_collision_check_ ?
+              distance_field_.at(i, j) <= 0.0f || distance_field_.at(i, j) < required_clearance :
+              costmap.data[i + j * size_x] >= 253;
+          if (blocked) {
             is_safe = false;
             break;
           }
@@ -247,28 +465,90 @@ float BackUpFreeSpace::findBestDirection(
   }
   best_angle = (final_safe_angle + final_unsafe_angle) / 2.0f;
   RCLCPP_WARN(logger_, "first %f last%f", final_safe_angle, final_unsafe_angle);
-  visualizeline(pose, radius, final_safe_angle, final_unsafe_angle);
+  if (visualize_) {
+    visualizeline(pose, radius, final_safe_angle, final_unsafe_angle);
+  }
   return best_angle;
 }
 
-std::vector<geometry_msgs::msg::Point> BackUpFreeSpace::gatherFreePoints(
+float BackUpFreeSpace::findClearestDirection(
   const nav2_msgs::msg::Costmap & costmap, geometry_msgs::msg::Pose2D pose, float radius)
 {
-  std::vector<geometry_msgs::msg::Point> results;
-  for (unsigned int i = 0; i < costmap.metadata.size_x; i++) {
-    for (unsigned int j = 0; j < costmap.metadata.size_y; j++) {
-      auto idx = i + j * costmap.metadata.size_x;
-      auto x = i * costmap.metadata.resolution + costmap.metadata.origin.position.x;
-      auto y = j * costmap.metadata.resolution + costmap.metadata.origin.position.y;
-      if (std::hypot(x - pose.x, y - pose.y) <= radius && costmap.data[idx] == 0) {
-        geometry_msgs::msg::Point p;
-        p.x = x;
-        p.y = y;
-        results.push_back(p);
+  DirectionChoice choice = clearance_solver_.solve(
+    distance_field_, costmap.metadata, pose, radius, swept_collision_check_ ? robot_radius_ : 0.0f);
+  if (!choice.found) {
+    RCLCPP_WARN(logger_, "No clear heading found, falling back to the ray sweep.");
+    return findBestDirection(costmap, pose, -M_PI, M_PI, radius, M_PI / 32.0);
+  }
+
+  RCLCPP_DEBUG(
+    logger_, "heading %f with clearance %f, sector %f to %f", choice.angle, choice.clearance,
+    choice.sector_begin, choice.sector_end);
+  if (visualize_) {
+    visualizeline(pose, radius, choice.sector_begin, choice.sector_end);
+  }
+  return choice.angle;
+}
+
+void BackUpFreeSpace::gatherFreePoints(
+  const nav2_msgs::msg::Costmap & costmap, geometry_msgs::msg::Pose2D pose, float radius,
+  FreePoints & points)
+{
+  points.clear();
+  const float resolution = costmap.metadata.resolution;
+  const int size_x = costmap.metadata.size_x;
+  const int size_y = costmap.metadata.size_y;
+  if (resolution <= 0.0f || radius < 0.0f) {
+    return;
+  }
+
+  // the pose in cells, relative to the center of cell (0, 0)
+  const float cx = (pose.x - costmap.metadata.origin.position.x) / resolution - 0.5f;
+  const float cy = (pose.y - costmap.metadata.origin.position.y) / resolution - 0.5f;
+  const float r = radius / resolution;
+  const float r2 = r * r;
+
+  const int j_begin = std::max(static_cast<int>(std::ceil(cy - r)), 0);
+  const int j_end = std::min(static_cast<int>(std::floor(cy + r)) + 1, size_y);
+  for (int j = j_begin; j < j_end; ++j) {
+    const float dy = j - cy;
+    const float half_span = std::sqrt(std::max(r2 - dy * dy, 0.0f));
+    const int i_begin = std::max(static_cast<int>(std::ceil(cx - half_span)), 0);
+    const int i_end = std::min(static_cast<int>(std::floor(cx + half_span)) + 1, size_x);
+    const uint8_t * row = &costmap.data[static_cast<size_t>(j) * size_x];
+    const float y = costmap.metadata.origin.position.y + (j + 0.5f) * resolution;
+    for (int i = i_begin; i < i_end; ++i) {
+      if (row[i] == 0) {
+        points.x.push_back(costmap.metadata.origin.position.x + (i + 0.5f) * resolution);
+        points.y.push_back(y);
       }
     }
   }
-  return results;
+}
+
+float BackUpFreeSpace::findFreeCentroidDirection(
+  const nav2_msgs::msg::Costmap & costmap, geometry_msgs::msg::Pose2D pose, float radius)
+{
+  gatherFreePoints(costmap, pose, radius, free_points_);
+  if (free_points_.size() < static_cast<size_t>(std::max(free_threshold_, 1))) {
+    RCLCPP_WARN(
+      logger_, "Only %zu free cells within %f m, falling back to the ray sweep.",
+      free_points_.size(), radius);
+    return findBestDirection(costmap, pose, -M_PI, M_PI, radius, M_PI / 32.0);
+  }
+
+  double sum_x = 0.0, sum_y = 0.0;
+  for (size_t k = 0; k < free_points_.size(); ++k) {
+    sum_x += free_points_.x[k];
+    sum_y += free_points_.y[k];
+  }
+  const double dx = sum_x / free_points_.size() - pose.x;
+  const double dy = sum_y / free_points_.size() - pose.y;
+  if (std::hypot(dx, dy) < costmap.metadata.resolution) {
+    RCLCPP_WARN(logger_, "Free space is centered on the robot, falling back to the ray sweep.");
+    return findBestDirection(costmap, pose, -M_PI, M_PI, radius, M_PI / 32.0);
+  }
+  return std::atan2(dy, dx);
 }
 
 void BackUpFreeSpace::visualize(const geometry_msgs::msg::Point & target_point)
@@ -0,0 +1,308 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pb_nav2_plugins/behaviors/clearance_direction_solver.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace pb_nav2_behaviors
+{
+
+namespace
+{
+
+// squared distance in cells standing in for "no blocked cell", finite so the envelope stays exact
+constexpr float FAR = 1e20f;
+
+}  // namespace
+
+void DistanceField::transform1D(unsigned int n)
+{
+  // where the parabolas rooted at samples q and p intersect
+  auto intersection = [this](int q, int p) {
+    return ((f_[q] + static_cast<float>(q) * q) - (f_[p] + static_cast<float>(p) * p)) /
+           (2.0f * (q - p));
+  };
+
+  // lower envelope of the parabolas rooted at every sample
+  int k = 0;
+  v_[0] = 0;
+  z_[0] = -std::numeric_limits<float>::infinity();
+  z_[1] = std::numeric_limits<float>::infinity();
+  for (int q = 1; q < static_cast<int>(n); ++q) {
+    float s = intersection(q, v_[k]);
+    while (s <= z_[k]) {
+      --k;
+      s = intersection(q, v_[k]);
+    }
+    ++k;
+    v_[k] = q;
+    z_[k] = s;
+    z_[k + 1] = std::numeric_limits<float>::infinity();
+  }
+
+  k = 0;
+  for (int q = 0; q < static_cast<int>(n); ++q) {
+    while (z_[k + 1] < q) {
+      ++k;
+    }
+    const float dq = static_cast<float>(q - v_[k]);
+    d_[q] = dq * dq + f_[v_[k]];
+  }
+}
+
+bool DistanceField::transformColumn(unsigned int i)
+{
+  for (unsigned int j = 0; j < size_y_; ++j) {
+    f_[j] = blocked_[j * size_x_ + i] ? 0.0f : FAR;
+  }
+  transform1D(size_y_);
+  bool changed = false;
+  for (unsigned int j = 0; j < size_y_; ++j) {
+    float & column = column_[j * size_x_ + i];
+    if (column != d_[j]) {
+      column = d_[j];
+      dirty_rows_[j] = 1;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+void DistanceField::transformRow(unsigned int j)
+{
+  // the squared euclidean distance, clipped at the map border
+  std::copy(&column_[j * size_x_], &column_[j * size_x_] + size_x_, f_.begin());
+  transform1D(size_x_);
+  float * row = &distance_[j * size_x_];
+  const unsigned int border_y = std::min(j + 1, size_y_ - j);
+  for (unsigned int i = 0; i < size_x_; ++i) {
+    const float border = static_cast<float>(std::min({i + 1, size_x_ - i, border_y}));
+    row[i] = std::min(std::sqrt(d_[i]), border) * resolution_;
+  }
+}
+
+void DistanceField::build(const nav2_msgs::msg::Costmap & costmap, unsigned char lethal_cost)
+{
+  size_x_ = costmap.metadata.size_x;
+  size_y_ = costmap.metadata.size_y;
+  resolution_ = costmap.metadata.resolution;
+  origin_x_ = costmap.metadata.origin.position.x;
+  origin_y_ = costmap.metadata.origin.position.y;
+  const size_t size = static_cast<size_t>(size_x_) * size_y_;
+  distance_.resize(size);
+  blocked_.resize(size);
+  column_.resize(size);
+  if (size == 0) {
+    return;
+  }
+
+  const unsigned int longest = std::max(size_x_, size_y_);
+  f_.resize(longest);
+  d_.resize(longest);
+  z_.resize(longest + 1);
+  v_.resize(longest);
+  dirty_columns_.assign(size_x_, 0);
+  dirty_rows_.assign(size_y_, 0);
+
+  for (size_t k = 0; k < size; ++k) {
+    blocked_[k] = costmap.data[k] >= lethal_cost;
+  }
+  // squared distances along the columns first, then along the rows
+  for (unsigned int i = 0; i < size_x_; ++i) {
+    transformColumn(i);
+  }
+  for (unsigned int j = 0; j < size_y_; ++j) {
+    transformRow(j);
+  }
+  std::fill(dirty_rows_.begin(), dirty_rows_.end(), 0);
+}
+
+size_t DistanceField::update(const nav2_msgs::msg::Costmap & costmap, unsigned char lethal_cost)
+{
+  const auto & metadata = costmap.metadata;
+  if (
+    metadata.size_x != size_x_ || metadata.size_y != size_y_ ||
+    metadata.resolution != resolution_ || metadata.origin.position.x != origin_x_ ||
+    metadata.origin.position.y != origin_y_ || distance_.empty()) {
+    build(costmap, lethal_cost);
+    return distance_.size();
+  }
+
+  // find the columns with a cell that changed state, row by row
+  size_t changed = 0;
+  for (unsigned int j = 0; j < size_y_; ++j) {
+    const size_t row = static_cast<size_t>(j) * size_x_;
+    for (unsigned int i = 0; i < size_x_; ++i) {
+      const uint8_t blocked = costmap.data[row + i] >= lethal_cost;
+      if (blocked != blocked_[row + i]) {
+        blocked_[row + i] = blocked;
+        dirty_columns_[i] = 1;
+        ++changed;
+      }
+    }
+  }
+  if (changed == 0) {
+    return 0;
+  }
+
+  for (unsigned int i = 0; i < size_x_; ++i) {
+    if (dirty_columns_[i]) {
+      transformColumn(i);
+      dirty_columns_[i] = 0;
+    }
+  }
+  for (unsigned int j = 0; j < size_y_; ++j) {
+    if (dirty_rows_[j]) {
+      transformRow(j);
+      dirty_rows_[j] = 0;
+    }
+  }
+  return changed;
+}
+
+void ClearanceDirectionSolver::setHeadings(unsigned int num_headings)
+{
+  num_headings = std::max(num_headings, 1u);
+  angles_.resize(num_headings);
+  cos_.resize(num_headings);
+  sin_.resize(num_headings);
+  scores_.resize(num_headings);
+
+  const double increment = 2.0 * M_PI / num_headings;
+  for (unsigned int h = 0; h < num_headings; ++h) {
+    const double angle = -M_PI + h * increment;
+    angles_[h] = static_cast<float>(angle);
+    cos_[h] = static_cast<float>(std::cos(angle));
+    sin_[h] = static_cast<float>(std::sin(angle));
+  }
+}
+
+float ClearanceDirectionSolver::clearanceAt(
+  const DistanceField & field, const nav2_msgs::msg::CostmapMetaData & metadata, float x, float y)
+{
+  const float mx = (x - static_cast<float>(metadata.origin.position.x)) / metadata.resolution;
+  const float my = (y - static_cast<float>(metadata.origin.position.y)) / metadata.resolution;
+  if (!(mx >= 0.0f && my >= 0.0f)) {
+    return 0.0f;
+  }
+  const auto i = static_cast<unsigned int>(mx);
+  const auto j = static_cast<unsigned int>(my);
+  if (i >= field.sizeX() || j >= field.sizeY()) {
+    return 0.0f;
+  }
+  return field.at(i, j);
+}
+
+float ClearanceDirectionSolver::requiredClearance(
+  float start_clearance, float robot_radius, float resolution)
+{
+  // half a cell of slack, a disc moving along an obstacle sees its distance jitter by that much
+  return std::min(robot_radius, start_clearance) - 0.5f * resolution;
+}
+
+DirectionChoice ClearanceDirectionSolver::solve(
+  const DistanceField & field, const nav2_msgs::msg::CostmapMetaData & metadata,
+  const geometry_msgs::msg::Pose2D & pose, float radius, float robot_radius)
+{
+  DirectionChoice choice{0.0f, 0.0f, 0.0f, 0.0f, false};
+  const unsigned int num_headings = angles_.size();
+  const float resolution = metadata.resolution;
+  if (num_headings == 0 || resolution <= 0.0f) {
+    return choice;
+  }
+
+  const float start_clearance = clearanceAt(field, metadata, pose.x, pose.y);
+  if (start_clearance <= 0.0f) {
+    return choice;
+  }
+
+  // every heading starts with the clearance the robot already has, so the samples that cannot
+  // have moved away from it yet would only flatten the scores, they are still checked against
+  // the swept disc
+  const float skip = std::min(0.5f * start_clearance, radius);
+  const auto first_step = static_cast<unsigned int>(std::ceil(skip / resolution));
+  const auto last_step = static_cast<unsigned int>(radius / resolution);
+  const float required = robot_radius > 0.0f ?
+                           requiredClearance(start_clearance, robot_radius, resolution) :
+                           0.0f;
+  const unsigned int check_from = robot_radius > 0.0f ? 1 : first_step;
+
+  unsigned int best = 0;
+  for (unsigned int h = 0; h < num_headings; ++h) {
+    float score = first_step <= last_step ? std::numeric_limits<float>::max() : start_clearance;
+    const float step_x = cos_[h] * resolution;
+    const float step_y = sin_[h] * resolution;
+    float x = pose.x + check_from * step_x;
+    float y = pose.y + check_from * step_y;
+    for (unsigned int s = check_from; s <= last_step; ++s, x += step_x, y += step_y) {
+      const float clearance = clearanceAt(field, metadata, x, y);
+      if (clearance <= 0.0f || clearance < required) {
+        score = 0.0f;
+        break;
+      }
+      if (s >= first_step) {
+        score = std::min(score, clearance);
+      }
+    }
+    scores_[h] = score;
+    if (score > scores_[best]) {
+      best = h;
+    }
+  }
+
+  if (scores_[best] <= 0.0f) {
+    return choice;
+  }
+
+  // grow the sector of headings that are as good as the best one, around the circle
+  const float threshold = scores_[best] - 0.5f * resolution;
+  unsigned int below = 0, above = 0;
+  while (below + above + 1 < num_headings &&
+         scores_[(best + num_headings - below - 1) % num_headings] >= threshold)
+  {
+    ++below;
+  }
+  while (below + above + 1 < num_headings &&
+         scores_[(best + above + 1) % num_headings] >= threshold)
+  {
+    ++above;
+  }
+
+  const float increment = static_cast<float>(2.0 * M_PI / num_headings);
+  choice.found = true;
+  if (below + above + 1 >= num_headings) {
+    // open all around, keep the heading with the most clearance
+    choice.angle = angles_[best];
+    choice.clearance = scores_[best];
+    choice.sector_begin = -M_PI;
+    choice.sector_end = M_PI;
+    return choice;
+  }
+
+  const float center = angles_[best] + 0.5f * (static_cast<float>(above) - below) * increment;
+  choice.angle = std::atan2(std::sin(center), std::cos(center));
+  const int center_index = static_cast<int>(best) + (static_cast<int>(above) - below) / 2;
+  choice.clearance = scores_[(center_index + num_headings) % num_headings];
+  const float begin = angles_[best] - below * increment;
+  const float end = angles_[best] + above * increment;
+  choice.sector_begin = std::atan2(std::sin(begin), std::cos(begin));
+  choice.sector_end = std::atan2(std::sin(end), std::cos(end));
+  return choice;
+}
+
+}  // namespace pb_nav2_behaviors
@@ -0,0 +1,257 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pb_nav2_plugins/layers/dirty_tiles.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "nav2_costmap_2d/cost_values.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PB_NAV2_DIRTY_TILES_SSE2
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PB_NAV2_DIRTY_TILES_NEON
+#endif
+
+using nav2_costmap_2d::NO_INFORMATION;
+
+namespace pb_nav2_costmap_2d
+{
+
+namespace
+{
+
+/**
+ * @brief The master cell of CostmapLayer::updateWithMax
+ */
+inline unsigned char maxMergeCell(unsigned char cost, unsigned char old)
+{
+  if (cost == NO_INFORMATION) {
+    return old;
+  }
+  return old == NO_INFORMATION || old < cost ? cost : old;
+}
+
+/**
+ * @brief CostmapLayer::updateWithMax along n cells of a row, 16 at a time
+ */
+void maxMergeRow(const unsigned char * costmap, unsigned char * master, size_t n)
+{
+  size_t i = 0;
+#if defined(PB_NAV2_DIRTY_TILES_SSE2)
+  const __m128i unknown = _mm_set1_epi8(static_cast<char>(NO_INFORMATION));
+  for (; i + 16 <= n; i += 16) {
+    const __m128i cost = _mm_loadu_si128(reinterpret_cast<const __m128i *>(costmap + i));
+    const __m128i old = _mm_loadu_si128(reinterpret_cast<const __m128i *>(master + i));
+    // an unknown master cell takes any known cost, as if it were free
+    const __m128i known_old = _mm_andnot_si128(_mm_cmpeq_epi8(old, unknown), old);
+    const __m128i merged = _mm_max_epu8(known_old, cost);
+    // unknown layer cells leave the master as it is
+    const __m128i keep = _mm_cmpeq_epi8(cost, unknown);
+    _mm_storeu_si128(
+      reinterpret_cast<__m128i *>(master + i),
+      _mm_or_si128(_mm_and_si128(keep, old), _mm_andnot_si128(keep, merged)));
+  }
+#elif defined(PB_NAV2_DIRTY_TILES_NEON)
+  const uint8x16_t unknown = vdupq_n_u8(NO_INFORMATION);
+  for (; i + 16 <= n; i += 16) {
+    const uint8x16_t cost = vld1q_u8(costmap + i);
+    const uint8x16_t old = vld1q_u8(master + i);
+    const uint8x16_t known_old = vbicq_u8(old, vceqq_u8(old, unknown));
+    const uint8x16_t merged = vmaxq_u8(known_old, cost);
+    vst1q_u8(master + i, vbslq_u8(vceqq_u8(cost, unknown), old, merged));
+  }
+#endif
+  for (; i < n; ++i) {
+    master[i] = maxMergeCell(costmap[i], master[i]);
+  }
+}
+
+/**
+ * @brief CostmapLayer::updateWithOverwrite along n cells of a row, 16 at a time
+ */
+void overwriteRow(const unsigned char * costmap, unsigned char * master, size_t n)
+{
+  size_t i = 0;
+#if defined(PB_NAV2_DIRTY_TILES_SSE2)
+  const __m128i unknown = _mm_set1_epi8(static_cast<char>(NO_INFORMATION));
+  for (; i + 16 <= n; i += 16) {
+    const __m128i cost = _mm_loadu_si128(reinterpret_cast<const __m128i *>(costmap + i));
+    const __m128i old = _mm_loadu_si128(reinterpret_cast<const __m128i *>(master + i));
+    const __m128i keep = _mm_cmpeq_epi8(cost, unknown);
+    _mm_storeu_si128(
+      reinterpret_cast<__m128i *>(master + i),
+      _mm_or_si128(_mm_and_si128(keep, old), _mm_andnot_si128(keep, cost)));
+  }
+#elif defined(PB_NAV2_DIRTY_TILES_NEON)
+  const uint8x16_t unknown = vdupq_n_u8(NO_INFORMATION);
+  for (; i + 16 <= n; i += 16) {
+    const uint8x16_t cost = vld1q_u8(costmap + i);
+    const uint8x16_t old = vld1q_u8(master + i);
+    vst1q_u8(master + i, vbslq_u8(vceqq_u8(cost, unknown), old, cost));
+  }
+#endif
+  for (; i < n; ++i) {
+    if (costmap[i] != NO_INFORMATION) {
+      master[i] = costmap[i];
+    }
+  }
+}
+
+}  // namespace
+
+void DirtyTiles::resize(unsigned int size_x, unsigned int size_y)
+{
+  size_x_ = size_x;
+  size_y_ = size_y;
+  tiles_x_ = (size_x + TILE_SIZE - 1) >> TILE_SHIFT;
+  tiles_y_ = (size_y + TILE_SIZE - 1) >> TILE_SHIFT;
+  flags_.assign(static_cast<size_t>(tiles_x_) * tiles_y_, DIRTY);
+}
+
+void DirtyTiles::markRect(
+  unsigned int min_mx, unsigned int min_my, unsigned int max_mx, unsigned int max_my)
+{
+  if (size_x_ == 0 || size_y_ == 0) {
+    return;
+  }
+  max_mx = std::min(max_mx, size_x_ - 1);
+  max_my = std::min(max_my, size_y_ - 1);
+  if (min_mx > max_mx || min_my > max_my) {
+    return;
+  }
+  for (unsigned int ty = min_my >> TILE_SHIFT; ty <= max_my >> TILE_SHIFT; ++ty) {
+    uint8_t * row = &flags_[static_cast<size_t>(ty) * tiles_x_];
+    for (unsigned int tx = min_mx >> TILE_SHIFT; tx <= max_mx >> TILE_SHIFT; ++tx) {
+      row[tx] |= DIRTY;
+    }
+  }
+}
+
+void DirtyTiles::shift(int shift_x, int shift_y)
+{
+  shift_scratch_.assign(flags_.begin(), flags_.end());
+  const int size_x = static_cast<int>(size_x_);
+  const int size_y = static_cast<int>(size_y_);
+
+  for (unsigned int ty = 0; ty < tiles_y_; ++ty) {
+    // the rows of the tile before the shift
+    const int y_begin = static_cast<int>(ty << TILE_SHIFT) + shift_y;
+    const int y_last = std::min(static_cast<int>((ty + 1) << TILE_SHIFT), size_y) - 1 + shift_y;
+    for (unsigned int tx = 0; tx < tiles_x_; ++tx) {
+      const int x_begin = static_cast<int>(tx << TILE_SHIFT) + shift_x;
+      const int x_last = std::min(static_cast<int>((tx + 1) << TILE_SHIFT), size_x) - 1 + shift_x;
+
+      // the cells that scrolled in hold the default value, which may have to be merged
+      bool dirty = x_begin < 0 || y_begin < 0 || x_last >= size_x || y_last >= size_y;
+      const int x0 = std::max(x_begin, 0), x1 = std::min(x_last, size_x - 1);
+      const int y0 = std::max(y_begin, 0), y1 = std::min(y_last, size_y - 1);
+      for (int sy = y0 >> TILE_SHIFT; !dirty && x0 <= x1 && sy <= (y1 >> TILE_SHIFT); ++sy) {
+        for (int sx = x0 >> TILE_SHIFT; sx <= (x1 >> TILE_SHIFT); ++sx) {
+          dirty |= shift_scratch_[static_cast<size_t>(sy) * tiles_x_ + sx] != 0;
+        }
+      }
+      flags_[static_cast<size_t>(ty) * tiles_x_ + tx] = dirty ? DIRTY : 0;
+    }
+  }
+}
+
+void DirtyTiles::refresh(const unsigned char * costmap, bool merge_free)
+{
+  if (merge_free != merge_free_) {
+    merge_free_ = merge_free;
+    markAll();
+  }
+
+  for (unsigned int ty = 0; ty < tiles_y_; ++ty) {
+    const unsigned int y0 = ty << TILE_SHIFT;
+    const unsigned int y1 = std::min(y0 + TILE_SIZE, size_y_);
+    for (unsigned int tx = 0; tx < tiles_x_; ++tx) {
+      uint8_t & flag = flags_[static_cast<size_t>(ty) * tiles_x_ + tx];
+      if (!(flag & DIRTY)) {
+        continue;
+      }
+      const unsigned int x0 = tx << TILE_SHIFT;
+      const unsigned int x1 = std::min(x0 + TILE_SIZE, size_x_);
+
+      bool merged = false;
+      for (unsigned int y = y0; y < y1 && !merged; ++y) {
+        const unsigned char * row = costmap + static_cast<size_t>(y) * size_x_;
+        if (merge_free) {
+          for (unsigned int x = x0; x < x1; ++x) {
+            merged |= row[x] != NO_INFORMATION;
+          }
+        } else {
+          // neither free nor unknown, the subtraction wraps free around to unknown
+          for (unsigned int x = x0; x < x1; ++x) {
+            merged |= static_cast<unsigned char>(row[x] - 1) < NO_INFORMATION - 1;
+          }
+        }
+      }
+      flag = merged ? MERGED : 0;
+    }
+  }
+}
+
+template<typename Merge>
+void DirtyTiles::forEachMergedSpan(
+  int min_i, int min_j, int max_i, int max_j, Merge && merge) const
+{
+  min_i = std::max(min_i, 0);
+  min_j = std::max(min_j, 0);
+  max_i = std::min(max_i, static_cast<int>(size_x_));
+  max_j = std::min(max_j, static_cast<int>(size_y_));
+
+  for (int j = min_j; j < max_j; ++j) {
+    const uint8_t * tiles = &flags_[static_cast<size_t>(j >> TILE_SHIFT) * tiles_x_];
+    int i = min_i;
+    while (i < max_i) {
+      // skip the tile if it has nothing to merge, otherwise run to the end of the merged tiles
+      if (!tiles[i >> TILE_SHIFT]) {
+        i = ((i >> TILE_SHIFT) + 1) << TILE_SHIFT;
+        continue;
+      }
+      int end = i;
+      while (end < max_i && tiles[end >> TILE_SHIFT]) {
+        end = ((end >> TILE_SHIFT) + 1) << TILE_SHIFT;
+      }
+      end = std::min(end, max_i);
+      merge(static_cast<size_t>(j) * size_x_ + i, static_cast<size_t>(end - i));
+      i = end;
+    }
+  }
+}
+
+void DirtyTiles::updateWithMax(
+  const unsigned char * costmap, unsigned char * master, int min_i, int min_j, int max_i,
+  int max_j) const
+{
+  forEachMergedSpan(min_i, min_j, max_i, max_j, [&](size_t offset, size_t length) {
+    maxMergeRow(costmap + offset, master + offset, length);
+  });
+}
+
+void DirtyTiles::updateWithOverwrite(
+  const unsigned char * costmap, unsigned char * master, int min_i, int min_j, int max_i,
+  int max_j) const
+{
+  forEachMergedSpan(min_i, min_j, max_i, max_j, [&](size_t offset, size_t length) {
+    overwriteRow(costmap + offset, master + offset, length);
+  });
+}
+
+}  // namespace pb_nav2_costmap_2d
@@ -16,11 +16,17 @@
 #include "pb_nav2_plugins/layers/intensity_obstacle_layer.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "nav2_costmap_2d/costmap_layer.hpp"
+#include "pb_nav2_plugins/layers/marking_kernel.hpp"
+#include "pb_nav2_plugins/layers/rolling_shift.hpp"
+#include "pb_nav2_plugins/layers/shared_observation_cache.hpp"
 #include "pluginlib/class_list_macros.hpp"
 #include "sensor_msgs/point_cloud2_iterator.hpp"
 
@@ -30,13 +36,150 @@ using nav2_costmap_2d::FREE_SPACE;
 using nav2_costmap_2d::LETHAL_OBSTACLE;
 using nav2_costmap_2d::NO_INFORMATION;
 
-using nav2_costmap_2d::Observation;
-using nav2_costmap_2d::ObservationBuffer;
 using rcl_interfaces::msg::ParameterType;
 
 namespace pb_nav2_costmap_2d
 {
 
+namespace
+{
+
+/**
+ * @brief raytraceLine action that records traced cells in a bitmask instead of writing them
+ */
+class MarkCellBit
+{
+public:
+  MarkCellBit(uint64_t * mask, unsigned int base) : mask_(mask), base_(base) {}
+  inline void operator()(unsigned int offset)
+  {
+    const unsigned int bit = offset - base_;
+    mask_[bit >> 6] |= uint64_t{1} << (bit & 63);
+  }
+
+private:
+  uint64_t * mask_;
+  unsigned int base_;
+};
+
+/**
+ * @brief raytraceLine action that writes free space, flags the tiles it changed and drops the hit
+ * counts of the cells when they are kept
+ */
+class ClearCell
+{
+public:
+  ClearCell(unsigned char * costmap, DirtyTiles & tiles, uint8_t * hits)
+  : costmap_(costmap), tiles_(tiles), hits_(hits)
+  {
+  }
+  inline void operator()(unsigned int offset)
+  {
+    if (costmap_[offset] != FREE_SPACE) {
+      costmap_[offset] = FREE_SPACE;
+      tiles_.mark(offset);
+    }
+    if (hits_) {
+      hits_[offset] = 0;
+    }
+  }
+
+private:
+  unsigned char * costmap_;
+  DirtyTiles & tiles_;
+  uint8_t * hits_;
+};
+
+/**
+ * @brief Decode the x, y and z fields of a cloud into point blocks, clearing clouds need no
+ * intensity field
+ */
+template<typename BlockVisitor>
+void forEachXYZBlock(
+  const sensor_msgs::msg::PointCloud2 & cloud, PointBlock & block, BlockVisitor && visit)
+{
+  sensor_msgs::PointCloud2ConstIterator<float> iter_x(cloud, "x");
+  sensor_msgs::PointCloud2ConstIterator<float> iter_y(cloud, "y");
+  sensor_msgs::PointCloud2ConstIterator<float> iter_z(cloud, "z");
+
+  block.size = 0;
+  for (; iter_x != iter_x.end(); ++iter_x, ++iter_y, ++iter_z) {
+    block.x[block.size] = *iter_x;
+    block.y[block.size] = *iter_y;
+    block.z[block.size] = *iter_z;
+    if (++block.size == PointBlock::CAPACITY) {
+      visit(block);
+      block.size = 0;
+    }
+  }
+  if (block.size > 0) {
+    visit(block);
+  }
+}
+
+/**
+ * @brief Transform and filter the point blocks of an observation into a PreparedCloud
+ * @param decode Callable taking (PointBlock &, visitor) that feeds the blocks in the frame of the
+ *        observation to the visitor
+ */
+template<typename Decode>
+std::shared_ptr<PreparedCloud> preparePoints(
+  const StoredObservation & obs, bool marking, bool clearing, double min_intensity,
+  double max_intensity, Decode && decode)
+{
+  auto prepared = std::make_shared<PreparedCloud>();
+  prepared->marking = marking;
+  prepared->clearing = clearing;
+  prepared->min_intensity = min_intensity;
+  prepared->max_intensity = max_intensity;
+
+  const PointFilterParams params = makePointFilterParams(
+    obs.min_obstacle_height, obs.max_obstacle_height, min_intensity, max_intensity, obs.origin.x,
+    obs.origin.y, obs.origin.z, obs.obstacle_min_range, obs.obstacle_max_range);
+
+  // the scratch is local, the one of the layer belongs to the update thread
+  PointBlock block;
+  uint32_t survivors[PointBlock::CAPACITY];
+  decode(block, [&](PointBlock & decoded) {
+    transformPointBlock(decoded, obs.transform);
+    prepared->points_in += decoded.size;
+    if (clearing) {
+      prepared->clearing_blocks.push_back(decoded);
+    }
+    if (marking) {
+      const size_t num_survivors = filterPointBlock(decoded, params, survivors);
+      appendSurvivors(decoded, survivors, num_survivors, prepared->marking_blocks);
+    }
+  });
+  return prepared;
+}
+
+/**
+ * @brief Build the observation of a cloud, or take it from the cache of its source when the layer
+ * shares observations
+ * @param build Callable taking (StoredObservation &) that builds the observation, returning false
+ *        if it cannot be built
+ * @return False if the observation could not be built
+ */
+template<typename Build>
+bool shareObservation(
+  const sensor_msgs::msg::PointCloud2 & cloud, const std::shared_ptr<ObservationStore> & buffer,
+  const SharedObservationCache::Needs & needs, Build && build, StoredObservation & observation)
+{
+  const std::shared_ptr<SharedObservationCache> & shared = buffer->sharedCache();
+  if (!shared) {
+    return build(observation);
+  }
+  if (!shared->share(cloud, needs, build, observation)) {
+    return false;
+  }
+  // the observation may come from a source of another layer
+  observation.source = buffer->source();
+  return true;
+}
+
+}  // namespace
+
 IntensityObstacleLayer::~IntensityObstacleLayer()
 {
   dyn_params_handler_.reset();
@@ -58,6 +201,23 @@ void IntensityObstacleLayer::onInitialize()
   declareParameter("min_obstacle_intensity", rclcpp::ParameterValue(0.1));
   declareParameter("max_obstacle_intensity", rclcpp::ParameterValue(2.0));
   declareParameter("combination_method", rclcpp::ParameterValue(1));
+  declareParameter("parallel_clearing", rclcpp::ParameterValue(false));
+  declareParameter("clearing_threads", rclcpp::ParameterValue(4));
+  declareParameter("clearing_angular_resolution", rclcpp::ParameterValue(0.0));
+  declareParameter("fused_mark_clear", rclcpp::ParameterValue(false));
+  declareParameter("share_observations", rclcpp::ParameterValue(false));
+  declareParameter("async_preprocessing", rclcpp::ParameterValue(false));
+  declareParameter("occupancy_mode", rclcpp::ParameterValue(std::string("binary")));
+  declareParameter("hit_increment", rclcpp::ParameterValue(1));
+  declareParameter("hit_threshold", rclcpp::ParameterValue(3));
+  declareParameter("hit_max", rclcpp::ParameterValue(10));
+  declareParameter("hit_decay_time", rclcpp::ParameterValue(0.5));
+  declareParameter("clearing_interval", rclcpp::ParameterValue(0.0));
+  declareParameter("far_lod_factor", rclcpp::ParameterValue(1));
+  declareParameter("near_field_radius", rclcpp::ParameterValue(3.0));
+  declareParameter("stats_enabled", rclcpp::ParameterValue(false));
+  declareParameter("stats_window", rclcpp::ParameterValue(200));
+  declareParameter("stats_publish_rate", rclcpp::ParameterValue(1.0));
   declareParameter("observation_sources", rclcpp::ParameterValue(std::string("")));
 
   auto node = node_.lock();
@@ -70,6 +230,36 @@ void IntensityObstacleLayer::onInitialize()
   node->get_parameter(name_ + "." + "min_obstacle_intensity", min_obstacle_intensity_);
   node->get_parameter(name_ + "." + "max_obstacle_intensity", max_obstacle_intensity_);
   node->get_parameter(name_ + "." + "combination_method", combination_method_);
+  bool parallel_clearing;
+  int clearing_threads;
+  node->get_parameter(name_ + "." + "parallel_clearing", parallel_clearing);
+  node->get_parameter(name_ + "." + "clearing_threads", clearing_threads);
+  node->get_parameter(
+    name_ + "." + "clearing_angular_resolution", clearing_angular_resolution_);
+  node->get_parameter(name_ + "." + "fused_mark_clear", fused_mark_clear_);
+  bool share_observations;
+  node->get_parameter(name_ + "." + "share_observations", share_observations);
+  node->get_parameter(name_ + "." + "async_preprocessing", async_preprocessing_);
+  prepare_min_intensity_ = min_obstacle_intensity_;
+  prepare_max_intensity_ = max_obstacle_intensity_;
+  std::string occupancy_mode;
+  int hit_increment, hit_threshold, hit_max;
+  node->get_parameter(name_ + "." + "occupancy_mode", occupancy_mode);
+  node->get_parameter(name_ + "." + "hit_increment", hit_increment);
+  node->get_parameter(name_ + "." + "hit_threshold", hit_threshold);
+  node->get_parameter(name_ + "." + "hit_max", hit_max);
+  node->get_parameter(name_ + "." + "hit_decay_time", hit_decay_time_);
+  node->get_parameter(name_ + "." + "clearing_interval", clearing_interval_);
+  int far_lod_factor;
+  double near_field_radius;
+  node->get_parameter(name_ + "." + "far_lod_factor", far_lod_factor);
+  node->get_parameter(name_ + "." + "near_field_radius", near_field_radius);
+  bool stats_enabled;
+  int stats_window;
+  double stats_publish_rate;
+  node->get_parameter(name_ + "." + "stats_enabled", stats_enabled);
+  node->get_parameter(name_ + "." + "stats_window", stats_window);
+  node->get_parameter(name_ + "." + "stats_publish_rate", stats_publish_rate);
   node->get_parameter("track_unknown_space", track_unknown_space);
   node->get_parameter("transform_tolerance", transform_tolerance);
   node->get_parameter(name_ + "." + "observation_sources", topics_string);
@@ -81,6 +271,52 @@ void IntensityObstacleLayer::onInitialize()
 
   rolling_window_ = layered_costmap_->isRolling();
 
+  if (parallel_clearing) {
+    if (clearing_threads < 1) {
+      RCLCPP_WARN(logger_, "clearing_threads must be at least 1, using a single clearing thread");
+      clearing_threads = 1;
+    }
+    clearing_pool_ = std::make_unique<WorkerPool>(clearing_threads);
+    RCLCPP_INFO(logger_, "Parallel clearing enabled with %d threads", clearing_threads);
+  }
+
+  ray_culler_.configure(clearing_angular_resolution_, false);
+
+  if (occupancy_mode == "hit_count") {
+    if (hit_increment < 1 || hit_threshold < 1 || hit_max < hit_threshold || hit_max > 255) {
+      RCLCPP_WARN(
+        logger_,
+        "hit_increment and hit_threshold must be at least 1 and hit_max between hit_threshold "
+        "and 255, clamping them");
+    }
+    hit_counts_.configure(
+      static_cast<unsigned int>(std::max(hit_increment, 1)),
+      static_cast<unsigned int>(std::max(hit_threshold, 1)),
+      static_cast<unsigned int>(std::max(hit_max, 1)));
+    RCLCPP_INFO(
+      logger_, "Hit count occupancy enabled, occupied at %d hits, decaying every %.2f s",
+      hit_threshold, hit_decay_time_);
+  } else if (occupancy_mode != "binary") {
+    RCLCPP_WARN(
+      logger_, "Unknown occupancy_mode %s, using binary occupancy", occupancy_mode.c_str());
+  }
+
+  if (far_lod_factor < 1) {
+    RCLCPP_WARN(logger_, "far_lod_factor must be at least 1, marking at full resolution");
+    far_lod_factor = 1;
+  } else if (far_lod_factor > static_cast<int>(FarFieldLod::MAX_FACTOR)) {
+    RCLCPP_WARN(
+      logger_, "far_lod_factor must be at most %u, using %u", FarFieldLod::MAX_FACTOR,
+      FarFieldLod::MAX_FACTOR);
+    far_lod_factor = FarFieldLod::MAX_FACTOR;
+  }
+  far_lod_.configure(static_cast<unsigned int>(far_lod_factor), near_field_radius);
+  if (far_lod_.enabled()) {
+    RCLCPP_INFO(
+      logger_, "Far field marking and clearing at %d cells per coarse cell beyond %.2f m",
+      far_lod_factor, near_field_radius);
+  }
+
   if (track_unknown_space) {
     default_value_ = NO_INFORMATION;
   } else {
@@ -90,6 +326,8 @@ void IntensityObstacleLayer::onInitialize()
   IntensityObstacleLayer::matchSize();
   current_ = true;
   was_reset_ = false;
+  last_hit_decay_ = clock_->now();
+  last_clearing_ = clock_->now();
 
   global_frame_ = layered_costmap_->getGlobalFrameID();
 
@@ -98,13 +336,15 @@ void IntensityObstacleLayer::onInitialize()
 
   // now we need to split the topics based on whitespace which we can use a stringstream for
   std::stringstream ss(topics_string);
+  std::vector<std::string> source_names;
 
   std::string source;
   while (ss >> source) {
     // get the parameters for the specific topic
     double observation_keep_time, expected_update_rate, min_obstacle_height, max_obstacle_height;
     std::string topic, sensor_frame, data_type;
-    bool inf_is_valid, clearing, marking;
+    bool inf_is_valid, clearing, marking, intra_process;
+    int queue_depth;
 
     declareParameter(source + "." + "topic", rclcpp::ParameterValue(source));
     declareParameter(source + "." + "sensor_frame", rclcpp::ParameterValue(std::string("")));
@@ -120,6 +360,9 @@ void IntensityObstacleLayer::onInitialize()
     declareParameter(source + "." + "obstacle_min_range", rclcpp::ParameterValue(0.0));
     declareParameter(source + "." + "raytrace_max_range", rclcpp::ParameterValue(3.0));
     declareParameter(source + "." + "raytrace_min_range", rclcpp::ParameterValue(0.0));
+    declareParameter(source + "." + "queue_depth", rclcpp::ParameterValue(50));
+    declareParameter(source + "." + "intra_process", rclcpp::ParameterValue(false));
+    declareParameter(source + "." + "direct_scan_projection", rclcpp::ParameterValue(false));
 
     node->get_parameter(name_ + "." + source + "." + "topic", topic);
     node->get_parameter(name_ + "." + source + "." + "sensor_frame", sensor_frame);
@@ -132,6 +375,17 @@ void IntensityObstacleLayer::onInitialize()
     node->get_parameter(name_ + "." + source + "." + "inf_is_valid", inf_is_valid);
     node->get_parameter(name_ + "." + source + "." + "marking", marking);
     node->get_parameter(name_ + "." + source + "." + "clearing", clearing);
+    node->get_parameter(name_ + "." + source + "." + "queue_depth", queue_depth);
+    node->get_parameter(name_ + "." + source + "." + "intra_process", intra_process);
+    bool direct_scan_projection;
+    node->get_parameter(
+      name_ + "." + source + "." + "direct_scan_projection", direct_scan_projection);
+
+    if (queue_depth < 1) {
+      RCLCPP_WARN(
+        logger_, "queue_depth of source %s must be at least 1, using a depth of 1", source.c_str());
+      queue_depth = 1;
+    }
 
     if (!(data_type == "PointCloud2" || data_type == "LaserScan")) {
       RCLCPP_FATAL(
@@ -155,11 +409,25 @@ void IntensityObstacleLayer::onInitialize()
       topic.c_str(), sensor_frame.c_str());
 
     // create an observation buffer
-    observation_buffers_.push_back(std::make_shared<ObservationBuffer>(
+    observation_buffers_.push_back(std::make_shared<ObservationStore>(
       node, topic, observation_keep_time, expected_update_rate, min_obstacle_height,
       max_obstacle_height, obstacle_max_range, obstacle_min_range, raytrace_max_range,
       raytrace_min_range, *tf_, global_frame_, sensor_frame,
       tf2::durationFromSec(transform_tolerance)));
+    observation_buffers_.back()->setSource(static_cast<int>(source_names.size()));
+    observation_buffers_.back()->setRoles(marking, clearing);
+    source_names.push_back(source);
+
+    // scans projected on arrival and projected directly become different clouds
+    if (share_observations) {
+      const std::string kind = data_type == "PointCloud2" ? "cloud" :
+        std::string(direct_scan_projection ? "direct_scan" : "scan") +
+        (inf_is_valid ? "_inf" : "");
+      observation_buffers_.back()->setSharedCache(
+        SharedObservationCache::forKey(SharedObservationCache::makeKey(
+          kind, topic, global_frame_, sensor_frame, min_obstacle_height, max_obstacle_height,
+          obstacle_max_range, obstacle_min_range, raytrace_max_range, raytrace_min_range)));
+    }
 
     // check if we'll add this buffer to our marking observation buffers
     if (marking) {
@@ -179,20 +447,32 @@ void IntensityObstacleLayer::onInitialize()
       observation_keep_time);
 
     rmw_qos_profile_t custom_qos_profile = rmw_qos_profile_sensor_data;
-    custom_qos_profile.depth = 50;
+    custom_qos_profile.depth = queue_depth;
+
+    // with intra-process comms a publisher in the same process hands over its message without
+    // serializing or copying it, the sensor data profile is volatile as intra-process requires
+    auto source_sub_opt = sub_opt;
+    if (intra_process) {
+      source_sub_opt.use_intra_process_comm = rclcpp::IntraProcessSetting::Enable;
+    }
 
     // create a callback for the topic
     if (data_type == "LaserScan") {
       auto sub = std::make_shared<
         message_filters::Subscriber<sensor_msgs::msg::LaserScan, rclcpp_lifecycle::LifecycleNode>>(
-        node, topic, custom_qos_profile, sub_opt);
+        node, topic, custom_qos_profile, source_sub_opt);
       sub->unsubscribe();
 
       auto filter = std::make_shared<tf2_ros::MessageFilter<sensor_msgs::msg::LaserScan>>(
-        *sub, *tf_, global_frame_, 50, node->get_node_logging_interface(),
+        *sub, *tf_, global_frame_, queue_depth, node->get_node_logging_interface(),
         node->get_node_clock_interface(), tf2::durationFromSec(transform_tolerance));
 
-      if (inf_is_valid) {
+      if (direct_scan_projection) {
+        filter->registerCallback(std::bind(
+          &IntensityObstacleLayer::laserScanDirectCallback, this, std::placeholders::_1,
+          observation_buffers_.back(), std::make_shared<ScanProjector>(), inf_is_valid));
+
+      } else if (inf_is_valid) {
         filter->registerCallback(std::bind(
           &IntensityObstacleLayer::laserScanValidInfCallback, this, std::placeholders::_1,
           observation_buffers_.back()));
@@ -211,7 +491,7 @@ void IntensityObstacleLayer::onInitialize()
     } else {
       auto sub = std::make_shared<message_filters::Subscriber<
         sensor_msgs::msg::PointCloud2, rclcpp_lifecycle::LifecycleNode>>(
-        node, topic, custom_qos_profile, sub_opt);
+        node, topic, custom_qos_profile, source_sub_opt);
       sub->unsubscribe();
 
       if (inf_is_valid) {
@@ -220,9 +500,15 @@ void IntensityObstacleLayer::onInitialize()
           "intensity_obstacle_layer: inf_is_valid option is not applicable to PointCloud "
           "observations.");
       }
+      if (direct_scan_projection) {
+        RCLCPP_WARN(
+          logger_,
+          "intensity_obstacle_layer: direct_scan_projection option is not applicable to "
+          "PointCloud observations.");
+      }
 
       auto filter = std::make_shared<tf2_ros::MessageFilter<sensor_msgs::msg::PointCloud2>>(
-        *sub, *tf_, global_frame_, 50, node->get_node_logging_interface(),
+        *sub, *tf_, global_frame_, queue_depth, node->get_node_logging_interface(),
         node->get_node_clock_interface(), tf2::durationFromSec(transform_tolerance));
 
       filter->registerCallback(std::bind(
@@ -240,6 +526,55 @@ void IntensityObstacleLayer::onInitialize()
       observation_notifiers_.back()->setTargetFrames(target_frames);
     }
   }
+
+  stats_.configure(stats_enabled, std::max(stats_window, 1), source_names);
+  if (stats_enabled) {
+    stats_pub_ = node->create_publisher<diagnostic_msgs::msg::DiagnosticArray>(
+      name_ + "/stats", rclcpp::QoS(rclcpp::KeepLast(1)));
+    stats_pub_->on_activate();
+    stats_msg_.status.resize(1);
+    stats_msg_.status[0].name = name_;
+    if (stats_publish_rate > 0.0) {
+      stats_publish_period_ = rclcpp::Duration::from_seconds(1.0 / stats_publish_rate);
+    }
+    last_stats_publish_ = clock_->now();
+  }
+}
+
+void IntensityObstacleLayer::matchSize()
+{
+  CostmapLayer::matchSize();
+  marking_batch_.resize(size_x_, size_y_);
+  dirty_tiles_.resize(size_x_, size_y_);
+  far_lod_.resize(size_x_, size_y_, resolution_);
+  if (hit_counts_.enabled()) {
+    hit_counts_.resize(size_x_, size_y_);
+    observation_batch_.resize(size_x_, size_y_);
+    observation_hits_.clear();
+  }
+}
+
+void IntensityObstacleLayer::updateOrigin(double new_origin_x, double new_origin_y)
+{
+  // project the new origin into the grid
+  int cell_ox, cell_oy;
+  cell_ox = static_cast<int>((new_origin_x - origin_x_) / resolution_);
+  cell_oy = static_cast<int>((new_origin_y - origin_y_) / resolution_);
+
+  // nothing to move until the robot has crossed a whole cell
+  if (cell_ox == 0 && cell_oy == 0) {
+    return;
+  }
+
+  // scroll the overlap into its new location and reset only the strips that come into view,
+  // the same as copying it out, resetting the whole map and copying it back
+  shiftMapInPlace(costmap_, size_x_, size_y_, cell_ox, cell_oy, default_value_);
+  dirty_tiles_.shift(cell_ox, cell_oy);
+  hit_counts_.shift(cell_ox, cell_oy);
+
+  // update the origin with the appropriate world coordinates, keeping things grid-aligned
+  origin_x_ = origin_x_ + cell_ox * resolution_;
+  origin_y_ = origin_y_ + cell_oy * resolution_;
 }
 
 rcl_interfaces::msg::SetParametersResult IntensityObstacleLayer::dynamicParametersCallback(
@@ -255,8 +590,10 @@ rcl_interfaces::msg::SetParametersResult IntensityObstacleLayer::dynamicParamete
     if (param_type == ParameterType::PARAMETER_DOUBLE) {
       if (param_name == name_ + "." + "min_obstacle_intensity") {
         min_obstacle_intensity_ = parameter.as_double();
+        prepare_min_intensity_ = min_obstacle_intensity_;
       } else if (param_name == name_ + "." + "max_obstacle_intensity") {
         max_obstacle_intensity_ = parameter.as_double();
+        prepare_max_intensity_ = max_obstacle_intensity_;
       }
     } else if (param_type == ParameterType::PARAMETER_BOOL) {
       if (param_name == name_ + "." + "enabled" && enabled_ != parameter.as_bool()) {
@@ -280,20 +617,20 @@ rcl_interfaces::msg::SetParametersResult IntensityObstacleLayer::dynamicParamete
 
 void IntensityObstacleLayer::laserScanCallback(
   sensor_msgs::msg::LaserScan::ConstSharedPtr message,
-  const std::shared_ptr<nav2_costmap_2d::ObservationBuffer> & buffer)
+  const std::shared_ptr<ObservationStore> & buffer)
 {
   // project the laser into a point cloud
-  sensor_msgs::msg::PointCloud2 cloud;
-  cloud.header = message->header;
+  auto cloud = std::make_shared<sensor_msgs::msg::PointCloud2>();
+  cloud->header = message->header;
 
   // project the scan into a point cloud
   try {
-    projector_.transformLaserScanToPointCloud(message->header.frame_id, *message, cloud, *tf_);
+    projector_.transformLaserScanToPointCloud(message->header.frame_id, *message, *cloud, *tf_);
   } catch (tf2::TransformException & ex) {
     RCLCPP_WARN(
       logger_, "High fidelity enabled, but TF returned a transform exception to frame %s: %s",
       global_frame_.c_str(), ex.what());
-    projector_.projectLaser(*message, cloud);
+    projector_.projectLaser(*message, *cloud);
   } catch (std::runtime_error & ex) {
     RCLCPP_WARN(
       logger_,
@@ -304,14 +641,12 @@ void IntensityObstacleLayer::laserScanCallback(
   }
 
   // buffer the point cloud
-  buffer->lock();
-  buffer->bufferCloud(cloud);
-  buffer->unlock();
+  bufferObservation(cloud, buffer);
 }
 
 void IntensityObstacleLayer::laserScanValidInfCallback(
   sensor_msgs::msg::LaserScan::ConstSharedPtr raw_message,
-  const std::shared_ptr<nav2_costmap_2d::ObservationBuffer> & buffer)
+  const std::shared_ptr<ObservationStore> & buffer)
 {
   // Filter positive infinities ("Inf"s) to max_range.
   float epsilon = 0.0001;  // a tenth of a millimeter
@@ -324,17 +659,17 @@ void IntensityObstacleLayer::laserScanValidInfCallback(
   }
 
   // project the laser into a point cloud
-  sensor_msgs::msg::PointCloud2 cloud;
-  cloud.header = message.header;
+  auto cloud = std::make_shared<sensor_msgs::msg::PointCloud2>();
+  cloud->header = message.header;
 
   // project the scan into a point cloud
   try {
-    projector_.transformLaserScanToPointCloud(message.header.frame_id, message, cloud, *tf_);
+    projector_.transformLaserScanToPointCloud(message.header.frame_id, message, *cloud, *tf_);
   } catch (tf2::TransformException & ex) {
     RCLCPP_WARN(
       logger_, "High fidelity enabled, but TF returned a transform exception to frame %s: %s",
       global_frame_.c_str(), ex.what());
-    projector_.projectLaser(message, cloud);
+    projector_.projectLaser(message, *cloud);
   } catch (std::runtime_error & ex) {
     RCLCPP_WARN(
       logger_,
@@ -345,26 +680,134 @@ void IntensityObstacleLayer::laserScanValidInfCallback(
   }
 
   // buffer the point cloud
-  buffer->lock();
-  buffer->bufferCloud(cloud);
-  buffer->unlock();
+  bufferObservation(cloud, buffer);
 }
 
 void IntensityObstacleLayer::pointCloud2Callback(
   sensor_msgs::msg::PointCloud2::ConstSharedPtr message,
-  const std::shared_ptr<ObservationBuffer> & buffer)
+  const std::shared_ptr<ObservationStore> & buffer)
 {
-  // buffer the point cloud
+  // keep a reference to the point cloud, it is transformed where it is used
+  bufferObservation(message, buffer);
+}
+
+void IntensityObstacleLayer::laserScanDirectCallback(
+  sensor_msgs::msg::LaserScan::ConstSharedPtr message,
+  const std::shared_ptr<ObservationStore> & buffer,
+  const std::shared_ptr<ScanProjector> & projector, bool inf_is_valid)
+{
+  // the cloud only carries the header and the size of the scan for the store, the points are
+  // projected from the scan straight into the prepared cloud
+  auto cloud = std::make_shared<sensor_msgs::msg::PointCloud2>();
+  cloud->header = message->header;
+  cloud->height = 1;
+  cloud->width = static_cast<uint32_t>(message->ranges.size());
+
+  const double min_intensity = prepare_min_intensity_, max_intensity = prepare_max_intensity_;
+  auto build = [&](StoredObservation & built) {
+    if (!buffer->makeObservation(cloud, built)) {
+      return false;
+    }
+    built.prepared = prepareScan(
+      built, message, *projector, inf_is_valid, buffer->isMarking(), buffer->isClearing(),
+      min_intensity, max_intensity);
+    return true;
+  };
+
+  // the observation has no points but the prepared ones, so it is only shared once prepared
+  StoredObservation observation;
+  SharedObservationCache::Needs needs{
+    true, buffer->isMarking(), buffer->isClearing(), min_intensity, max_intensity};
+  if (!shareObservation(*cloud, buffer, needs, build, observation)) {
+    return;
+  }
+
+  buffer->lock();
+  buffer->addObservation(std::move(observation));
+  buffer->unlock();
+}
+
+void IntensityObstacleLayer::bufferObservation(
+  const sensor_msgs::msg::PointCloud2::ConstSharedPtr & cloud,
+  const std::shared_ptr<ObservationStore> & buffer)
+{
+  // the transform lookup and the preparation run before the store is locked, so updateBounds
+  // is never kept waiting on them
+  const double min_intensity = prepare_min_intensity_, max_intensity = prepare_max_intensity_;
+  auto build = [&](StoredObservation & built) {
+    if (!buffer->makeObservation(cloud, built)) {
+      return false;
+    }
+    if (async_preprocessing_) {
+      built.prepared = prepareObservation(
+        built, buffer->isMarking(), buffer->isClearing(), min_intensity, max_intensity);
+    }
+    return true;
+  };
+
+  StoredObservation observation;
+  SharedObservationCache::Needs needs{
+    async_preprocessing_, buffer->isMarking(), buffer->isClearing(), min_intensity,
+    max_intensity};
+  if (!shareObservation(*cloud, buffer, needs, build, observation)) {
+    return;
+  }
+
   buffer->lock();
-  buffer->bufferCloud(*message);
+  buffer->addObservation(std::move(observation));
   buffer->unlock();
 }
 
+std::shared_ptr<const PreparedCloud> IntensityObstacleLayer::prepareObservation(
+  const StoredObservation & observation, bool marking, bool clearing, double min_intensity,
+  double max_intensity) const
+{
+  const sensor_msgs::msg::PointCloud2 & cloud = *observation.cloud;
+  return preparePoints(
+    observation, marking, clearing, min_intensity, max_intensity,
+    [&](PointBlock & block, auto && visit) {
+      if (marking) {
+        forEachPointBlock(cloud, block, visit);
+      } else {
+        forEachXYZBlock(cloud, block, visit);
+      }
+    });
+}
+
+std::shared_ptr<const PreparedCloud> IntensityObstacleLayer::prepareScan(
+  const StoredObservation & observation, const sensor_msgs::msg::LaserScan::ConstSharedPtr & scan,
+  ScanProjector & projector, bool inf_is_valid, bool marking, bool clearing,
+  double min_intensity, double max_intensity) const
+{
+  auto prepared = preparePoints(
+    observation, marking, clearing, min_intensity, max_intensity,
+    [&](PointBlock & block, auto && visit) {
+      projector.forEachBlock(*scan, inf_is_valid, block, visit);
+    });
+  prepared->scan = scan;
+  prepared->scan_inf_is_valid = inf_is_valid;
+  return prepared;
+}
+
+const PreparedCloud * IntensityObstacleLayer::preparedMarking(
+  const StoredObservation & marking_observation) const
+{
+  const PreparedCloud * prepared = marking_observation.prepared.get();
+  if (
+    !prepared || !prepared->marking || prepared->min_intensity != min_obstacle_intensity_ ||
+    prepared->max_intensity != max_obstacle_intensity_)
+  {
+    return nullptr;
+  }
+  return prepared;
+}
+
 void IntensityObstacleLayer::updateBounds(
   double robot_x, double robot_y, double robot_yaw, double * min_x, double * min_y, double * max_x,
   double * max_y)
 {
   std::lock_guard<Costmap2D::mutex_t> guard(*getMutex());
+  recordStatsCycle();
   if (rolling_window_) {
     updateOrigin(robot_x - getSizeInMetersX() / 2, robot_y - getSizeInMetersY() / 2);
   }
@@ -374,70 +817,344 @@ void IntensityObstacleLayer::updateBounds(
   useExtraBounds(min_x, min_y, max_x, max_y);
 
   bool current = true;
-  std::vector<Observation> observations, clearing_observations;
+  {
+    LayerStats::StageTimer timer(stats_, LayerStats::FETCH);
+    marking_observations_.clear();
+    clearing_observations_.clear();
 
-  // get the marking observations
-  current = current && getMarkingObservations(observations);
+    // get the marking observations
+    current = current && getMarkingObservations(marking_observations_);
 
-  // get the clearing observations
-  current = current && getClearingObservations(clearing_observations);
+    // get the clearing observations
+    current = current && getClearingObservations(clearing_observations_);
+    selectObservations();
+  }
 
   // update the global current status
   current_ = current;
 
-  // raytrace freespace
-  for (const auto & clearing_observation : clearing_observations) {
-    raytraceFreespace(clearing_observation, min_x, min_y, max_x, max_y);
+  // counts that decayed below the threshold release their cells before this update marks
+  decayHits(min_x, min_y, max_x, max_y);
+
+  // raytrace freespace and collect the marks of the new obstacles
+  processObservations(min_x, min_y, max_x, max_y);
+
+  // write every marked cell once and widen the bounds by the batch's bounding box
+  {
+    LayerStats::StageTimer timer(stats_, LayerStats::MARKING);
+    // the hits are taken after every clearing pass of the update, so marks still win over clears
+    for (const unsigned int index : observation_hits_) {
+      if (hit_counts_.hit(index)) {
+        marking_batch_.add(index);
+      }
+    }
+    observation_hits_.clear();
+    far_lod_.expandInto(marking_batch_);
+    marking_batch_.flush([this](unsigned int index) {
+      if (costmap_[index] != LETHAL_OBSTACLE) {
+        costmap_[index] = LETHAL_OBSTACLE;
+        dirty_tiles_.mark(index);
+      }
+      return true;
+    });
+    touchBatchBounds(marking_batch_, min_x, min_y, max_x, max_y);
   }
 
-  // place the new obstacles into a priority queue... each with a priority of zero to begin with
-  for (const auto & obs : observations) {
-    const sensor_msgs::msg::PointCloud2 & cloud = *(obs.cloud_);
+  updateFootprint(robot_x, robot_y, robot_yaw, min_x, min_y, max_x, max_y);
+}
 
-    double sq_obstacle_max_range = obs.obstacle_max_range_ * obs.obstacle_max_range_;
-    double sq_obstacle_min_range = obs.obstacle_min_range_ * obs.obstacle_min_range_;
+void IntensityObstacleLayer::selectObservations()
+{
+  if (clearing_interval_ > 0.0) {
+    const rclcpp::Time now = clock_->now();
+    if ((now - last_clearing_).seconds() < clearing_interval_) {
+      clearing_observations_.clear();
+    } else {
+      last_clearing_ = now;
+    }
+  }
 
-    sensor_msgs::PointCloud2ConstIterator<float> iter_x(cloud, "x");
-    sensor_msgs::PointCloud2ConstIterator<float> iter_y(cloud, "y");
-    sensor_msgs::PointCloud2ConstIterator<float> iter_z(cloud, "z");
-    sensor_msgs::PointCloud2ConstIterator<float> iter_i(cloud, "intensity");
+  if (!hit_counts_.enabled()) {
+    return;
+  }
 
-    for (; iter_x != iter_x.end(); ++iter_x, ++iter_y, ++iter_z, ++iter_i) {
-      if (*iter_i < min_obstacle_intensity_ || *iter_i > max_obstacle_intensity_) {
-        continue;
-      }
+  // the hits of a cloud are counted by the first update that sees it, the later updates that
+  // still find it buffered skip it
+  counted_scratch_.clear();
+  for (const auto & observation : marking_observations_) {
+    counted_scratch_.push_back(observation.cloud);
+  }
+  marking_observations_.erase(
+    std::remove_if(
+      marking_observations_.begin(), marking_observations_.end(),
+      [this](const StoredObservation & observation) {
+        return std::find(counted_clouds_.begin(), counted_clouds_.end(), observation.cloud) !=
+               counted_clouds_.end();
+      }),
+    marking_observations_.end());
+  counted_clouds_.swap(counted_scratch_);
+}
 
-      // compute the squared distance from the hitpoint to the pointcloud's origin
-      double sq_dist = (*iter_x - obs.origin_.x) * (*iter_x - obs.origin_.x) +
-                       (*iter_y - obs.origin_.y) * (*iter_y - obs.origin_.y) +
-                       (*iter_z - obs.origin_.z) * (*iter_z - obs.origin_.z);
+void IntensityObstacleLayer::decayHits(
+  double * min_x, double * min_y, double * max_x, double * max_y)
+{
+  if (!hit_counts_.enabled() || hit_decay_time_ <= 0.0) {
+    return;
+  }
 
-      // if the point is far enough away... we won't consider it
-      if (sq_dist >= sq_obstacle_max_range) {
-        RCLCPP_DEBUG(logger_, "The point is too far away");
-        continue;
-      }
+  const rclcpp::Time now = clock_->now();
+  const double elapsed = (now - last_hit_decay_).seconds();
+  if (elapsed < 0.0) {
+    // the clock jumped back
+    last_hit_decay_ = now;
+    return;
+  }
+  if (elapsed < hit_decay_time_) {
+    return;
+  }
+  const double periods = std::floor(elapsed / hit_decay_time_);
+  last_hit_decay_ = last_hit_decay_ + rclcpp::Duration::from_seconds(periods * hit_decay_time_);
+  const unsigned int steps = static_cast<unsigned int>(std::min(periods, 255.0));
+
+  unsigned int min_mx = UINT32_MAX, min_my = UINT32_MAX, max_mx = 0, max_my = 0;
+  hit_counts_.decay(steps, [&](unsigned int index) {
+    if (costmap_[index] != LETHAL_OBSTACLE) {
+      return;
+    }
+    costmap_[index] = default_value_;
+    dirty_tiles_.mark(index);
+    unsigned int mx, my;
+    indexToCells(index, mx, my);
+    min_mx = std::min(min_mx, mx);
+    min_my = std::min(min_my, my);
+    max_mx = std::max(max_mx, mx);
+    max_my = std::max(max_my, my);
+  });
+  if (min_mx > max_mx) {
+    return;
+  }
 
-      // if the point is too close, do not conisder it
-      if (sq_dist < sq_obstacle_min_range) {
-        RCLCPP_DEBUG(logger_, "The point is too close");
-        continue;
-      }
+  double wx, wy;
+  mapToWorld(min_mx, min_my, wx, wy);
+  touch(wx, wy, min_x, min_y, max_x, max_y);
+  mapToWorld(max_mx, max_my, wx, wy);
+  touch(wx, wy, min_x, min_y, max_x, max_y);
+}
+
+void IntensityObstacleLayer::recordStatsCycle()
+{
+  if (!stats_.enabled()) {
+    return;
+  }
+  stats_.endCycle();
+
+  const rclcpp::Time now = clock_->now();
+  if (now - last_stats_publish_ < stats_publish_period_) {
+    return;
+  }
+  last_stats_publish_ = now;
+  stats_msg_.header.stamp = now;
+  stats_.fillStatus(stats_msg_.status[0]);
+  stats_pub_->publish(stats_msg_);
+}
 
-      // now we need to compute the map coordinates for the observation
-      unsigned int mx, my;
-      if (!worldToMap(*iter_x, *iter_y, mx, my)) {
-        RCLCPP_DEBUG(logger_, "Computing map coords failed");
+void IntensityObstacleLayer::processObservations(
+  double * min_x, double * min_y, double * max_x, double * max_y)
+{
+  // pair every clearing observation with the marking observation of the same cloud
+  fused_clearing_.assign(clearing_observations_.size(), -1);
+  fused_marking_.assign(marking_observations_.size(), false);
+  if (fused_mark_clear_) {
+    for (size_t i = 0; i < clearing_observations_.size(); ++i) {
+      // a prepared cloud was already decoded once for both
+      if (clearing_observations_[i].prepared) {
         continue;
       }
+      for (size_t j = 0; j < marking_observations_.size(); ++j) {
+        if (
+          !fused_marking_[j] &&
+          marking_observations_[j].cloud == clearing_observations_[i].cloud)
+        {
+          fused_clearing_[i] = static_cast<int>(j);
+          fused_marking_[j] = true;
+          break;
+        }
+      }
+    }
+  }
 
-      unsigned int index = getIndex(mx, my);
-      costmap_[index] = LETHAL_OBSTACLE;
-      touch(*iter_x, *iter_y, min_x, min_y, max_x, max_y);
+  // raytrace freespace
+  LayerStats::StageTimer clearing_timer(stats_, LayerStats::CLEARING);
+  for (size_t i = 0; i < clearing_observations_.size(); ++i) {
+    if (fused_clearing_[i] >= 0) {
+      markAndClear(
+        marking_observations_[fused_clearing_[i]], clearing_observations_[i], min_x, min_y, max_x,
+        max_y);
+    } else {
+      raytraceFreespace(clearing_observations_[i], min_x, min_y, max_x, max_y);
     }
+    collectObservationHits();
   }
+  clearing_timer.stop();
 
-  updateFootprint(robot_x, robot_y, robot_yaw, min_x, min_y, max_x, max_y);
+  // place the new obstacles into a priority queue... each with a priority of zero to begin with
+  LayerStats::StageTimer marking_timer(stats_, LayerStats::MARKING);
+  for (size_t j = 0; j < marking_observations_.size(); ++j) {
+    if (fused_marking_[j]) {
+      continue;
+    }
+    const StoredObservation & observation = marking_observations_[j];
+    if (const PreparedCloud * prepared = preparedMarking(observation)) {
+      markPrepared(observation, *prepared);
+    } else if (observation.prepared && observation.prepared->scan) {
+      // a direct scan filtered with an old intensity window has no cloud to fall back on
+      const PreparedCloud & stale = *observation.prepared;
+      auto prepared = prepareScan(
+        observation, stale.scan, scan_projector_, stale.scan_inf_is_valid, true, false,
+        min_obstacle_intensity_, max_obstacle_intensity_);
+      markPrepared(observation, *prepared);
+    } else {
+      markObservation(observation);
+    }
+    collectObservationHits();
+  }
+}
+
+void IntensityObstacleLayer::collectObservationHits()
+{
+  if (!hit_counts_.enabled()) {
+    return;
+  }
+  // a cell takes one hit per observation, however many of its points fall in it
+  far_lod_.expandInto(observation_batch_);
+  observation_batch_.flush([this](unsigned int index) {
+    observation_hits_.push_back(index);
+    return false;
+  });
+}
+
+void IntensityObstacleLayer::markPrepared(
+  const StoredObservation & marking_observation, const PreparedCloud & prepared)
+{
+  size_t points_accepted = 0;
+  for (const PointBlock & block : prepared.marking_blocks) {
+    points_accepted += markPreparedBlock(marking_observation, block);
+  }
+  stats_.addPoints(marking_observation.source, prepared.points_in, points_accepted);
+}
+
+void IntensityObstacleLayer::markObservation(const StoredObservation & marking_observation)
+{
+  const PointFilterParams params = makeMarkingParams(marking_observation);
+  const MapGeometry map{origin_x_, origin_y_, resolution_, size_x_, size_y_};
+
+  size_t points_in = 0, points_accepted = 0;
+  forEachPointBlock(*(marking_observation.cloud), marking_scratch_.block, [&](PointBlock & block) {
+    transformPointBlock(block, marking_observation.transform);
+    points_in += block.size;
+    points_accepted += markBlock(block, params, map);
+  });
+  stats_.addPoints(marking_observation.source, points_in, points_accepted);
+}
+
+void IntensityObstacleLayer::markAndClear(
+  const StoredObservation & marking_observation, const StoredObservation & clearing_observation,
+  double * min_x, double * min_y, double * max_x, double * max_y)
+{
+  ClearingPass pass;
+  const bool clearing = beginClearing(clearing_observation, pass, min_x, min_y, max_x, max_y);
+  const PointFilterParams params = makeMarkingParams(marking_observation);
+  const MapGeometry map{origin_x_, origin_y_, resolution_, size_x_, size_y_};
+
+  // every block feeds the clearer and the marker, the marks are only written once all
+  // observations have been traced, so the result is the same as clearing before marking
+  size_t points_in = 0, points_accepted = 0;
+  forEachPointBlock(*(marking_observation.cloud), marking_scratch_.block, [&](PointBlock & block) {
+    transformPointBlock(block, marking_observation.transform);
+    if (clearing) {
+      addClearingBlock(pass, block);
+    }
+    points_in += block.size;
+    points_accepted += markBlock(block, params, map);
+  });
+  stats_.addPoints(marking_observation.source, points_in, points_accepted);
+
+  if (clearing) {
+    endClearing(pass, min_x, min_y, max_x, max_y);
+  }
+}
+
+PointFilterParams IntensityObstacleLayer::makeMarkingParams(
+  const StoredObservation & marking_observation) const
+{
+  const StoredObservation & obs = marking_observation;
+  return makePointFilterParams(
+    obs.min_obstacle_height, obs.max_obstacle_height, min_obstacle_intensity_,
+    max_obstacle_intensity_, obs.origin.x, obs.origin.y, obs.origin.z, obs.obstacle_min_range,
+    obs.obstacle_max_range);
+}
+
+size_t IntensityObstacleLayer::markBlock(
+  const PointBlock & block, const PointFilterParams & params, const MapGeometry & map)
+{
+  // drop points outside of the height window, the intensity window and the obstacle range in
+  // one batch
+  size_t num_survivors = filterPointBlock(block, params, marking_scratch_.survivors);
+  addMarks(block, num_survivors, map, params.origin_x, params.origin_y);
+  return num_survivors;
+}
+
+size_t IntensityObstacleLayer::markPreparedBlock(
+  const StoredObservation & marking_observation, const PointBlock & block)
+{
+  // the points were filtered as they arrived, only the map can have moved since
+  const MapGeometry map{origin_x_, origin_y_, resolution_, size_x_, size_y_};
+  size_t num_points = selectAllPoints(block, marking_scratch_.survivors);
+  addMarks(
+    block, num_points, map, static_cast<float>(marking_observation.origin.x),
+    static_cast<float>(marking_observation.origin.y));
+  return num_points;
+}
+
+void IntensityObstacleLayer::addMarks(
+  const PointBlock & block, size_t num_survivors, const MapGeometry & map, float origin_x,
+  float origin_y)
+{
+  uint32_t * survivors = marking_scratch_.survivors;
+  unsigned int * cells = marking_scratch_.cells;
+  const size_t num_near = far_lod_.enabled() ?
+    far_lod_.partitionNear(block, survivors, num_survivors, origin_x, origin_y) :
+    num_survivors;
+
+  // in the hit_count mode the cells are deduplicated per observation, as every observation
+  // counts once
+  CellBatch & batch = hit_counts_.enabled() ? observation_batch_ : marking_batch_;
+  size_t num_cells = projectToCells(block, survivors, num_near, map, cells);
+  for (size_t k = 0; k < num_cells; ++k) {
+    batch.add(cells[k]);
+  }
+
+  // far cells are collected per coarse cell and handed to the batch before it is flushed
+  num_cells = projectToCells(block, survivors + num_near, num_survivors - num_near, map, cells);
+  for (size_t k = 0; k < num_cells; ++k) {
+    far_lod_.addFar(cells[k]);
+  }
+}
+
+void IntensityObstacleLayer::touchBatchBounds(
+  const CellBatch & batch, double * min_x, double * min_y, double * max_x, double * max_y)
+{
+  unsigned int min_mx, min_my, max_mx, max_my;
+  if (!batch.getBounds(min_mx, min_my, max_mx, max_my)) {
+    return;
+  }
+
+  // cell centers fall in the same cells as the marked points, so the bounds are unchanged
+  double wx, wy;
+  mapToWorld(min_mx, min_my, wx, wy);
+  touch(wx, wy, min_x, min_y, max_x, max_y);
+  mapToWorld(max_mx, max_my, wx, wy);
+  touch(wx, wy, min_x, min_y, max_x, max_y);
 }
 
 void IntensityObstacleLayer::updateFootprint(
@@ -447,6 +1164,7 @@ void IntensityObstacleLayer::updateFootprint(
   if (!footprint_clearing_enabled_) {
     return;
   }
+  LayerStats::StageTimer timer(stats_, LayerStats::FOOTPRINT);
   nav2_costmap_2d::transformFootprint(
     robot_x, robot_y, robot_yaw, getFootprint(), transformed_footprint_);
 
@@ -455,6 +1173,38 @@ void IntensityObstacleLayer::updateFootprint(
   }
 }
 
+void IntensityObstacleLayer::clearFootprint()
+{
+  // like setConvexPolygonCost, nothing is cleared once a vertex is off the map
+  footprint_polygon_scratch_.clear();
+  for (const auto & point : transformed_footprint_) {
+    nav2_costmap_2d::MapLocation loc;
+    if (!worldToMap(point.x, point.y, loc.x, loc.y)) {
+      return;
+    }
+    footprint_polygon_scratch_.push_back(loc);
+  }
+
+  // the fill only depends on the cells of the vertices, which stay the same while the robot
+  // stands still or moves by less than a cell
+  const bool same_polygon = std::equal(
+    footprint_polygon_scratch_.begin(), footprint_polygon_scratch_.end(),
+    footprint_polygon_.begin(), footprint_polygon_.end(),
+    [](const nav2_costmap_2d::MapLocation & a, const nav2_costmap_2d::MapLocation & b) {
+      return a.x == b.x && a.y == b.y;
+    });
+  if (!same_polygon) {
+    footprint_polygon_.swap(footprint_polygon_scratch_);
+    footprint_cells_.clear();
+    convexFillCells(footprint_polygon_, footprint_cells_);
+  }
+
+  ClearCell clear_cell(costmap_, dirty_tiles_, hit_counts_.data());
+  for (const auto & cell : footprint_cells_) {
+    clear_cell(getIndex(cell.x, cell.y));
+  }
+}
+
 void IntensityObstacleLayer::updateCosts(
   nav2_costmap_2d::Costmap2D & master_grid, int min_i, int min_j, int max_i, int max_j)
 {
@@ -470,29 +1220,46 @@ void IntensityObstacleLayer::updateCosts(
   }
 
   if (footprint_clearing_enabled_) {
-    setConvexPolygonCost(transformed_footprint_, nav2_costmap_2d::FREE_SPACE);
+    LayerStats::StageTimer timer(stats_, LayerStats::FOOTPRINT);
+    clearFootprint();
   }
 
+  LayerStats::StageTimer timer(stats_, LayerStats::UPDATE_COSTS);
+  // only the tiles that hold a cell which changes the master are merged, free cells change it
+  // wherever it may hold unknown cells
+  unsigned char * master = master_grid.getCharMap();
   switch (combination_method_) {
     case 0:  // Overwrite
-      updateWithOverwrite(master_grid, min_i, min_j, max_i, max_j);
+      dirty_tiles_.refresh(costmap_, true);
+      dirty_tiles_.updateWithOverwrite(costmap_, master, min_i, min_j, max_i, max_j);
       break;
     case 1:  // Maximum
-      updateWithMax(master_grid, min_i, min_j, max_i, max_j);
+      dirty_tiles_.refresh(costmap_, masterMayHoldUnknown());
+      dirty_tiles_.updateWithMax(costmap_, master, min_i, min_j, max_i, max_j);
       break;
     default:  // Nothing
       break;
   }
 }
 
+bool IntensityObstacleLayer::masterMayHoldUnknown() const
+{
+  if (layered_costmap_->isTrackingUnknown()) {
+    return true;
+  }
+  const std::vector<std::shared_ptr<nav2_costmap_2d::Layer>> & plugins =
+    *layered_costmap_->getPlugins();
+  return plugins.empty() || plugins.front().get() != this;
+}
+
 void IntensityObstacleLayer::addStaticObservation(
   nav2_costmap_2d::Observation & obs, bool marking, bool clearing)
 {
   if (marking) {
-    static_marking_observations_.push_back(obs);
+    static_marking_observations_.push_back(StoredObservation::fromObservation(obs));
   }
   if (clearing) {
-    static_clearing_observations_.push_back(obs);
+    static_clearing_observations_.push_back(StoredObservation::fromObservation(obs));
   }
 }
 
@@ -507,7 +1274,7 @@ void IntensityObstacleLayer::clearStaticObservations(bool marking, bool clearing
 }
 
 bool IntensityObstacleLayer::getMarkingObservations(
-  std::vector<Observation> & marking_observations) const
+  std::vector<StoredObservation> & marking_observations) const
 {
   bool current = true;
   // get the marking observations
@@ -524,7 +1291,7 @@ bool IntensityObstacleLayer::getMarkingObservations(
 }
 
 bool IntensityObstacleLayer::getClearingObservations(
-  std::vector<Observation> & clearing_observations) const
+  std::vector<StoredObservation> & clearing_observations) const
 {
   bool current = true;
   // get the clearing observations
@@ -541,12 +1308,37 @@ bool IntensityObstacleLayer::getClearingObservations(
 }
 
 void IntensityObstacleLayer::raytraceFreespace(
-  const Observation & clearing_observation, double * min_x, double * min_y, double * max_x,
+  const StoredObservation & clearing_observation, double * min_x, double * min_y, double * max_x,
   double * max_y)
 {
-  double ox = clearing_observation.origin_.x;
-  double oy = clearing_observation.origin_.y;
-  const sensor_msgs::msg::PointCloud2 & cloud = *(clearing_observation.cloud_);
+  ClearingPass pass;
+  if (!beginClearing(clearing_observation, pass, min_x, min_y, max_x, max_y)) {
+    return;
+  }
+
+  // for each point in the cloud, we want to trace a line from the origin
+  // and clear obstacles along it
+  const PreparedCloud * prepared = clearing_observation.prepared.get();
+  if (prepared && prepared->clearing) {
+    for (const PointBlock & block : prepared->clearing_blocks) {
+      addClearingBlock(pass, block);
+    }
+  } else {
+    forEachXYZBlock(*(clearing_observation.cloud), marking_scratch_.block, [&](PointBlock & block) {
+      transformPointBlock(block, clearing_observation.transform);
+      addClearingBlock(pass, block);
+    });
+  }
+
+  endClearing(pass, min_x, min_y, max_x, max_y);
+}
+
+bool IntensityObstacleLayer::beginClearing(
+  const StoredObservation & clearing_observation, ClearingPass & pass, double * min_x,
+  double * min_y, double * max_x, double * max_y)
+{
+  double ox = clearing_observation.origin.x;
+  double oy = clearing_observation.origin.y;
 
   // get the map coordinates of the origin of the sensor
   unsigned int x0, y0;
@@ -556,24 +1348,44 @@ void IntensityObstacleLayer::raytraceFreespace(
       "Sensor origin at (%.2f, %.2f) is out of map bounds (%.2f, %.2f) to (%.2f, %.2f). "
       "The costmap cannot raytrace for it.",
       ox, oy, origin_x_, origin_y_, origin_x_ + getSizeInMetersX(), origin_y_ + getSizeInMetersY());
-    return;
+    return false;
   }
 
+  touch(ox, oy, min_x, min_y, max_x, max_y);
+
+  pass.observation = &clearing_observation;
+  pass.ox = ox;
+  pass.oy = oy;
+  pass.oz = clearing_observation.origin.z;
+  pass.x0 = x0;
+  pass.y0 = y0;
+  pass.batch = RaytraceBatch(
+    ox, oy, clearing_observation.raytrace_max_range, clearing_observation.raytrace_min_range,
+    cellDistance(clearing_observation.raytrace_max_range),
+    cellDistance(clearing_observation.raytrace_min_range));
+
+  // the line endpoints are collected first, then culled and traced serially or by the worker pool
+  clearing_rays_.clear();
+  return true;
+}
+
+void IntensityObstacleLayer::addClearingBlock(ClearingPass & pass, const PointBlock & block)
+{
+  const StoredObservation & clearing_observation = *pass.observation;
+  const double ox = pass.ox, oy = pass.oy;
+
   // we can pre-compute the endpoints of the map outside of the inner loop... we'll need these later
   double origin_x = origin_x_, origin_y = origin_y_;
   double map_end_x = origin_x + size_x_ * resolution_;
   double map_end_y = origin_y + size_y_ * resolution_;
 
-  touch(ox, oy, min_x, min_y, max_x, max_y);
-
-  // for each point in the cloud, we want to trace a line from the origin
-  // and clear obstacles along it
-  sensor_msgs::PointCloud2ConstIterator<float> iter_x(cloud, "x");
-  sensor_msgs::PointCloud2ConstIterator<float> iter_y(cloud, "y");
-
-  for (; iter_x != iter_x.end(); ++iter_x, ++iter_y) {
-    double wx = *iter_x;
-    double wy = *iter_y;
+  for (size_t i = 0; i < block.size; ++i) {
+    // apply the height window of the source
+    if (!clearing_observation.inHeightWindow(block.z[i])) {
+      continue;
+    }
+    double wx = block.x[i];
+    double wy = block.y[i];
 
     // now we also need to make sure that the endpoint we're raytracing
     // to isn't off the costmap and scale if necessary
@@ -612,16 +1424,116 @@ void IntensityObstacleLayer::raytraceFreespace(
       continue;
     }
 
-    unsigned int cell_raytrace_max_range = cellDistance(clearing_observation.raytrace_max_range_);
-    unsigned int cell_raytrace_min_range = cellDistance(clearing_observation.raytrace_min_range_);
-    MarkCell marker(costmap_, FREE_SPACE);
-    // and finally... we can execute our trace to clear obstacles along that line
-    raytraceLine(marker, x0, y0, x1, y1, cell_raytrace_max_range, cell_raytrace_min_range);
+    if (ray_culler_.enabled()) {
+      ray_culler_.add(clearing_rays_.size(), wx - ox, wy - oy, 0.0);
+    }
+    clearing_rays_.push_back({x1, y1, wx, wy});
+  }
+}
+
+void IntensityObstacleLayer::endClearing(
+  ClearingPass & pass, double * min_x, double * min_y, double * max_x, double * max_y)
+{
+  RaytraceBatch & batch = pass.batch;
+
+  // only the farthest ray of each angular bin is traced
+  if (ray_culler_.enabled()) {
+    ray_culler_.cull(clearing_rays_);
+  }
+  // and only the farthest far ray of each coarse endpoint cell
+  far_lod_.cullFarRays(clearing_rays_, pass.x0, pass.y0);
+  stats_.addRays(clearing_rays_.size());
+
+  const bool parallel = clearing_pool_ != nullptr;
+  ClearCell marker(costmap_, dirty_tiles_, hit_counts_.data());
+  for (const ClearingRay & ray : clearing_rays_) {
+    if (!parallel) {
+      // and finally... we can execute our trace to clear obstacles along that line
+      raytraceLine(
+        marker, pass.x0, pass.y0, ray.x1, ray.y1, batch.cellMaxRange(), batch.cellMinRange());
+    }
+    batch.addEndpoint(ray.wx, ray.wy);
+  }
 
-    updateRaytraceBounds(
-      ox, oy, wx, wy, clearing_observation.raytrace_max_range_,
-      clearing_observation.raytrace_min_range_, min_x, min_y, max_x, max_y);
+  if (parallel) {
+    raytraceInParallel(pass.x0, pass.y0, batch.cellMaxRange(), batch.cellMinRange());
   }
+
+  batch.touchBounds(min_x, min_y, max_x, max_y);
+}
+
+void IntensityObstacleLayer::raytraceInParallel(
+  unsigned int x0, unsigned int y0, unsigned int max_length, unsigned int min_length)
+{
+  if (clearing_rays_.empty()) {
+    return;
+  }
+
+  // every traced cell lies within the rows spanned by the origin and the endpoints, so each
+  // worker records its cells in a bitmask over that band of rows
+  unsigned int min_row = y0, max_row = y0;
+  for (const auto & ray : clearing_rays_) {
+    min_row = std::min(min_row, ray.y1);
+    max_row = std::max(max_row, ray.y1);
+  }
+  const unsigned int base = min_row * size_x_;
+  const size_t num_words = ((max_row - min_row + 1) * static_cast<size_t>(size_x_) + 63) / 64;
+
+  // the masks are left zeroed by the merge, so they only need to grow here
+  clearing_masks_.resize(clearing_pool_->size());
+  for (auto & mask : clearing_masks_) {
+    if (mask.size() < num_words) {
+      mask.resize(num_words, 0);
+    }
+  }
+
+  const size_t num_rays = clearing_rays_.size();
+  const size_t num_tasks = std::min(num_rays, clearing_pool_->size() * 4);
+  const size_t rays_per_task = (num_rays + num_tasks - 1) / num_tasks;
+  std::atomic<int64_t> busy_ns{0};
+
+  const auto start = std::chrono::steady_clock::now();
+  clearing_pool_->run(num_tasks, [&](size_t task, size_t worker) {
+    const auto task_start = std::chrono::steady_clock::now();
+    MarkCellBit marker(clearing_masks_[worker].data(), base);
+    const size_t end = std::min(num_rays, (task + 1) * rays_per_task);
+    for (size_t i = task * rays_per_task; i < end; ++i) {
+      const ClearingRay & ray = clearing_rays_[i];
+      raytraceLine(marker, x0, y0, ray.x1, ray.y1, max_length, min_length);
+    }
+    busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now() - task_start)
+                 .count();
+  });
+
+  // every ray only ever writes FREE_SPACE, so the union of the traced cells is exactly what the
+  // serial path would have cleared, whatever order the workers ran in
+  ClearCell clear_cell(costmap_, dirty_tiles_, hit_counts_.data());
+  for (size_t word = 0; word < num_words; ++word) {
+    uint64_t bits = 0;
+    for (auto & mask : clearing_masks_) {
+      bits |= mask[word];
+      mask[word] = 0;
+    }
+    while (bits) {
+      clear_cell(base + word * 64 + __builtin_ctzll(bits));
+      bits &= bits - 1;
+    }
+  }
+
+  reportClearingSpeedup(num_rays, start, busy_ns.load());
+}
+
+void IntensityObstacleLayer::reportClearingSpeedup(
+  size_t num_rays, std::chrono::steady_clock::time_point start, int64_t busy_ns)
+{
+  const double wall_ms =
+    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  const double busy_ms = busy_ns * 1e-6;
+  clearing_speedup_ = wall_ms > 0.0 ? busy_ms / wall_ms : 1.0;
+  RCLCPP_DEBUG(
+    logger_, "Parallel clearing traced %zu rays in %.3f ms on %zu threads (%.2fx speedup)",
+    num_rays, wall_ms, clearing_pool_->size(), clearing_speedup_);
 }
 
 void IntensityObstacleLayer::activate()
@@ -648,23 +1560,13 @@ void IntensityObstacleLayer::deactivate()
   }
 }
 
-void IntensityObstacleLayer::updateRaytraceBounds(
-  double ox, double oy, double wx, double wy, double max_range, double min_range, double * min_x,
-  double * min_y, double * max_x, double * max_y)
-{
-  double dx = wx - ox, dy = wy - oy;
-  double full_distance = hypot(dx, dy);
-  if (full_distance < min_range) {
-    return;
-  }
-  double scale = std::min(1.0, max_range / full_distance);
-  double ex = ox + dx * scale, ey = oy + dy * scale;
-  touch(ex, ey, min_x, min_y, max_x, max_y);
-}
-
 void IntensityObstacleLayer::reset()
 {
   resetMaps();
+  dirty_tiles_.markAll();
+  hit_counts_.reset();
+  observation_hits_.clear();
+  counted_clouds_.clear();
   resetBuffersLastUpdated();
   current_ = false;
   was_reset_ = true;
@@ -16,11 +16,19 @@
 #include "pb_nav2_plugins/layers/intensity_voxel_layer.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <bitset>
 #include <cassert>
+#include <chrono>
+#include <limits>
 #include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
+#include "pb_nav2_plugins/layers/marking_kernel.hpp"
+#include "pb_nav2_plugins/layers/rolling_shift.hpp"
+#include "pb_nav2_plugins/layers/voxel_snapshot.hpp"
 #include "pluginlib/class_list_macros.hpp"
 #include "sensor_msgs/point_cloud2_iterator.hpp"
 
@@ -35,6 +43,25 @@ using rcl_interfaces::msg::ParameterType;
 namespace pb_nav2_costmap_2d
 {
 
+namespace
+{
+
+/**
+ * @brief raytraceLine action that accumulates the cleared voxel bits of each column in a mask
+ */
+class ClearVoxelBits
+{
+public:
+  ClearVoxelBits(uint32_t * mask, unsigned int base) : mask_(mask), base_(base) {}
+  inline void operator()(unsigned int offset, uint32_t z_mask) { mask_[offset - base_] |= z_mask; }
+
+private:
+  uint32_t * mask_;
+  unsigned int base_;
+};
+
+}  // namespace
+
 void IntensityVoxelLayer::onInitialize()
 {
   IntensityObstacleLayer::onInitialize();
@@ -45,6 +72,11 @@ void IntensityVoxelLayer::onInitialize()
   declareParameter("unknown_threshold", rclcpp::ParameterValue(15));
   declareParameter("mark_threshold", rclcpp::ParameterValue(0));
   declareParameter("publish_voxel_map", rclcpp::ParameterValue(false));
+  declareParameter("publish_clearing_endpoints", rclcpp::ParameterValue(false));
+  declareParameter("voxel_map_publish_rate", rclcpp::ParameterValue(0.0));
+  declareParameter("voxel_map_keyframe_interval", rclcpp::ParameterValue(0));
+  declareParameter("voxel_storage", rclcpp::ParameterValue(std::string("dense")));
+  declareParameter("snapshot_file", rclcpp::ParameterValue(std::string("")));
 
   auto node = node_.lock();
   if (!node) {
@@ -57,21 +89,90 @@ void IntensityVoxelLayer::onInitialize()
   node->get_parameter(name_ + "." + "unknown_threshold", unknown_threshold_);
   node->get_parameter(name_ + "." + "mark_threshold", mark_threshold_);
   node->get_parameter(name_ + "." + "publish_voxel_map", publish_voxel_);
+  bool publish_clearing_endpoints;
+  node->get_parameter(name_ + "." + "publish_clearing_endpoints", publish_clearing_endpoints);
+  double voxel_map_publish_rate;
+  node->get_parameter(name_ + "." + "voxel_map_publish_rate", voxel_map_publish_rate);
+  node->get_parameter(name_ + "." + "voxel_map_keyframe_interval", voxel_keyframe_interval_);
+  if (voxel_map_publish_rate > 0.0) {
+    voxel_publish_period_ = rclcpp::Duration::from_seconds(1.0 / voxel_map_publish_rate);
+  }
+  std::string voxel_storage;
+  node->get_parameter(name_ + "." + "voxel_storage", voxel_storage);
+  node->get_parameter(name_ + "." + "snapshot_file", snapshot_file_);
+
+  if (voxel_storage == "tiled") {
+    tiled_voxel_grid_ = std::make_unique<TiledVoxelGrid>();
+  } else if (voxel_storage == "cuda") {
+    std::string error;
+    gpu_voxel_grid_ = VoxelGpuBackend::create(error);
+    if (!gpu_voxel_grid_) {
+      RCLCPP_WARN(
+        logger_, "The cuda voxel storage is not available (%s), using the dense voxel storage",
+        error.c_str());
+    }
+  } else if (voxel_storage != "dense") {
+    throw std::runtime_error{"Unknown voxel_storage \"" + voxel_storage + "\""};
+  }
+  const int max_levels = maxVoxelLevels();
+  if (size_z_ > max_levels) {
+    RCLCPP_WARN(
+      logger_, "z_voxels %d exceeds the %d levels of the %s voxel storage, using %d", size_z_,
+      max_levels, voxel_storage.c_str(), max_levels);
+    size_z_ = max_levels;
+  }
+  if (tiled_voxel_grid_ && publish_voxel_ && size_z_ > VOXEL_BITS) {
+    RCLCPP_WARN(
+      logger_, "The voxel_grid message holds at most %d levels, the voxel map is not published",
+      VOXEL_BITS);
+    publish_voxel_ = false;
+  }
+  if (tiled_voxel_grid_ && clearing_pool_) {
+    RCLCPP_WARN(logger_, "Parallel clearing is not supported by the tiled voxel storage");
+    clearing_pool_.reset();
+  }
+  if (gpu_voxel_grid_ && clearing_pool_) {
+    RCLCPP_INFO(logger_, "Clearing runs on the device, the clearing threads are not used");
+    clearing_pool_.reset();
+  }
+  if (hit_counts_.enabled()) {
+    RCLCPP_WARN(
+      logger_,
+      "The hit_count occupancy mode is not supported by the voxel layer, mark_threshold already "
+      "counts the marked voxels of a column, using binary occupancy");
+    hit_counts_.disable();
+  }
+  if (far_lod_.enabled()) {
+    RCLCPP_WARN(
+      logger_, "far_lod_factor is not supported by the voxel layer, marking at full resolution");
+    far_lod_.disable();
+  }
 
   auto custom_qos = rclcpp::QoS(rclcpp::KeepLast(1)).transient_local().reliable();
 
   if (publish_voxel_) {
     voxel_pub_ = node->create_publisher<nav2_msgs::msg::VoxelGrid>("voxel_grid", custom_qos);
     voxel_pub_->on_activate();
+    if (voxel_keyframe_interval_ > 0) {
+      voxel_updates_pub_ =
+        node->create_publisher<nav2_msgs::msg::VoxelGrid>("voxel_grid_updates", custom_qos);
+      voxel_updates_pub_->on_activate();
+    }
+    last_voxel_publish_ = clock_->now();
   }
 
-  clearing_endpoints_pub_ =
-    node->create_publisher<sensor_msgs::msg::PointCloud2>("clearing_endpoints", custom_qos);
-  clearing_endpoints_pub_->on_activate();
+  if (publish_clearing_endpoints) {
+    clearing_endpoints_pub_ =
+      node->create_publisher<sensor_msgs::msg::PointCloud2>("clearing_endpoints", custom_qos);
+    clearing_endpoints_pub_->on_activate();
+  }
 
-  unknown_threshold_ += (VOXEL_BITS - size_z_);
+  unknown_threshold_ += unusedVoxelBits();
   matchSize();
 
+  // clearing rays also fan out vertically, so bin them by elevation as well
+  ray_culler_.configure(clearing_angular_resolution_, true);
+
   // Add callback for dynamic parameters
   dyn_params_handler_ = node->add_on_set_parameters_callback(
     std::bind(&IntensityVoxelLayer::dynamicParametersCallback, this, std::placeholders::_1));
@@ -79,10 +180,33 @@ void IntensityVoxelLayer::onInitialize()
 
 IntensityVoxelLayer::~IntensityVoxelLayer() { dyn_params_handler_.reset(); }
 
+int IntensityVoxelLayer::maxVoxelLevels() const
+{
+  return tiled_voxel_grid_ ? static_cast<int>(TiledVoxelGrid::MAX_LEVELS) : VOXEL_BITS;
+}
+
+int IntensityVoxelLayer::unusedVoxelBits() const
+{
+  // the unknown threshold counts the levels above z_voxels of a 16 bit column, the tiled
+  // storage keeps that offset so both storages clear alike
+  return std::max(0, VOXEL_BITS - size_z_);
+}
+
 void IntensityVoxelLayer::matchSize()
 {
   std::lock_guard<Costmap2D::mutex_t> guard(*getMutex());
   IntensityObstacleLayer::matchSize();
+  if (tiled_voxel_grid_) {
+    // the dense grid is not used, so it does not hold any memory
+    tiled_voxel_grid_->resize(size_x_, size_y_, size_z_);
+    voxel_grid_.resize(0, 0, 0);
+    return;
+  }
+  if (gpu_voxel_grid_) {
+    gpu_voxel_grid_->resize(size_x_, size_y_, size_z_);
+    voxel_grid_.resize(0, 0, 0);
+    return;
+  }
   voxel_grid_.resize(size_x_, size_y_, size_z_);
   assert(voxel_grid_.sizeX() == size_x_ && voxel_grid_.sizeY() == size_y_);
 }
@@ -101,7 +225,182 @@ void IntensityVoxelLayer::resetMaps()
   // resetMaps so this goes to the next layer down Costmap2DLayer which also
   // doesn't implement this, so it actually goes all the way to Costmap2D
   IntensityObstacleLayer::resetMaps();
-  voxel_grid_.reset();
+  dirty_tiles_.markAll();
+  voxel_keyframe_needed_ = true;
+  if (tiled_voxel_grid_) {
+    tiled_voxel_grid_->reset();
+  } else if (gpu_voxel_grid_) {
+    gpu_voxel_grid_->reset();
+  } else {
+    voxel_grid_.reset();
+  }
+}
+
+void IntensityVoxelLayer::activate()
+{
+  IntensityObstacleLayer::activate();
+  if (!snapshot_file_.empty()) {
+    loadSnapshot();
+  }
+}
+
+void IntensityVoxelLayer::deactivate()
+{
+  IntensityObstacleLayer::deactivate();
+  if (!snapshot_file_.empty()) {
+    saveSnapshot();
+  }
+}
+
+void IntensityVoxelLayer::readColumns(uint32_t * data)
+{
+  if (tiled_voxel_grid_) {
+    tiled_voxel_grid_->toVoxelGridData(data);
+  } else if (gpu_voxel_grid_) {
+    gpu_voxel_grid_->download(data, 0, 0, size_x_, size_y_);
+  } else {
+    memcpy(data, voxel_grid_.getData(), size_x_ * size_y_ * sizeof(uint32_t));
+  }
+}
+
+void IntensityVoxelLayer::writeColumns(const uint32_t * data)
+{
+  if (tiled_voxel_grid_) {
+    tiled_voxel_grid_->fromVoxelGridData(data);
+  } else if (gpu_voxel_grid_) {
+    gpu_voxel_grid_->upload(data);
+  } else {
+    memcpy(voxel_grid_.getData(), data, size_x_ * size_y_ * sizeof(uint32_t));
+  }
+}
+
+void IntensityVoxelLayer::remapLevels(double old_origin_z, double old_z_resolution, int old_size_z)
+{
+  const VerticalRemap remap(
+    old_origin_z, old_z_resolution, static_cast<unsigned int>(std::max(old_size_z, 0)),
+    origin_z_, z_resolution_, static_cast<unsigned int>(std::max(size_z_, 0)));
+  if (remap.identity()) {
+    return;
+  }
+
+  const unsigned int num_cells = size_x_ * size_y_;
+  if (tiled_voxel_grid_) {
+    // the tiled columns may hold more levels than a VoxelGrid column, they are remapped in place
+    tiled_voxel_grid_->remapLevels(remap, size_z_);
+    for (unsigned int i = 0; i < num_cells; ++i) {
+      followColumn(i, tiled_voxel_grid_->markedCount(i));
+    }
+  } else {
+    std::vector<uint32_t> columns(num_cells);
+    readColumns(columns.data());
+    for (uint32_t & column : columns) {
+      column = remap.remapColumn(column);
+    }
+    // a resize to other levels reallocates and resets the storage, the remapped columns are
+    // written back afterwards
+    if (gpu_voxel_grid_) {
+      gpu_voxel_grid_->resize(size_x_, size_y_, size_z_);
+    } else {
+      voxel_grid_.resize(size_x_, size_y_, size_z_);
+    }
+    writeColumns(columns.data());
+    for (unsigned int i = 0; i < num_cells; ++i) {
+      followColumn(i, nav2_voxel_grid::VoxelGrid::numBits(columns[i] >> 16));
+    }
+  }
+
+  dirty_tiles_.markAll();
+  voxel_keyframe_needed_ = true;
+  addExtraBounds(
+    origin_x_, origin_y_, origin_x_ + getSizeInMetersX(), origin_y_ + getSizeInMetersY());
+  RCLCPP_INFO(
+    logger_, "Remapped the voxel columns onto %d levels of %.3f m from %.3f m", size_z_,
+    z_resolution_, origin_z_);
+}
+
+void IntensityVoxelLayer::saveSnapshot()
+{
+  std::lock_guard<Costmap2D::mutex_t> guard(*getMutex());
+  if (size_z_ > VOXEL_BITS) {
+    RCLCPP_WARN(
+      logger_, "The voxel snapshot holds at most %d levels, %s is not written", VOXEL_BITS,
+      snapshot_file_.c_str());
+    return;
+  }
+
+  VoxelSnapshot snapshot;
+  snapshot.global_frame = global_frame_;
+  snapshot.size_x = size_x_;
+  snapshot.size_y = size_y_;
+  snapshot.size_z = size_z_;
+  snapshot.resolution = resolution_;
+  snapshot.z_resolution = z_resolution_;
+  snapshot.origin_x = origin_x_;
+  snapshot.origin_y = origin_y_;
+  snapshot.origin_z = origin_z_;
+  snapshot.costmap.assign(costmap_, costmap_ + size_x_ * size_y_);
+  snapshot.columns.resize(size_x_ * size_y_);
+  readColumns(snapshot.columns.data());
+
+  std::string error;
+  if (!snapshot.save(snapshot_file_, error)) {
+    RCLCPP_WARN(logger_, "Failed to write the voxel snapshot: %s", error.c_str());
+    return;
+  }
+  RCLCPP_INFO(logger_, "Wrote the voxel snapshot to %s", snapshot_file_.c_str());
+}
+
+void IntensityVoxelLayer::loadSnapshot()
+{
+  std::lock_guard<Costmap2D::mutex_t> guard(*getMutex());
+  if (size_z_ > VOXEL_BITS) {
+    RCLCPP_WARN(
+      logger_, "The voxel snapshot holds at most %d levels, %s is not read", VOXEL_BITS,
+      snapshot_file_.c_str());
+    return;
+  }
+
+  VoxelSnapshot snapshot;
+  std::string error;
+  if (!snapshot.load(snapshot_file_, error)) {
+    RCLCPP_INFO(logger_, "Starting without a voxel snapshot: %s", error.c_str());
+    return;
+  }
+
+  // a rolling window takes the origin of the snapshot and scrolls to the robot on the next update,
+  // a static one has to cover the same area
+  if (
+    snapshot.global_frame != global_frame_ || snapshot.size_x != size_x_ ||
+    snapshot.size_y != size_y_ || snapshot.resolution != resolution_ ||
+    snapshot.size_z > static_cast<unsigned int>(VOXEL_BITS) ||
+    (!rolling_window_ && (snapshot.origin_x != origin_x_ || snapshot.origin_y != origin_y_)))
+  {
+    RCLCPP_WARN(
+      logger_, "The voxel snapshot %s was written for another map, starting from an empty one",
+      snapshot_file_.c_str());
+    return;
+  }
+  origin_x_ = snapshot.origin_x;
+  origin_y_ = snapshot.origin_y;
+
+  const unsigned int num_cells = size_x_ * size_y_;
+  memcpy(costmap_, snapshot.costmap.data(), num_cells);
+  const VerticalRemap remap(
+    snapshot.origin_z, snapshot.z_resolution, snapshot.size_z, origin_z_, z_resolution_,
+    static_cast<unsigned int>(std::max(size_z_, 0)));
+  if (!remap.identity()) {
+    for (unsigned int i = 0; i < num_cells; ++i) {
+      snapshot.columns[i] = remap.remapColumn(snapshot.columns[i]);
+      followColumn(i, nav2_voxel_grid::VoxelGrid::numBits(snapshot.columns[i] >> 16));
+    }
+  }
+  writeColumns(snapshot.columns.data());
+
+  dirty_tiles_.markAll();
+  voxel_keyframe_needed_ = true;
+  addExtraBounds(
+    origin_x_, origin_y_, origin_x_ + getSizeInMetersX(), origin_y_ + getSizeInMetersY());
+  RCLCPP_INFO(logger_, "Started from the voxel snapshot %s", snapshot_file_.c_str());
 }
 
 void IntensityVoxelLayer::updateBounds(
@@ -109,6 +408,7 @@ void IntensityVoxelLayer::updateBounds(
   double * max_y)
 {
   std::lock_guard<Costmap2D::mutex_t> guard(*getMutex());
+  recordStatsCycle();
 
   if (rolling_window_) {
     updateOrigin(robot_x - getSizeInMetersX() / 2, robot_y - getSizeInMetersY() / 2);
@@ -119,114 +419,287 @@ void IntensityVoxelLayer::updateBounds(
   useExtraBounds(min_x, min_y, max_x, max_y);
 
   bool current = true;
-  std::vector<nav2_costmap_2d::Observation> observations, clearing_observations;
+  {
+    LayerStats::StageTimer timer(stats_, LayerStats::FETCH);
+    marking_observations_.clear();
+    clearing_observations_.clear();
 
-  // get the marking observations
-  current = getMarkingObservations(observations) && current;
+    // get the marking observations
+    current = getMarkingObservations(marking_observations_) && current;
 
-  // get the clearing observations
-  current = getClearingObservations(clearing_observations) && current;
+    // get the clearing observations
+    current = getClearingObservations(clearing_observations_) && current;
+    selectObservations();
+  }
 
   // update the global current status
   current_ = current;
 
-  // raytrace freespace
-  for (const auto & clearing_observation : clearing_observations) {
-    raytraceFreespace(clearing_observation, min_x, min_y, max_x, max_y);
+  // the voxels changed by this update are bounded apart, they are what a voxel map update sends
+  double voxel_min_x = std::numeric_limits<double>::max();
+  double voxel_min_y = std::numeric_limits<double>::max();
+  double voxel_max_x = std::numeric_limits<double>::lowest();
+  double voxel_max_y = std::numeric_limits<double>::lowest();
+
+  // the traced endpoints are only gathered while someone listens, which is checked once per update
+  collect_clearing_endpoints_ =
+    clearing_endpoints_pub_ && clearing_endpoints_pub_->get_subscription_count() > 0;
+  if (collect_clearing_endpoints_) {
+    resetClearingEndpoints();
   }
 
-  // place the new obstacles into a priority queue... each with a priority of zero to begin with
-  for (const auto & obs : observations) {
-    const sensor_msgs::msg::PointCloud2 & cloud = *(obs.cloud_);
+  // raytrace freespace and collect the voxels of the new obstacles
+  pending_voxel_marks_.clear();
+  processObservations(&voxel_min_x, &voxel_min_y, &voxel_max_x, &voxel_max_y);
 
-    double sq_obstacle_max_range = obs.obstacle_max_range_ * obs.obstacle_max_range_;
-    double sq_obstacle_min_range = obs.obstacle_min_range_ * obs.obstacle_min_range_;
-
-    sensor_msgs::PointCloud2ConstIterator<float> iter_x(cloud, "x");
-    sensor_msgs::PointCloud2ConstIterator<float> iter_y(cloud, "y");
-    sensor_msgs::PointCloud2ConstIterator<float> iter_z(cloud, "z");
-    sensor_msgs::PointCloud2ConstIterator<uint8_t> iter_i(cloud, "intensity");
+  // one cloud holds the endpoints of every clearing observation of this update
+  if (collect_clearing_endpoints_) {
+    publishClearingEndpoints();
+  }
 
-    for (; iter_x != iter_x.end(); ++iter_x, ++iter_y, ++iter_z, ++iter_i) {
-      if (*iter_i < min_obstacle_intensity_ || *iter_i > max_obstacle_intensity_) {
-        continue;
+  // the voxels are marked after every observation was traced, as clearing before marking requires
+  // marking only sets bits, so checking each column after the last mark gives the same result
+  // as checking it after every mark
+  LayerStats::StageTimer marking_timer(stats_, LayerStats::MARKING);
+  if (tiled_voxel_grid_) {
+    for (const VoxelMark & mark : pending_voxel_marks_) {
+      tiled_voxel_grid_->markVoxel(mark.mx, mark.my, mark.mz);
+    }
+    marking_batch_.flush([this](unsigned int index) {
+      if (tiled_voxel_grid_->markedCount(index) <= static_cast<unsigned int>(mark_threshold_)) {
+        return false;
+      }
+      if (costmap_[index] != LETHAL_OBSTACLE) {
+        costmap_[index] = LETHAL_OBSTACLE;
+        dirty_tiles_.mark(index);
+      }
+      return true;
+    });
+    // tiles that were cleared out during this update give their memory back
+    tiled_voxel_grid_->releaseEmptyTiles();
+  } else if (gpu_voxel_grid_) {
+    // the marks are applied and the batch's columns checked in one round trip, the flush visits
+    // the cells in the order they were handed over
+    gpu_voxel_grid_->markVoxels(
+      pending_voxel_marks_, marking_batch_.cells(), static_cast<unsigned int>(mark_threshold_),
+      gpu_occupied_);
+    size_t next = 0;
+    marking_batch_.flush([this, &next](unsigned int index) {
+      if (!gpu_occupied_[next++]) {
+        return false;
+      }
+      if (costmap_[index] != LETHAL_OBSTACLE) {
+        costmap_[index] = LETHAL_OBSTACLE;
+        dirty_tiles_.mark(index);
       }
+      return true;
+    });
+  } else {
+    for (const VoxelMark & mark : pending_voxel_marks_) {
+      voxel_grid_.markVoxel(mark.mx, mark.my, mark.mz);
+    }
+    const unsigned int * voxel_data = voxel_grid_.getData();
+    marking_batch_.flush([this, voxel_data](unsigned int index) {
+      if (
+        std::bitset<32>(voxel_data[index] >> 16).count() <= static_cast<size_t>(mark_threshold_))
+      {
+        return false;
+      }
+      if (costmap_[index] != LETHAL_OBSTACLE) {
+        costmap_[index] = LETHAL_OBSTACLE;
+        dirty_tiles_.mark(index);
+      }
+      return true;
+    });
+  }
+  touchBatchBounds(marking_batch_, &voxel_min_x, &voxel_min_y, &voxel_max_x, &voxel_max_y);
+  marking_timer.stop();
+
+  if (voxel_min_x <= voxel_max_x && voxel_min_y <= voxel_max_y) {
+    *min_x = std::min(*min_x, voxel_min_x);
+    *min_y = std::min(*min_y, voxel_min_y);
+    *max_x = std::max(*max_x, voxel_max_x);
+    *max_y = std::max(*max_y, voxel_max_y);
+
+    // columns changed since the last voxel map publish
+    int dirty_min_x, dirty_min_y, dirty_max_x, dirty_max_y;
+    worldToMapEnforceBounds(voxel_min_x, voxel_min_y, dirty_min_x, dirty_min_y);
+    worldToMapEnforceBounds(voxel_max_x, voxel_max_y, dirty_max_x, dirty_max_y);
+    voxel_dirty_min_x_ = std::min(voxel_dirty_min_x_, dirty_min_x);
+    voxel_dirty_min_y_ = std::min(voxel_dirty_min_y_, dirty_min_y);
+    voxel_dirty_max_x_ = std::max(voxel_dirty_max_x_, dirty_max_x);
+    voxel_dirty_max_y_ = std::max(voxel_dirty_max_y_, dirty_max_y);
+  }
 
-      // compute the squared distance from the hitpoint to the pointcloud's origin
-      double sq_dist = (*iter_x - obs.origin_.x) * (*iter_x - obs.origin_.x) +
-                       (*iter_y - obs.origin_.y) * (*iter_y - obs.origin_.y) +
-                       (*iter_z - obs.origin_.z) * (*iter_z - obs.origin_.z);
+  if (publish_voxel_) {
+    publishVoxelMap();
+  }
 
-      // if the point is far enough away... we won't consider it
-      if (sq_dist >= sq_obstacle_max_range) {
-        continue;
-      }
+  updateFootprint(robot_x, robot_y, robot_yaw, min_x, min_y, max_x, max_y);
+}
 
-      // If the point is too close, do not consider it
-      if (sq_dist < sq_obstacle_min_range) {
-        continue;
-      }
+void IntensityVoxelLayer::publishVoxelMap()
+{
+  if (voxel_publish_period_ > rclcpp::Duration(0, 0)) {
+    const rclcpp::Time now = clock_->now();
+    if (now - last_voxel_publish_ < voxel_publish_period_) {
+      return;
+    }
+    last_voxel_publish_ = now;
+  }
 
-      // now we need to compute the map coordinates for the observation
-      unsigned int mx, my, mz;
-      if (*iter_z < origin_z_) {
-        if (!worldToMap3D(*iter_x, *iter_y, origin_z_, mx, my, mz)) {
-          continue;
-        }
-      } else if (!worldToMap3D(*iter_x, *iter_y, *iter_z, mx, my, mz)) {
-        continue;
-      }
+  const bool dirty = voxel_dirty_min_x_ <= voxel_dirty_max_x_;
+  const bool keyframe = voxel_keyframe_interval_ <= 0 || voxel_keyframe_needed_ ||
+                        voxel_deltas_since_keyframe_ >= voxel_keyframe_interval_;
+  if (!keyframe && !dirty) {
+    return;
+  }
 
-      // mark the cell in the voxel grid and check if we should also mark it in the costmap
-      if (voxel_grid_.markVoxelInMap(mx, my, mz, mark_threshold_)) {
-        unsigned int index = getIndex(mx, my);
+  unsigned int x0 = 0, y0 = 0, width = size_x_, height = size_y_;
+  if (!keyframe) {
+    x0 = voxel_dirty_min_x_;
+    y0 = voxel_dirty_min_y_;
+    width = voxel_dirty_max_x_ - voxel_dirty_min_x_ + 1;
+    height = voxel_dirty_max_y_ - voxel_dirty_min_y_ + 1;
+  }
 
-        costmap_[index] = LETHAL_OBSTACLE;
-        touch(
-          static_cast<double>(*iter_x), static_cast<double>(*iter_y), min_x, min_y, max_x, max_y);
-      }
+  // the messages and their data are reused, the data only grows when the map does
+  nav2_msgs::msg::VoxelGrid & grid_msg = keyframe ? voxel_grid_msg_ : voxel_update_msg_;
+  grid_msg.size_x = width;
+  grid_msg.size_y = height;
+  grid_msg.size_z = size_z_;
+  grid_msg.data.resize(width * height);
+  if (tiled_voxel_grid_) {
+    tiled_voxel_grid_->toVoxelGridData(grid_msg.data.data(), x0, y0, width, height);
+  } else if (gpu_voxel_grid_) {
+    gpu_voxel_grid_->download(grid_msg.data.data(), x0, y0, width, height);
+  } else {
+    const unsigned int * voxel_data = voxel_grid_.getData();
+    for (unsigned int y = 0; y < height; ++y) {
+      memcpy(
+        &grid_msg.data[y * width], voxel_data + getIndex(x0, y0 + y),
+        width * sizeof(unsigned int));
     }
   }
 
-  if (publish_voxel_) {
-    auto grid_msg = std::make_unique<nav2_msgs::msg::VoxelGrid>();
-    unsigned int size = voxel_grid_.sizeX() * voxel_grid_.sizeY();
-    grid_msg->size_x = voxel_grid_.sizeX();
-    grid_msg->size_y = voxel_grid_.sizeY();
-    grid_msg->size_z = voxel_grid_.sizeZ();
-    grid_msg->data.resize(size);
-    memcpy(&grid_msg->data[0], voxel_grid_.getData(), size * sizeof(unsigned int));
+  // an update is a voxel grid of its own, placed at the first changed column
+  grid_msg.origin.x = origin_x_ + x0 * resolution_;
+  grid_msg.origin.y = origin_y_ + y0 * resolution_;
+  grid_msg.origin.z = origin_z_;
+
+  grid_msg.resolutions.x = resolution_;
+  grid_msg.resolutions.y = resolution_;
+  grid_msg.resolutions.z = z_resolution_;
+  grid_msg.header.frame_id = global_frame_;
+  grid_msg.header.stamp = clock_->now();
+
+  if (keyframe) {
+    voxel_pub_->publish(grid_msg);
+    voxel_keyframe_needed_ = false;
+    voxel_deltas_since_keyframe_ = 0;
+  } else {
+    voxel_updates_pub_->publish(grid_msg);
+    ++voxel_deltas_since_keyframe_;
+  }
 
-    grid_msg->origin.x = origin_x_;
-    grid_msg->origin.y = origin_y_;
-    grid_msg->origin.z = origin_z_;
+  voxel_dirty_min_x_ = voxel_dirty_min_y_ = std::numeric_limits<int>::max();
+  voxel_dirty_max_x_ = voxel_dirty_max_y_ = std::numeric_limits<int>::min();
+}
 
-    grid_msg->resolutions.x = resolution_;
-    grid_msg->resolutions.y = resolution_;
-    grid_msg->resolutions.z = z_resolution_;
-    grid_msg->header.frame_id = global_frame_;
-    grid_msg->header.stamp = clock_->now();
+void IntensityVoxelLayer::markObservation(const StoredObservation & marking_observation)
+{
+  const PointFilterParams params = makeMarkingParams(marking_observation);
+
+  size_t points_in = 0, points_accepted = 0;
+  forEachPointBlock(*(marking_observation.cloud), marking_scratch_.block, [&](PointBlock & block) {
+    transformPointBlock(block, marking_observation.transform);
+    points_in += block.size;
+    points_accepted += markVoxelBlock(block, params);
+  });
+  stats_.addPoints(marking_observation.source, points_in, points_accepted);
+}
 
-    voxel_pub_->publish(std::move(grid_msg));
+void IntensityVoxelLayer::markAndClear(
+  const StoredObservation & marking_observation, const StoredObservation & clearing_observation,
+  double * min_x, double * min_y, double * max_x, double * max_y)
+{
+  ClearingPass pass;
+  const bool clearing = beginClearing(clearing_observation, pass, min_x, min_y, max_x, max_y);
+  const PointFilterParams params = makeMarkingParams(marking_observation);
+
+  // every block feeds the clearer and the marker, the voxels are only marked once all
+  // observations have been traced, so the result is the same as clearing before marking
+  size_t points_in = 0, points_accepted = 0;
+  forEachPointBlock(*(marking_observation.cloud), marking_scratch_.block, [&](PointBlock & block) {
+    transformPointBlock(block, marking_observation.transform);
+    if (clearing) {
+      addClearingBlock(pass, block);
+    }
+    points_in += block.size;
+    points_accepted += markVoxelBlock(block, params);
+  });
+  stats_.addPoints(marking_observation.source, points_in, points_accepted);
+
+  if (clearing) {
+    endClearing(pass, min_x, min_y, max_x, max_y);
   }
+}
 
-  updateFootprint(robot_x, robot_y, robot_yaw, min_x, min_y, max_x, max_y);
+size_t IntensityVoxelLayer::markVoxelBlock(
+  const PointBlock & block, const PointFilterParams & params)
+{
+  // drop points outside of the height window, the intensity window and the obstacle range in
+  // one batch
+  size_t num_survivors = filterPointBlock(block, params, marking_scratch_.survivors);
+  markVoxels(block, num_survivors);
+  return num_survivors;
 }
 
-void IntensityVoxelLayer::raytraceFreespace(
-  const nav2_costmap_2d::Observation & clearing_observation, double * min_x, double * min_y,
-  double * max_x, double * max_y)
+size_t IntensityVoxelLayer::markPreparedBlock(
+  const StoredObservation & marking_observation, const PointBlock & block)
 {
-  auto clearing_endpoints = std::make_unique<sensor_msgs::msg::PointCloud2>();
+  // the points were filtered as they arrived, only the map can have moved since
+  size_t num_points = selectAllPoints(block, marking_scratch_.survivors);
+  markVoxels(block, num_points);
+  return num_points;
+}
 
-  if (clearing_observation.cloud_->height == 0 || clearing_observation.cloud_->width == 0) {
-    return;
+void IntensityVoxelLayer::markVoxels(const PointBlock & block, size_t num_survivors)
+{
+  for (size_t k = 0; k < num_survivors; ++k) {
+    const uint32_t i = marking_scratch_.survivors[k];
+    const double x = block.x[i];
+    const double y = block.y[i];
+    const double z = block.z[i];
+
+    // now we need to compute the map coordinates for the observation
+    unsigned int mx, my, mz;
+    if (z < origin_z_) {
+      if (!worldToMap3D(x, y, origin_z_, mx, my, mz)) {
+        continue;
+      }
+    } else if (!worldToMap3D(x, y, z, mx, my, mz)) {
+      continue;
+    }
+
+    // the voxel is marked after tracing, the column is checked once the batch is complete
+    pending_voxel_marks_.push_back({mx, my, mz});
+    marking_batch_.add(getIndex(mx, my));
+  }
+}
+
+bool IntensityVoxelLayer::beginClearing(
+  const StoredObservation & clearing_observation, ClearingPass & pass, double * min_x,
+  double * min_y, double * max_x, double * max_y)
+{
+  if (clearing_observation.cloud->height == 0 || clearing_observation.cloud->width == 0) {
+    return false;
   }
 
   double sensor_x, sensor_y, sensor_z;
-  double ox = clearing_observation.origin_.x;
-  double oy = clearing_observation.origin_.y;
-  double oz = clearing_observation.origin_.z;
+  double ox = clearing_observation.origin.x;
+  double oy = clearing_observation.origin.y;
+  double oz = clearing_observation.origin.z;
 
   if (!worldToMap3DFloat(ox, oy, oz, sensor_x, sensor_y, sensor_z)) {
     RCLCPP_WARN(
@@ -237,51 +710,51 @@ void IntensityVoxelLayer::raytraceFreespace(
       ox, oy, oz, origin_x_, origin_y_, origin_z_, origin_x_ + getSizeInMetersX(),
       origin_y_ + getSizeInMetersY(), origin_z_ + getSizeInMetersZ());
 
-    return;
-  }
-
-  bool publish_clearing_points;
-
-  {
-    auto node = node_.lock();
-    if (!node) {
-      throw std::runtime_error{"Failed to lock node"};
-    }
-    publish_clearing_points = (node->count_subscribers("clearing_endpoints") > 0);
+    return false;
   }
 
-  clearing_endpoints->data.clear();
-  clearing_endpoints->width = clearing_observation.cloud_->width;
-  clearing_endpoints->height = clearing_observation.cloud_->height;
-  clearing_endpoints->is_dense = true;
-  clearing_endpoints->is_bigendian = false;
-
-  sensor_msgs::PointCloud2Modifier modifier(*clearing_endpoints);
-  modifier.setPointCloud2Fields(
-    3, "x", 1, sensor_msgs::msg::PointField::FLOAT32, "y", 1, sensor_msgs::msg::PointField::FLOAT32,
-    "z", 1, sensor_msgs::msg::PointField::FLOAT32);
+  pass.observation = &clearing_observation;
+  pass.ox = ox;
+  pass.oy = oy;
+  pass.oz = oz;
+  pass.sensor_x = sensor_x;
+  pass.sensor_y = sensor_y;
+  pass.sensor_z = sensor_z;
+  pass.batch = RaytraceBatch(
+    ox, oy, clearing_observation.raytrace_max_range, clearing_observation.raytrace_min_range,
+    cellDistance(clearing_observation.raytrace_max_range),
+    cellDistance(clearing_observation.raytrace_min_range));
+
+  // the line endpoints are collected first, then culled and traced serially or by the worker pool
+  clearing_voxel_rays_.clear();
+  return true;
+}
 
-  sensor_msgs::PointCloud2Iterator<float> clearing_endpoints_iter_x(*clearing_endpoints, "x");
-  sensor_msgs::PointCloud2Iterator<float> clearing_endpoints_iter_y(*clearing_endpoints, "y");
-  sensor_msgs::PointCloud2Iterator<float> clearing_endpoints_iter_z(*clearing_endpoints, "z");
+void IntensityVoxelLayer::addClearingBlock(ClearingPass & pass, const PointBlock & block)
+{
+  const StoredObservation & clearing_observation = *pass.observation;
+  const double ox = pass.ox, oy = pass.oy, oz = pass.oz;
 
   // we can pre-compute the endpoints of the map outside of the inner loop... we'll need these later
   double map_end_x = origin_x_ + getSizeInMetersX();
   double map_end_y = origin_y_ + getSizeInMetersY();
   double map_end_z = origin_z_ + getSizeInMetersZ();
 
-  sensor_msgs::PointCloud2ConstIterator<float> iter_x(*(clearing_observation.cloud_), "x");
-  sensor_msgs::PointCloud2ConstIterator<float> iter_y(*(clearing_observation.cloud_), "y");
-  sensor_msgs::PointCloud2ConstIterator<float> iter_z(*(clearing_observation.cloud_), "z");
+  // every endpoint is pulled towards the sensor by two cells so the hit voxel is not cleared
+  const double endpoint_margin = 2 * resolution_;
 
-  for (; iter_x != iter_x.end(); ++iter_x, ++iter_y, ++iter_z) {
-    double wpx = *iter_x;
-    double wpy = *iter_y;
-    double wpz = *iter_z;
+  for (size_t i = 0; i < block.size; ++i) {
+    // apply the height window of the source
+    if (!clearing_observation.inHeightWindow(block.z[i])) {
+      continue;
+    }
+    double wpx = block.x[i];
+    double wpy = block.y[i];
+    double wpz = block.z[i];
 
     double distance = dist(ox, oy, oz, wpx, wpy, wpz);
     double scaling_fact = 1.0;
-    scaling_fact = std::max(std::min(scaling_fact, (distance - 2 * resolution_) / distance), 0.0);
+    scaling_fact = std::max(std::min(scaling_fact, (distance - endpoint_margin) / distance), 0.0);
     wpx = scaling_fact * (wpx - ox) + ox;
     wpy = scaling_fact * (wpy - oy) + oy;
     wpz = scaling_fact * (wpz - oz) + oz;
@@ -323,39 +796,192 @@ void IntensityVoxelLayer::raytraceFreespace(
 
     double point_x, point_y, point_z;
     if (worldToMap3DFloat(wpx, wpy, wpz, point_x, point_y, point_z)) {
-      unsigned int cell_raytrace_max_range = cellDistance(clearing_observation.raytrace_max_range_);
-      unsigned int cell_raytrace_min_range = cellDistance(clearing_observation.raytrace_min_range_);
+      if (ray_culler_.enabled()) {
+        ray_culler_.add(clearing_voxel_rays_.size(), wpx - ox, wpy - oy, wpz - oz);
+      }
+      clearing_voxel_rays_.push_back({point_x, point_y, point_z, wpx, wpy, wpz});
+    }
+  }
+}
+
+void IntensityVoxelLayer::endClearing(
+  ClearingPass & pass, double * min_x, double * min_y, double * max_x, double * max_y)
+{
+  RaytraceBatch & batch = pass.batch;
 
-      // voxel_grid_.markVoxelLine(sensor_x, sensor_y, sensor_z, point_x, point_y, point_z);
+  // only the farthest ray of each angular bin is traced
+  if (ray_culler_.enabled()) {
+    ray_culler_.cull(clearing_voxel_rays_);
+  }
+  stats_.addRays(clearing_voxel_rays_.size());
+
+  // the voxel grids, the parallel merge and the device updates write the costmap themselves, so
+  // every tile the rays pass over is flagged
+  double min_cx = pass.sensor_x, min_cy = pass.sensor_y;
+  double max_cx = pass.sensor_x, max_cy = pass.sensor_y;
+  const bool parallel = clearing_pool_ != nullptr;
+  gpu_endpoints_.clear();
+  for (const VoxelRay & ray : clearing_voxel_rays_) {
+    min_cx = std::min(min_cx, ray.x1);
+    min_cy = std::min(min_cy, ray.y1);
+    max_cx = std::max(max_cx, ray.x1);
+    max_cy = std::max(max_cy, ray.y1);
+    if (tiled_voxel_grid_) {
+      tiled_voxel_grid_->clearVoxelLineInMap(
+        pass.sensor_x, pass.sensor_y, pass.sensor_z, ray.x1, ray.y1, ray.z1, costmap_,
+        unknown_threshold_, mark_threshold_, FREE_SPACE, NO_INFORMATION, batch.cellMaxRange(),
+        batch.cellMinRange());
+    } else if (gpu_voxel_grid_) {
+      gpu_endpoints_.push_back({ray.x1, ray.y1, ray.z1});
+    } else if (!parallel) {
       voxel_grid_.clearVoxelLineInMap(
-        sensor_x, sensor_y, sensor_z, point_x, point_y, point_z, costmap_, unknown_threshold_,
-        mark_threshold_, FREE_SPACE, NO_INFORMATION, cell_raytrace_max_range,
-        cell_raytrace_min_range);
-
-      updateRaytraceBounds(
-        ox, oy, wpx, wpy, clearing_observation.raytrace_max_range_,
-        clearing_observation.raytrace_min_range_, min_x, min_y, max_x, max_y);
-
-      if (publish_clearing_points) {
-        *clearing_endpoints_iter_x = wpx;
-        *clearing_endpoints_iter_y = wpy;
-        *clearing_endpoints_iter_z = wpz;
-
-        ++clearing_endpoints_iter_x;
-        ++clearing_endpoints_iter_y;
-        ++clearing_endpoints_iter_z;
-      }
+        pass.sensor_x, pass.sensor_y, pass.sensor_z, ray.x1, ray.y1, ray.z1, costmap_,
+        unknown_threshold_, mark_threshold_, FREE_SPACE, NO_INFORMATION, batch.cellMaxRange(),
+        batch.cellMinRange());
     }
+    batch.addEndpoint(ray.wx, ray.wy);
   }
 
-  if (publish_clearing_points) {
-    clearing_endpoints->header.frame_id = global_frame_;
-    clearing_endpoints->header.stamp = clearing_observation.cloud_->header.stamp;
+  if (parallel) {
+    raytraceVoxelsInParallel(
+      pass.sensor_x, pass.sensor_y, pass.sensor_z, batch.cellMaxRange(), batch.cellMinRange());
+  }
+  if (gpu_voxel_grid_) {
+    gpu_voxel_grid_->clearLines(
+      pass.sensor_x, pass.sensor_y, pass.sensor_z, gpu_endpoints_, unknown_threshold_,
+      mark_threshold_, FREE_SPACE, NO_INFORMATION, batch.cellMaxRange(), batch.cellMinRange(),
+      gpu_updates_);
+    for (const VoxelGpuBackend::CellUpdate & update : gpu_updates_) {
+      costmap_[update.index] = static_cast<unsigned char>(update.cost);
+    }
+  }
+  if (!clearing_voxel_rays_.empty()) {
+    dirty_tiles_.markRect(
+      static_cast<unsigned int>(std::max(min_cx, 0.0)),
+      static_cast<unsigned int>(std::max(min_cy, 0.0)),
+      static_cast<unsigned int>(std::max(max_cx, 0.0)),
+      static_cast<unsigned int>(std::max(max_cy, 0.0)));
+  }
 
-    clearing_endpoints_pub_->publish(std::move(clearing_endpoints));
+  batch.touchBounds(min_x, min_y, max_x, max_y);
+
+  if (collect_clearing_endpoints_ && !clearing_voxel_rays_.empty()) {
+    // the endpoints go straight into the cloud, growing it keeps the points already written
+    sensor_msgs::PointCloud2Modifier modifier(clearing_endpoints_);
+    const size_t first = modifier.size();
+    modifier.resize(first + clearing_voxel_rays_.size());
+
+    // x, y and z are consecutive floats of each point
+    sensor_msgs::PointCloud2Iterator<float> iter_xyz =
+      sensor_msgs::PointCloud2Iterator<float>(clearing_endpoints_, "x") + static_cast<int>(first);
+    for (const VoxelRay & ray : clearing_voxel_rays_) {
+      iter_xyz[0] = static_cast<float>(ray.wx);
+      iter_xyz[1] = static_cast<float>(ray.wy);
+      iter_xyz[2] = static_cast<float>(ray.wz);
+      ++iter_xyz;
+    }
   }
 }
 
+void IntensityVoxelLayer::resetClearingEndpoints()
+{
+  // the fields are set once, after that resizing keeps the capacity of the data
+  sensor_msgs::PointCloud2Modifier modifier(clearing_endpoints_);
+  if (clearing_endpoints_.fields.empty()) {
+    clearing_endpoints_.is_dense = true;
+    clearing_endpoints_.is_bigendian = false;
+    modifier.setPointCloud2Fields(
+      3, "x", 1, sensor_msgs::msg::PointField::FLOAT32, "y", 1,
+      sensor_msgs::msg::PointField::FLOAT32, "z", 1, sensor_msgs::msg::PointField::FLOAT32);
+  }
+  modifier.resize(0);
+}
+
+void IntensityVoxelLayer::publishClearingEndpoints()
+{
+  sensor_msgs::msg::PointCloud2 & clearing_endpoints = clearing_endpoints_;
+  clearing_endpoints.header.frame_id = global_frame_;
+  clearing_endpoints.header.stamp = clock_->now();
+
+  clearing_endpoints_pub_->publish(clearing_endpoints);
+}
+
+void IntensityVoxelLayer::raytraceVoxelsInParallel(
+  double sensor_x, double sensor_y, double sensor_z, unsigned int max_length,
+  unsigned int min_length)
+{
+  if (clearing_voxel_rays_.empty()) {
+    return;
+  }
+
+  // every traced column lies within the rows spanned by the origin and the endpoints, so each
+  // worker accumulates the cleared voxel bits of a column in a mask over that band of rows
+  unsigned int min_row = static_cast<unsigned int>(sensor_y);
+  unsigned int max_row = min_row;
+  for (const auto & ray : clearing_voxel_rays_) {
+    min_row = std::min(min_row, static_cast<unsigned int>(ray.y1));
+    max_row = std::max(max_row, static_cast<unsigned int>(ray.y1));
+  }
+  const unsigned int base = min_row * size_x_;
+  const size_t band = (max_row - min_row + 1) * static_cast<size_t>(size_x_);
+
+  // the masks are left zeroed by the merge, so they only need to grow here
+  clearing_column_masks_.resize(clearing_pool_->size());
+  for (auto & mask : clearing_column_masks_) {
+    if (mask.size() < band) {
+      mask.resize(band, 0);
+    }
+  }
+
+  const size_t num_rays = clearing_voxel_rays_.size();
+  const size_t num_tasks = std::min(num_rays, clearing_pool_->size() * 4);
+  const size_t rays_per_task = (num_rays + num_tasks - 1) / num_tasks;
+  std::atomic<int64_t> busy_ns{0};
+
+  const auto start = std::chrono::steady_clock::now();
+  clearing_pool_->run(num_tasks, [&](size_t task, size_t worker) {
+    const auto task_start = std::chrono::steady_clock::now();
+    ClearVoxelBits clearer(clearing_column_masks_[worker].data(), base);
+    const size_t end = std::min(num_rays, (task + 1) * rays_per_task);
+    for (size_t i = task * rays_per_task; i < end; ++i) {
+      const VoxelRay & ray = clearing_voxel_rays_[i];
+      voxel_grid_.raytraceLine(
+        clearer, sensor_x, sensor_y, sensor_z, ray.x1, ray.y1, ray.z1, max_length, min_length);
+    }
+    busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now() - task_start)
+                 .count();
+  });
+
+  // clearing only removes bits, so the state of a column after all of its clears is the same
+  // whatever order they ran in, and the last serial costmap write is decided by that state
+  uint32_t * voxel_data = voxel_grid_.getData();
+  for (size_t i = 0; i < band; ++i) {
+    uint32_t cleared = 0;
+    for (auto & mask : clearing_column_masks_) {
+      cleared |= mask[i];
+      mask[i] = 0;
+    }
+    if (!cleared) {
+      continue;
+    }
+
+    uint32_t & column = voxel_data[base + i];
+    column &= ~cleared;
+    unsigned int unknown_bits = uint16_t(column >> 16) ^ uint16_t(column);
+    unsigned int marked_bits = column >> 16;
+    if (nav2_voxel_grid::VoxelGrid::bitsBelowThreshold(marked_bits, mark_threshold_)) {
+      if (nav2_voxel_grid::VoxelGrid::bitsBelowThreshold(unknown_bits, unknown_threshold_)) {
+        costmap_[base + i] = FREE_SPACE;
+      } else {
+        costmap_[base + i] = NO_INFORMATION;
+      }
+    }
+  }
+
+  reportClearingSpeedup(num_rays, start, busy_ns.load());
+}
+
 void IntensityVoxelLayer::updateOrigin(double new_origin_x, double new_origin_y)
 {
   // project the new origin into the grid
@@ -363,60 +989,30 @@ void IntensityVoxelLayer::updateOrigin(double new_origin_x, double new_origin_y)
   cell_ox = static_cast<int>((new_origin_x - origin_x_) / resolution_);
   cell_oy = static_cast<int>((new_origin_y - origin_y_) / resolution_);
 
-  // compute the associated world coordinates for the origin cell
-  // beacuase we want to keep things grid-aligned
-  double new_grid_ox, new_grid_oy;
-  new_grid_ox = origin_x_ + cell_ox * resolution_;
-  new_grid_oy = origin_y_ + cell_oy * resolution_;
-
-  // To save casting from unsigned int to int a bunch of times
-  int size_x = size_x_;
-  int size_y = size_y_;
-
-  // we need to compute the overlap of the new and existing windows
-  int lower_left_x, lower_left_y, upper_right_x, upper_right_y;
-  lower_left_x = std::min(std::max(cell_ox, 0), size_x);
-  lower_left_y = std::min(std::max(cell_oy, 0), size_y);
-  upper_right_x = std::min(std::max(cell_ox + size_x, 0), size_x);
-  upper_right_y = std::min(std::max(cell_oy + size_y, 0), size_y);
-
-  unsigned int cell_size_x = upper_right_x - lower_left_x;
-  unsigned int cell_size_y = upper_right_y - lower_left_y;
-
-  // we need a map to store the obstacles in the window temporarily
-  unsigned char * local_map = new unsigned char[cell_size_x * cell_size_y];
-  unsigned int * local_voxel_map = new unsigned int[cell_size_x * cell_size_y];
-  unsigned int * voxel_map = voxel_grid_.getData();
-
-  // copy the local window in the costmap to the local map
-  copyMapRegion(
-    costmap_, lower_left_x, lower_left_y, size_x_, local_map, 0, 0, cell_size_x, cell_size_x,
-    cell_size_y);
-  copyMapRegion(
-    voxel_map, lower_left_x, lower_left_y, size_x_, local_voxel_map, 0, 0, cell_size_x, cell_size_x,
-    cell_size_y);
-
-  // we'll reset our maps to unknown space if appropriate
-  resetMaps();
-
-  // update the origin with the appropriate world coordinates
-  origin_x_ = new_grid_ox;
-  origin_y_ = new_grid_oy;
-
-  // compute the starting cell location for copying data back in
-  int start_x = lower_left_x - cell_ox;
-  int start_y = lower_left_y - cell_oy;
+  // nothing to move until the robot has crossed a whole cell
+  if (cell_ox == 0 && cell_oy == 0) {
+    return;
+  }
 
-  // now we want to copy the overlapping information back into the map, but in its new location
-  copyMapRegion(
-    local_map, 0, 0, cell_size_x, costmap_, start_x, start_y, size_x_, cell_size_x, cell_size_y);
-  copyMapRegion(
-    local_voxel_map, 0, 0, cell_size_x, voxel_map, start_x, start_y, size_x_, cell_size_x,
-    cell_size_y);
+  // the columns moved, so the next voxel map publish is a full one
+  voxel_keyframe_needed_ = true;
+
+  // scroll the overlap of the costmap and of the voxel columns into its new location, the
+  // columns that come into view are reset to unknown like resetMaps does
+  shiftMapInPlace(costmap_, size_x_, size_y_, cell_ox, cell_oy, default_value_);
+  dirty_tiles_.shift(cell_ox, cell_oy);
+  if (tiled_voxel_grid_) {
+    tiled_voxel_grid_->shift(cell_ox, cell_oy);
+  } else if (gpu_voxel_grid_) {
+    gpu_voxel_grid_->shift(cell_ox, cell_oy);
+  } else {
+    // ~0u >> 16 is the column VoxelGrid::reset fills in, with every level unknown
+    shiftMapInPlace(voxel_grid_.getData(), size_x_, size_y_, cell_ox, cell_oy, ~0u >> 16);
+  }
 
-  // make sure to clean up
-  delete[] local_map;
-  delete[] local_voxel_map;
+  // update the origin with the appropriate world coordinates, keeping things grid-aligned
+  origin_x_ = origin_x_ + cell_ox * resolution_;
+  origin_y_ = origin_y_ + cell_oy * resolution_;
 }
 
 /**
@@ -428,7 +1024,11 @@ rcl_interfaces::msg::SetParametersResult IntensityVoxelLayer::dynamicParametersC
 {
   std::lock_guard<Costmap2D::mutex_t> guard(*getMutex());
   rcl_interfaces::msg::SetParametersResult result;
-  bool resize_map_needed = false;
+  bool remap_needed = false;
+  const double old_origin_z = origin_z_, old_z_resolution = z_resolution_;
+  const int old_size_z = size_z_;
+  // the threshold as set, the offset of the unused levels is added once the levels are known
+  int unknown_threshold = unknown_threshold_ - std::max(0, VOXEL_BITS - old_size_z);
 
   for (const auto & parameter : parameters) {
     const auto & param_type = parameter.get_type();
@@ -439,10 +1039,10 @@ rcl_interfaces::msg::SetParametersResult IntensityVoxelLayer::dynamicParametersC
         max_obstacle_intensity_ = parameter.as_double();
       } else if (param_name == name_ + "." + "origin_z") {
         origin_z_ = parameter.as_double();
-        resize_map_needed = true;
+        remap_needed = true;
       } else if (param_name == name_ + "." + "z_resolution") {
         z_resolution_ = parameter.as_double();
-        resize_map_needed = true;
+        remap_needed = true;
       }
     } else if (param_type == ParameterType::PARAMETER_BOOL) {
       if (param_name == name_ + "." + "enabled") {
@@ -460,10 +1060,10 @@ rcl_interfaces::msg::SetParametersResult IntensityVoxelLayer::dynamicParametersC
 
     } else if (param_type == ParameterType::PARAMETER_INTEGER) {
       if (param_name == name_ + "." + "z_voxels") {
-        size_z_ = parameter.as_int();
-        resize_map_needed = true;
+        size_z_ = std::min(static_cast<int>(parameter.as_int()), maxVoxelLevels());
+        remap_needed = true;
       } else if (param_name == name_ + "." + "unknown_threshold") {
-        unknown_threshold_ = parameter.as_int() + (VOXEL_BITS - size_z_);
+        unknown_threshold = parameter.as_int();
       } else if (param_name == name_ + "." + "mark_threshold") {
         mark_threshold_ = parameter.as_int();
       } else if (param_name == name_ + "." + "combination_method") {
@@ -472,8 +1072,11 @@ rcl_interfaces::msg::SetParametersResult IntensityVoxelLayer::dynamicParametersC
     }
   }
 
-  if (resize_map_needed) {
-    matchSize();
+  unknown_threshold_ = unknown_threshold + unusedVoxelBits();
+
+  // the columns are moved onto the new levels instead of being dropped with a matchSize
+  if (remap_needed) {
+    remapLevels(old_origin_z, old_z_resolution, old_size_z);
   }
 
   result.successful = true;
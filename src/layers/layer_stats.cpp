@@ -0,0 +1,121 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pb_nav2_plugins/layers/layer_stats.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pb_nav2_costmap_2d
+{
+
+namespace
+{
+
+constexpr const char * STAGE_NAMES[LayerStats::NUM_STAGES] = {
+  "fetch", "clearing", "marking", "footprint", "update_costs"};
+
+template<typename T>
+void addValue(diagnostic_msgs::msg::DiagnosticStatus & status, const std::string & key, T value)
+{
+  diagnostic_msgs::msg::KeyValue key_value;
+  key_value.key = key;
+  key_value.value = std::to_string(value);
+  status.values.push_back(std::move(key_value));
+}
+
+}  // namespace
+
+void LayerStats::configure(
+  bool enabled, size_t window, const std::vector<std::string> & source_names)
+{
+  enabled_ = enabled;
+  window_ = enabled ? std::max<size_t>(window, 1) : 0;
+  count_ = next_ = 0;
+  std::fill(std::begin(cycle_ns_), std::end(cycle_ns_), 0);
+  cycle_rays_ = last_rays_ = 0;
+  for (auto & ring : stage_rings_) {
+    ring.assign(window_, 0);
+  }
+  total_ring_.assign(window_, 0);
+
+  sources_.clear();
+  for (const auto & name : source_names) {
+    sources_.push_back(SourceCounts{name});
+  }
+  sources_.push_back(SourceCounts{"static"});
+}
+
+void LayerStats::endCycle()
+{
+  if (!enabled_) {
+    return;
+  }
+
+  int64_t total = 0;
+  for (unsigned int stage = 0; stage < NUM_STAGES; ++stage) {
+    stage_rings_[stage][next_] = cycle_ns_[stage];
+    total += cycle_ns_[stage];
+    cycle_ns_[stage] = 0;
+  }
+  total_ring_[next_] = total;
+  next_ = (next_ + 1) % window_;
+  count_ = std::min(count_ + 1, window_);
+
+  last_rays_ = cycle_rays_;
+  cycle_rays_ = 0;
+  for (auto & source : sources_) {
+    source.last_in = source.cycle_in;
+    source.last_accepted = source.cycle_accepted;
+    source.cycle_in = source.cycle_accepted = 0;
+  }
+}
+
+double LayerStats::percentile(const std::vector<int64_t> & ring, double q) const
+{
+  if (count_ == 0) {
+    return 0.0;
+  }
+  // the ring is only full once window_ cycles were closed, before that its head holds them
+  sorted_.assign(ring.begin(), ring.begin() + count_);
+  // nearest rank
+  size_t rank = static_cast<size_t>(std::ceil(q * static_cast<double>(count_)));
+  rank = std::min(rank > 0 ? rank - 1 : 0, count_ - 1);
+  std::nth_element(sorted_.begin(), sorted_.begin() + rank, sorted_.end());
+  return sorted_[rank] * 1e-6;
+}
+
+void LayerStats::fillStatus(diagnostic_msgs::msg::DiagnosticStatus & status) const
+{
+  status.values.clear();
+  addValue(status, "cycles", count_);
+  for (unsigned int stage = 0; stage < NUM_STAGES; ++stage) {
+    const std::string name = STAGE_NAMES[stage];
+    addValue(status, name + "_p50_ms", percentile(stage_rings_[stage], 0.5));
+    addValue(status, name + "_p99_ms", percentile(stage_rings_[stage], 0.99));
+  }
+  addValue(status, "total_p50_ms", percentile(total_ring_, 0.5));
+  addValue(status, "total_p99_ms", percentile(total_ring_, 0.99));
+
+  addValue(status, "rays_traced", last_rays_);
+  for (const auto & source : sources_) {
+    addValue(status, source.name + "_points_in", source.last_in);
+    addValue(status, source.name + "_points_accepted", source.last_accepted);
+  }
+}
+
+}  // namespace pb_nav2_costmap_2d
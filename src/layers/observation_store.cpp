@@ -0,0 +1,187 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pb_nav2_plugins/layers/observation_store.hpp"
+
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pb_nav2_costmap_2d
+{
+
+StoredObservation StoredObservation::fromObservation(const nav2_costmap_2d::Observation & obs)
+{
+  StoredObservation stored;
+  stored.cloud = std::make_shared<sensor_msgs::msg::PointCloud2>(*obs.cloud_);
+  stored.transform = PointTransform::makeIdentity();
+  stored.origin = obs.origin_;
+  stored.min_obstacle_height = -std::numeric_limits<double>::infinity();
+  stored.max_obstacle_height = std::numeric_limits<double>::infinity();
+  stored.obstacle_max_range = obs.obstacle_max_range_;
+  stored.obstacle_min_range = obs.obstacle_min_range_;
+  stored.raytrace_max_range = obs.raytrace_max_range_;
+  stored.raytrace_min_range = obs.raytrace_min_range_;
+  return stored;
+}
+
+ObservationStore::ObservationStore(
+  const rclcpp_lifecycle::LifecycleNode::WeakPtr & parent, std::string topic_name,
+  double observation_keep_time, double expected_update_rate, double min_obstacle_height,
+  double max_obstacle_height, double obstacle_max_range, double obstacle_min_range,
+  double raytrace_max_range, double raytrace_min_range, tf2_ros::Buffer & tf2_buffer,
+  std::string global_frame, std::string sensor_frame, tf2::Duration tf_tolerance)
+: tf2_buffer_(tf2_buffer),
+  observation_keep_time_(rclcpp::Duration::from_seconds(observation_keep_time)),
+  expected_update_rate_(rclcpp::Duration::from_seconds(expected_update_rate)),
+  global_frame_(global_frame),
+  sensor_frame_(sensor_frame),
+  topic_name_(topic_name),
+  min_obstacle_height_(min_obstacle_height),
+  max_obstacle_height_(max_obstacle_height),
+  obstacle_max_range_(obstacle_max_range),
+  obstacle_min_range_(obstacle_min_range),
+  raytrace_max_range_(raytrace_max_range),
+  raytrace_min_range_(raytrace_min_range),
+  tf_tolerance_(tf_tolerance)
+{
+  auto node = parent.lock();
+  if (!node) {
+    throw std::runtime_error{"Failed to lock node"};
+  }
+  clock_ = node->get_clock();
+  logger_ = node->get_logger();
+  last_updated_ = node->now();
+}
+
+void ObservationStore::bufferCloud(const sensor_msgs::msg::PointCloud2::ConstSharedPtr & cloud)
+{
+  StoredObservation obs;
+  if (makeObservation(cloud, obs)) {
+    addObservation(std::move(obs));
+  }
+}
+
+bool ObservationStore::makeObservation(
+  const sensor_msgs::msg::PointCloud2::ConstSharedPtr & cloud, StoredObservation & obs) const
+{
+  std::string origin_frame = sensor_frame_ == "" ? cloud->header.frame_id : sensor_frame_;
+
+  try {
+    const tf2::TimePoint stamp = tf2_ros::fromMsg(cloud->header.stamp);
+
+    // the points stay in the cloud frame, only the transform to apply to them is kept
+    const geometry_msgs::msg::TransformStamped cloud_tf =
+      tf2_buffer_.lookupTransform(global_frame_, cloud->header.frame_id, stamp, tf_tolerance_);
+    const auto & t = cloud_tf.transform.translation;
+    const auto & q = cloud_tf.transform.rotation;
+    obs.transform = PointTransform::fromTranslationRotation(t.x, t.y, t.z, q.x, q.y, q.z, q.w);
+
+    // the sensor origin is the origin of the sensor frame, or of the cloud frame without one
+    if (origin_frame == cloud->header.frame_id) {
+      obs.origin.x = t.x;
+      obs.origin.y = t.y;
+      obs.origin.z = t.z;
+    } else {
+      const geometry_msgs::msg::TransformStamped origin_tf =
+        tf2_buffer_.lookupTransform(global_frame_, origin_frame, stamp, tf_tolerance_);
+      obs.origin.x = origin_tf.transform.translation.x;
+      obs.origin.y = origin_tf.transform.translation.y;
+      obs.origin.z = origin_tf.transform.translation.z;
+    }
+  } catch (tf2::TransformException & ex) {
+    RCLCPP_ERROR(
+      logger_,
+      "TF Exception that should never happen for sensor frame: %s, cloud frame: %s, %s",
+      sensor_frame_.c_str(), cloud->header.frame_id.c_str(), ex.what());
+    return false;
+  }
+
+  obs.cloud = cloud;
+  obs.min_obstacle_height = min_obstacle_height_;
+  obs.max_obstacle_height = max_obstacle_height_;
+  obs.obstacle_max_range = obstacle_max_range_;
+  obs.obstacle_min_range = obstacle_min_range_;
+  obs.raytrace_max_range = raytrace_max_range_;
+  obs.raytrace_min_range = raytrace_min_range_;
+  obs.source = source_;
+  return true;
+}
+
+void ObservationStore::addObservation(StoredObservation && obs)
+{
+  observation_list_.push_front(std::move(obs));
+
+  // if the update was successful, we want to update the last updated time
+  last_updated_ = clock_->now();
+
+  // we'll also remove any stale observations from the list
+  purgeStaleObservations();
+}
+
+void ObservationStore::getObservations(std::vector<StoredObservation> & observations)
+{
+  // first... let's make sure that we don't have any stale observations
+  purgeStaleObservations();
+
+  // now we'll just copy the observations for the caller, which only copies shared pointers
+  observations.insert(observations.end(), observation_list_.begin(), observation_list_.end());
+}
+
+void ObservationStore::purgeStaleObservations()
+{
+  if (observation_list_.empty()) {
+    return;
+  }
+
+  auto obs_it = observation_list_.begin();
+  // if we're keeping observations for no time... then we'll only keep one observation
+  if (observation_keep_time_ == rclcpp::Duration(0, 0)) {
+    observation_list_.erase(++obs_it, observation_list_.end());
+    return;
+  }
+
+  // otherwise... we'll have to loop through the observations to see which ones are stale
+  for (; obs_it != observation_list_.end(); ++obs_it) {
+    // check if the observation is out of date... and if it is,
+    // remove it and those that follow from the list
+    if ((clock_->now() - obs_it->cloud->header.stamp) > observation_keep_time_) {
+      observation_list_.erase(obs_it, observation_list_.end());
+      return;
+    }
+  }
+}
+
+bool ObservationStore::isCurrent() const
+{
+  if (expected_update_rate_ == rclcpp::Duration(0, 0)) {
+    return true;
+  }
+
+  bool current = (clock_->now() - last_updated_) <= expected_update_rate_;
+  if (!current) {
+    RCLCPP_WARN(
+      logger_,
+      "The %s observation buffer has not been updated for %.2f seconds, "
+      "and it should be updated every %.2f seconds.",
+      topic_name_.c_str(), (clock_->now() - last_updated_).seconds(),
+      expected_update_rate_.seconds());
+  }
+  return current;
+}
+
+void ObservationStore::resetLastUpdated() { last_updated_ = clock_->now(); }
+
+}  // namespace pb_nav2_costmap_2d
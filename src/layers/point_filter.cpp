@@ -0,0 +1,299 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pb_nav2_plugins/layers/point_filter.hpp"
+
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PB_NAV2_POINT_FILTER_X86
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PB_NAV2_POINT_FILTER_NEON
+#endif
+
+namespace pb_nav2_costmap_2d
+{
+
+namespace
+{
+
+/**
+ * @brief Append base + lane for every set bit of mask without branching on the bits
+ */
+inline size_t compact(uint32_t mask, uint32_t base, uint32_t lanes, uint32_t * out, size_t n)
+{
+  for (uint32_t lane = 0; lane < lanes; ++lane) {
+    out[n] = base + lane;
+    n += (mask >> lane) & 1u;
+  }
+  return n;
+}
+
+inline size_t filterScalar(
+  const PointBlock & block, const PointFilterParams & params, size_t begin, uint32_t * survivors,
+  size_t n)
+{
+  for (size_t i = begin; i < block.size; ++i) {
+    float dx = block.x[i] - params.origin_x;
+    float dy = block.y[i] - params.origin_y;
+    float dz = block.z[i] - params.origin_z;
+    float sq_dist = dx * dx + dy * dy + dz * dz;
+    bool reject = !(block.z[i] >= params.min_height) | !(block.z[i] <= params.max_height) |
+                  (block.intensity[i] < params.min_intensity) |
+                  (block.intensity[i] > params.max_intensity) |
+                  (sq_dist >= params.sq_max_range) | (sq_dist < params.sq_min_range);
+    survivors[n] = static_cast<uint32_t>(i);
+    n += !reject;
+  }
+  return n;
+}
+
+#ifdef PB_NAV2_POINT_FILTER_X86
+__attribute__((target("avx2"))) size_t filterAvx2(
+  const PointBlock & block, const PointFilterParams & params, uint32_t * survivors)
+{
+  const __m256 min_z = _mm256_set1_ps(params.min_height);
+  const __m256 max_z = _mm256_set1_ps(params.max_height);
+  const __m256 min_i = _mm256_set1_ps(params.min_intensity);
+  const __m256 max_i = _mm256_set1_ps(params.max_intensity);
+  const __m256 ox = _mm256_set1_ps(params.origin_x);
+  const __m256 oy = _mm256_set1_ps(params.origin_y);
+  const __m256 oz = _mm256_set1_ps(params.origin_z);
+  const __m256 sq_min = _mm256_set1_ps(params.sq_min_range);
+  const __m256 sq_max = _mm256_set1_ps(params.sq_max_range);
+
+  size_t n = 0;
+  size_t i = 0;
+  for (; i + 8 <= block.size; i += 8) {
+    __m256 z = _mm256_load_ps(block.z + i);
+    __m256 dx = _mm256_sub_ps(_mm256_load_ps(block.x + i), ox);
+    __m256 dy = _mm256_sub_ps(_mm256_load_ps(block.y + i), oy);
+    __m256 dz = _mm256_sub_ps(z, oz);
+    __m256 sq_dist = _mm256_add_ps(
+      _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+    __m256 intensity = _mm256_load_ps(block.intensity + i);
+
+    __m256 reject = _mm256_or_ps(
+      _mm256_cmp_ps(intensity, min_i, _CMP_LT_OQ), _mm256_cmp_ps(intensity, max_i, _CMP_GT_OQ));
+    reject = _mm256_or_ps(reject, _mm256_cmp_ps(sq_dist, sq_max, _CMP_GE_OQ));
+    reject = _mm256_or_ps(reject, _mm256_cmp_ps(sq_dist, sq_min, _CMP_LT_OQ));
+    reject = _mm256_or_ps(reject, _mm256_cmp_ps(z, min_z, _CMP_NGE_UQ));
+    reject = _mm256_or_ps(reject, _mm256_cmp_ps(z, max_z, _CMP_NLE_UQ));
+
+    uint32_t keep = ~static_cast<uint32_t>(_mm256_movemask_ps(reject)) & 0xffu;
+    n = compact(keep, static_cast<uint32_t>(i), 8, survivors, n);
+  }
+  return filterScalar(block, params, i, survivors, n);
+}
+
+size_t filterSse2(const PointBlock & block, const PointFilterParams & params, uint32_t * survivors)
+{
+  const __m128 min_z = _mm_set1_ps(params.min_height);
+  const __m128 max_z = _mm_set1_ps(params.max_height);
+  const __m128 min_i = _mm_set1_ps(params.min_intensity);
+  const __m128 max_i = _mm_set1_ps(params.max_intensity);
+  const __m128 ox = _mm_set1_ps(params.origin_x);
+  const __m128 oy = _mm_set1_ps(params.origin_y);
+  const __m128 oz = _mm_set1_ps(params.origin_z);
+  const __m128 sq_min = _mm_set1_ps(params.sq_min_range);
+  const __m128 sq_max = _mm_set1_ps(params.sq_max_range);
+
+  size_t n = 0;
+  size_t i = 0;
+  for (; i + 4 <= block.size; i += 4) {
+    __m128 z = _mm_load_ps(block.z + i);
+    __m128 dx = _mm_sub_ps(_mm_load_ps(block.x + i), ox);
+    __m128 dy = _mm_sub_ps(_mm_load_ps(block.y + i), oy);
+    __m128 dz = _mm_sub_ps(z, oz);
+    __m128 sq_dist =
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    __m128 intensity = _mm_load_ps(block.intensity + i);
+
+    __m128 reject = _mm_or_ps(_mm_cmplt_ps(intensity, min_i), _mm_cmpgt_ps(intensity, max_i));
+    reject = _mm_or_ps(reject, _mm_cmpge_ps(sq_dist, sq_max));
+    reject = _mm_or_ps(reject, _mm_cmplt_ps(sq_dist, sq_min));
+    reject = _mm_or_ps(reject, _mm_cmpnge_ps(z, min_z));
+    reject = _mm_or_ps(reject, _mm_cmpnle_ps(z, max_z));
+
+    uint32_t keep = ~static_cast<uint32_t>(_mm_movemask_ps(reject)) & 0xfu;
+    n = compact(keep, static_cast<uint32_t>(i), 4, survivors, n);
+  }
+  return filterScalar(block, params, i, survivors, n);
+}
+#endif  // PB_NAV2_POINT_FILTER_X86
+
+#ifdef PB_NAV2_POINT_FILTER_NEON
+size_t filterNeon(const PointBlock & block, const PointFilterParams & params, uint32_t * survivors)
+{
+  const float32x4_t min_z = vdupq_n_f32(params.min_height);
+  const float32x4_t max_z = vdupq_n_f32(params.max_height);
+  const float32x4_t min_i = vdupq_n_f32(params.min_intensity);
+  const float32x4_t max_i = vdupq_n_f32(params.max_intensity);
+  const float32x4_t ox = vdupq_n_f32(params.origin_x);
+  const float32x4_t oy = vdupq_n_f32(params.origin_y);
+  const float32x4_t oz = vdupq_n_f32(params.origin_z);
+  const float32x4_t sq_min = vdupq_n_f32(params.sq_min_range);
+  const float32x4_t sq_max = vdupq_n_f32(params.sq_max_range);
+  static const uint32_t LANE_BITS[4] = {1u, 2u, 4u, 8u};
+  const uint32x4_t lane_bits = vld1q_u32(LANE_BITS);
+
+  size_t n = 0;
+  size_t i = 0;
+  for (; i + 4 <= block.size; i += 4) {
+    float32x4_t z = vld1q_f32(block.z + i);
+    float32x4_t dx = vsubq_f32(vld1q_f32(block.x + i), ox);
+    float32x4_t dy = vsubq_f32(vld1q_f32(block.y + i), oy);
+    float32x4_t dz = vsubq_f32(z, oz);
+    float32x4_t sq_dist = vmlaq_f32(vmlaq_f32(vmulq_f32(dx, dx), dy, dy), dz, dz);
+    float32x4_t intensity = vld1q_f32(block.intensity + i);
+
+    uint32x4_t reject = vorrq_u32(vcltq_f32(intensity, min_i), vcgtq_f32(intensity, max_i));
+    reject = vorrq_u32(reject, vcgeq_f32(sq_dist, sq_max));
+    reject = vorrq_u32(reject, vcltq_f32(sq_dist, sq_min));
+    // a NaN height fails both ordered comparisons, so the window is checked as keep and inverted
+    uint32x4_t in_height = vandq_u32(vcgeq_f32(z, min_z), vcleq_f32(z, max_z));
+    reject = vorrq_u32(reject, vmvnq_u32(in_height));
+
+    uint32_t keep = vaddvq_u32(vandq_u32(vmvnq_u32(reject), lane_bits));
+    n = compact(keep, static_cast<uint32_t>(i), 4, survivors, n);
+  }
+  return filterScalar(block, params, i, survivors, n);
+}
+#endif  // PB_NAV2_POINT_FILTER_NEON
+
+/**
+ * @brief Smallest float that is not below value
+ */
+inline float floatNotBelow(double value)
+{
+  float f = static_cast<float>(value);
+  if (static_cast<double>(f) < value) {
+    f = std::nextafter(f, std::numeric_limits<float>::infinity());
+  }
+  return f;
+}
+
+/**
+ * @brief Largest float that is not above value
+ */
+inline float floatNotAbove(double value)
+{
+  float f = static_cast<float>(value);
+  if (static_cast<double>(f) > value) {
+    f = std::nextafter(f, -std::numeric_limits<float>::infinity());
+  }
+  return f;
+}
+
+}  // namespace
+
+PointFilterParams makePointFilterParams(
+  double min_height, double max_height, double min_intensity, double max_intensity,
+  double origin_x, double origin_y, double origin_z, double min_range, double max_range)
+{
+  PointFilterParams params;
+  params.min_height = floatNotBelow(min_height);
+  params.max_height = floatNotAbove(max_height);
+  params.min_intensity = floatNotBelow(min_intensity);
+  params.max_intensity = floatNotAbove(max_intensity);
+  params.origin_x = static_cast<float>(origin_x);
+  params.origin_y = static_cast<float>(origin_y);
+  params.origin_z = static_cast<float>(origin_z);
+  params.sq_min_range = static_cast<float>(min_range * min_range);
+  params.sq_max_range = static_cast<float>(max_range * max_range);
+  return params;
+}
+
+void transformPointBlock(PointBlock & block, const PointTransform & transform)
+{
+  if (transform.identity) {
+    return;
+  }
+  const float * r = transform.rotation;
+  const float * t = transform.translation;
+  for (size_t i = 0; i < block.size; ++i) {
+    const float x = block.x[i], y = block.y[i], z = block.z[i];
+    block.x[i] = r[0] * x + r[1] * y + r[2] * z + t[0];
+    block.y[i] = r[3] * x + r[4] * y + r[5] * z + t[1];
+    block.z[i] = r[6] * x + r[7] * y + r[8] * z + t[2];
+  }
+}
+
+size_t filterPointBlock(
+  const PointBlock & block, const PointFilterParams & params, uint32_t * survivors)
+{
+#if defined(PB_NAV2_POINT_FILTER_X86)
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  if (has_avx2) {
+    return filterAvx2(block, params, survivors);
+  }
+  return filterSse2(block, params, survivors);
+#elif defined(PB_NAV2_POINT_FILTER_NEON)
+  return filterNeon(block, params, survivors);
+#else
+  return filterScalar(block, params, 0, survivors, 0);
+#endif
+}
+
+size_t projectToCells(
+  const PointBlock & block, const uint32_t * survivors, size_t num_survivors,
+  const MapGeometry & map, unsigned int * cells)
+{
+  size_t n = 0;
+  for (size_t k = 0; k < num_survivors; ++k) {
+    const uint32_t i = survivors[k];
+    const double wx = block.x[i];
+    const double wy = block.y[i];
+    if (wx < map.origin_x || wy < map.origin_y) {
+      continue;
+    }
+    const unsigned int mx = static_cast<unsigned int>((wx - map.origin_x) / map.resolution);
+    const unsigned int my = static_cast<unsigned int>((wy - map.origin_y) / map.resolution);
+    if (mx < map.size_x && my < map.size_y) {
+      cells[n++] = my * map.size_x + mx;
+    }
+  }
+  return n;
+}
+
+size_t selectAllPoints(const PointBlock & block, uint32_t * survivors)
+{
+  for (size_t i = 0; i < block.size; ++i) {
+    survivors[i] = static_cast<uint32_t>(i);
+  }
+  return block.size;
+}
+
+void appendSurvivors(
+  const PointBlock & block, const uint32_t * survivors, size_t num_survivors,
+  std::vector<PointBlock> & blocks)
+{
+  for (size_t k = 0; k < num_survivors; ++k) {
+    if (blocks.empty() || blocks.back().size == PointBlock::CAPACITY) {
+      blocks.emplace_back();
+    }
+    PointBlock & packed = blocks.back();
+    const uint32_t i = survivors[k];
+    packed.x[packed.size] = block.x[i];
+    packed.y[packed.size] = block.y[i];
+    packed.z[packed.size] = block.z[i];
+    packed.intensity[packed.size] = block.intensity[i];
+    ++packed.size;
+  }
+}
+
+}  // namespace pb_nav2_costmap_2d
@@ -0,0 +1,127 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pb_nav2_plugins/layers/shared_observation_cache.hpp"
+
+#include <initializer_list>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace pb_nav2_costmap_2d
+{
+
+std::shared_ptr<SharedObservationCache> SharedObservationCache::forKey(const std::string & key)
+{
+  // one registry per process, the layers of every costmap loaded into it see the same one
+  static std::mutex registry_mutex;
+  static std::map<std::string, std::weak_ptr<SharedObservationCache>> registry;
+
+  std::lock_guard<std::mutex> guard(registry_mutex);
+  for (auto it = registry.begin(); it != registry.end();) {
+    it = it->second.expired() ? registry.erase(it) : std::next(it);
+  }
+
+  std::weak_ptr<SharedObservationCache> & slot = registry[key];
+  std::shared_ptr<SharedObservationCache> cache = slot.lock();
+  if (!cache) {
+    cache = std::make_shared<SharedObservationCache>();
+    slot = cache;
+  }
+  return cache;
+}
+
+std::string SharedObservationCache::makeKey(
+  const std::string & kind, const std::string & topic, const std::string & global_frame,
+  const std::string & sensor_frame, double min_obstacle_height, double max_obstacle_height,
+  double obstacle_max_range, double obstacle_min_range, double raytrace_max_range,
+  double raytrace_min_range)
+{
+  std::string key = kind + "|" + topic + "|" + global_frame + "|" + sensor_frame;
+  for (const double value :
+    {min_obstacle_height, max_obstacle_height, obstacle_max_range, obstacle_min_range,
+      raytrace_max_range, raytrace_min_range})
+  {
+    key += "|" + std::to_string(value);
+  }
+  return key;
+}
+
+bool SharedObservationCache::sameMessage(
+  const Entry & entry, const sensor_msgs::msg::PointCloud2 & cloud)
+{
+  return entry.stamp == cloud.header.stamp &&
+         entry.num_points == static_cast<uint64_t>(cloud.width) * cloud.height &&
+         entry.frame_id == cloud.header.frame_id;
+}
+
+bool SharedObservationCache::find(
+  const sensor_msgs::msg::PointCloud2 & cloud, const Needs & needs, StoredObservation & obs) const
+{
+  for (const Entry & entry : entries_) {
+    if (!sameMessage(entry, cloud)) {
+      continue;
+    }
+    auto shared_cloud = entry.cloud.lock();
+    if (!shared_cloud) {
+      return false;
+    }
+    // a layer that prepares no clouds takes the prepared points of another one all the same
+    auto prepared = entry.prepared.lock();
+    if (
+      needs.prepared &&
+      (!prepared || (needs.clearing && !prepared->clearing) ||
+      (needs.marking &&
+      (!prepared->marking || prepared->min_intensity != needs.min_intensity ||
+      prepared->max_intensity != needs.max_intensity))))
+    {
+      return false;
+    }
+    obs = entry.observation;
+    obs.cloud = shared_cloud;
+    obs.prepared = prepared;
+    return true;
+  }
+  return false;
+}
+
+void SharedObservationCache::insert(
+  const sensor_msgs::msg::PointCloud2 & cloud, const StoredObservation & obs)
+{
+  // a message built again for other needs replaces its old entry
+  size_t slot = next_;
+  for (size_t i = 0; i < HISTORY; ++i) {
+    if (sameMessage(entries_[i], cloud)) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot == next_) {
+    next_ = (next_ + 1) % HISTORY;
+  }
+
+  Entry & entry = entries_[slot];
+  entry.stamp = cloud.header.stamp;
+  entry.frame_id = cloud.header.frame_id;
+  entry.num_points = static_cast<uint64_t>(cloud.width) * cloud.height;
+  entry.observation = obs;
+  entry.observation.cloud.reset();
+  entry.observation.prepared.reset();
+  entry.cloud = obs.cloud;
+  entry.prepared = obs.prepared;
+}
+
+}  // namespace pb_nav2_costmap_2d
@@ -0,0 +1,319 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pb_nav2_plugins/layers/tiled_voxel_grid.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace pb_nav2_costmap_2d
+{
+
+namespace
+{
+
+/// @brief A VoxelGrid column with every level unknown, as VoxelGrid::reset leaves it
+constexpr uint32_t UNKNOWN_COLUMN = ~0u >> 16;
+
+inline int sign(int x) { return x > 0 ? 1 : (x < 0 ? -1 : 0); }
+
+/// @brief The bits of the levels below size_z
+inline uint64_t levelMask(unsigned int size_z)
+{
+  return size_z >= 64 ? ~uint64_t{0} : (uint64_t{1} << size_z) - 1;
+}
+
+inline bool bitsBelowThreshold(uint64_t bits, unsigned int threshold)
+{
+  return static_cast<unsigned int>(__builtin_popcountll(bits)) <= threshold;
+}
+
+/**
+ * @brief VoxelGrid::raytraceLine, stepping cell coordinates instead of an offset and a z mask
+ * @param visit Callable taking (x, y, z), called for every voxel on the line
+ */
+template<typename Visit>
+void traceLine(
+  Visit && visit, double x0, double y0, double z0, double x1, double y1, double z1,
+  unsigned int max_length, unsigned int min_length)
+{
+  double dist = std::sqrt((x0 - x1) * (x0 - x1) + (y0 - y1) * (y0 - y1) + (z0 - z1) * (z0 - z1));
+  if ((unsigned int)(dist) < min_length) {
+    return;
+  }
+  double scale, min_x0, min_y0, min_z0;
+  if (dist > 0.0) {
+    scale = std::min(1.0, max_length / dist);
+
+    // Updating starting point to the point at distance min_length from the initial point
+    min_x0 = x0 + (x1 - x0) / dist * min_length;
+    min_y0 = y0 + (y1 - y0) / dist * min_length;
+    min_z0 = z0 + (z1 - z0) / dist * min_length;
+  } else {
+    // dist can be 0 if [x0, y0, z0]==[x1, y1, z1].
+    // In this case only this voxel should be processed.
+    scale = 1.0;
+    min_x0 = x0;
+    min_y0 = y0;
+    min_z0 = z0;
+  }
+
+  const int delta[3] = {
+    int(x1) - int(min_x0), int(y1) - int(min_y0), int(z1) - int(min_z0)};  // NOLINT
+  unsigned int pos[3] = {
+    (unsigned int)min_x0, (unsigned int)min_y0, (unsigned int)min_z0};  // NOLINT
+
+  // the dominant axis is picked in the same order as VoxelGrid: x, then y, then z
+  const unsigned int abs_d[3] = {
+    (unsigned int)std::abs(delta[0]), (unsigned int)std::abs(delta[1]),
+    (unsigned int)std::abs(delta[2])};
+  unsigned int a, b, c;
+  if (abs_d[0] >= std::max(abs_d[1], abs_d[2])) {
+    a = 0, b = 1, c = 2;
+  } else if (abs_d[1] >= abs_d[2]) {
+    a = 1, b = 0, c = 2;
+  } else {
+    a = 2, b = 0, c = 1;
+  }
+
+  int error_b = abs_d[a] / 2;
+  int error_c = abs_d[a] / 2;
+  const unsigned int end = std::min((unsigned int)(scale * abs_d[a]), abs_d[a]);
+  for (unsigned int i = 0; i < end; ++i) {
+    visit(pos[0], pos[1], pos[2]);
+    pos[a] += sign(delta[a]);
+    error_b += abs_d[b];
+    error_c += abs_d[c];
+    if ((unsigned int)error_b >= abs_d[a]) {
+      pos[b] += sign(delta[b]);
+      error_b -= abs_d[a];
+    }
+    if ((unsigned int)error_c >= abs_d[a]) {
+      pos[c] += sign(delta[c]);
+      error_c -= abs_d[a];
+    }
+  }
+  visit(pos[0], pos[1], pos[2]);
+}
+
+}  // namespace
+
+void TiledVoxelGrid::resize(unsigned int size_x, unsigned int size_y, unsigned int size_z)
+{
+  size_x_ = size_x;
+  size_y_ = size_y;
+  size_z_ = std::min(size_z, MAX_LEVELS);
+  tiles_x_ = (size_x_ + TILE_SIZE - 1) >> TILE_SHIFT;
+  tiles_y_ = (size_y_ + TILE_SIZE - 1) >> TILE_SHIFT;
+  tiles_.clear();
+  tiles_.resize(static_cast<size_t>(tiles_x_) * tiles_y_);
+  allocated_tiles_ = 0;
+}
+
+void TiledVoxelGrid::reset()
+{
+  for (auto & tile : tiles_) {
+    tile.reset();
+  }
+  allocated_tiles_ = 0;
+}
+
+TiledVoxelGrid::Tile & TiledVoxelGrid::tileAt(unsigned int x, unsigned int y)
+{
+  std::unique_ptr<Tile> & tile = tiles_[tileIndex(x, y)];
+  if (!tile) {
+    // value-initialized, so every column starts in the default state
+    tile = std::make_unique<Tile>();
+    ++allocated_tiles_;
+  }
+  return *tile;
+}
+
+void TiledVoxelGrid::markVoxel(unsigned int x, unsigned int y, unsigned int z)
+{
+  if (x >= size_x_ || y >= size_y_ || z >= size_z_) {
+    return;
+  }
+  Tile & tile = tileAt(x, y);
+  Column & column = tile.columns[columnIndex(x, y)];
+  if (!column.marked && !column.seen) {
+    ++tile.used_columns;
+  }
+  const uint64_t bit = uint64_t{1} << z;
+  column.marked |= bit;
+  column.seen |= bit;
+}
+
+unsigned int TiledVoxelGrid::markedCount(unsigned int index) const
+{
+  const unsigned int x = index % size_x_;
+  const unsigned int y = index / size_x_;
+  const std::unique_ptr<Tile> & tile = tiles_[tileIndex(x, y)];
+  if (!tile) {
+    return 0;
+  }
+  return __builtin_popcountll(tile->columns[columnIndex(x, y)].marked);
+}
+
+void TiledVoxelGrid::clearVoxel(
+  unsigned int x, unsigned int y, unsigned int z, unsigned char * map_2d,
+  unsigned int unknown_threshold, unsigned int mark_threshold, unsigned char free_cost,
+  unsigned char unknown_cost)
+{
+  // the voxel is seen free from now on, so even a missing tile is allocated to remember that
+  Tile & tile = tileAt(x, y);
+  Column & column = tile.columns[columnIndex(x, y)];
+  if (!column.marked && !column.seen) {
+    ++tile.used_columns;
+  }
+  const uint64_t bit = uint64_t{1} << z;
+  column.marked &= ~bit;
+  column.seen |= bit;
+
+  // make sure the number of bits in each is below our thesholds
+  if (bitsBelowThreshold(column.marked, mark_threshold)) {
+    const unsigned int offset = y * size_x_ + x;
+    if (unknownCount(column) <= unknown_threshold) {
+      map_2d[offset] = free_cost;
+    } else {
+      map_2d[offset] = unknown_cost;
+    }
+  }
+}
+
+void TiledVoxelGrid::clearVoxelLineInMap(
+  double x0, double y0, double z0, double x1, double y1, double z1, unsigned char * map_2d,
+  unsigned int unknown_threshold, unsigned int mark_threshold, unsigned char free_cost,
+  unsigned char unknown_cost, unsigned int max_length, unsigned int min_length)
+{
+  traceLine(
+    [&](unsigned int x, unsigned int y, unsigned int z) {
+      clearVoxel(x, y, z, map_2d, unknown_threshold, mark_threshold, free_cost, unknown_cost);
+    },
+    x0, y0, z0, x1, y1, z1, max_length, min_length);
+}
+
+void TiledVoxelGrid::shift(int shift_x, int shift_y)
+{
+  std::vector<std::unique_ptr<Tile>> old_tiles(tiles_.size());
+  old_tiles.swap(tiles_);
+  allocated_tiles_ = 0;
+
+  for (unsigned int ty = 0; ty < tiles_y_; ++ty) {
+    for (unsigned int tx = 0; tx < tiles_x_; ++tx) {
+      const std::unique_ptr<Tile> & tile = old_tiles[static_cast<size_t>(ty) * tiles_x_ + tx];
+      if (!tile || tile->used_columns == 0) {
+        continue;
+      }
+      for (unsigned int i = 0; i < TILE_SIZE * TILE_SIZE; ++i) {
+        const Column & column = tile->columns[i];
+        if (!column.marked && !column.seen) {
+          continue;
+        }
+        // the column at (x, y) moves to (x - shift_x, y - shift_y)
+        const int x = static_cast<int>((tx << TILE_SHIFT) | (i & (TILE_SIZE - 1))) - shift_x;
+        const int y = static_cast<int>((ty << TILE_SHIFT) | (i >> TILE_SHIFT)) - shift_y;
+        if (x < 0 || y < 0 || x >= static_cast<int>(size_x_) || y >= static_cast<int>(size_y_)) {
+          continue;
+        }
+        Tile & target = tileAt(x, y);
+        target.columns[columnIndex(x, y)] = column;
+        ++target.used_columns;
+      }
+    }
+  }
+}
+
+void TiledVoxelGrid::remapLevels(const VerticalRemap & remap, unsigned int size_z)
+{
+  size_z_ = std::min(size_z, MAX_LEVELS);
+  for (auto & tile : tiles_) {
+    if (!tile || tile->used_columns == 0) {
+      continue;
+    }
+    unsigned int used_columns = 0;
+    for (Column & column : tile->columns) {
+      column.marked = remap.remapBits(column.marked);
+      column.seen = remap.remapBits(column.seen);
+      used_columns += column.marked || column.seen;
+    }
+    tile->used_columns = used_columns;
+  }
+}
+
+size_t TiledVoxelGrid::releaseEmptyTiles()
+{
+  size_t released = 0;
+  for (auto & tile : tiles_) {
+    if (tile && tile->used_columns == 0) {
+      tile.reset();
+      ++released;
+    }
+  }
+  allocated_tiles_ -= released;
+  return released;
+}
+
+void TiledVoxelGrid::toVoxelGridData(
+  uint32_t * data, unsigned int x0, unsigned int y0, unsigned int width,
+  unsigned int height) const
+{
+  const unsigned int x_end = x0 + width;
+  for (unsigned int y = y0; y < y0 + height; ++y) {
+    uint32_t * row = data + static_cast<size_t>(y - y0) * width;
+    // walk the row one tile at a time so missing tiles are filled in one go
+    for (unsigned int x_begin = x0; x_begin < x_end;) {
+      const unsigned int tile_end = std::min(((x_begin >> TILE_SHIFT) + 1) << TILE_SHIFT, x_end);
+      const std::unique_ptr<Tile> & tile = tiles_[tileIndex(x_begin, y)];
+      if (!tile) {
+        std::fill(row + (x_begin - x0), row + (tile_end - x0), UNKNOWN_COLUMN);
+      } else {
+        // a marked level keeps its low bit, an unknown one sets it alone
+        for (unsigned int x = x_begin; x < tile_end; ++x) {
+          const Column & column = tile->columns[columnIndex(x, y)];
+          row[x - x0] = (static_cast<uint32_t>(column.marked & 0xffff) << 16) |
+                        static_cast<uint32_t>((column.marked | ~column.seen) & 0xffff);
+        }
+      }
+      x_begin = tile_end;
+    }
+  }
+}
+
+void TiledVoxelGrid::fromVoxelGridData(const uint32_t * data)
+{
+  reset();
+  for (unsigned int y = 0; y < size_y_; ++y) {
+    for (unsigned int x = 0; x < size_x_; ++x) {
+      const uint32_t value = data[static_cast<size_t>(y) * size_x_ + x];
+      const uint64_t marked = value >> 16;
+      // a level is unknown when only its low bit is set
+      const uint64_t seen = (marked | ~value) & 0xffff & levelMask(size_z_);
+      if (!marked && !seen) {
+        continue;
+      }
+      Tile & tile = tileAt(x, y);
+      Column & column = tile.columns[columnIndex(x, y)];
+      column.marked = marked;
+      column.seen = seen;
+      ++tile.used_columns;
+    }
+  }
+}
+
+}  // namespace pb_nav2_costmap_2d
@@ -0,0 +1,466 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cuda_runtime.h>
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "pb_nav2_plugins/layers/voxel_gpu_backend.hpp"
+
+namespace pb_nav2_costmap_2d
+{
+
+namespace
+{
+
+constexpr unsigned int THREADS_PER_BLOCK = 256;
+/// @brief The column VoxelGrid::reset fills in, with every level unknown
+constexpr uint32_t UNKNOWN_COLUMN = ~0u >> 16;
+
+inline unsigned int numBlocks(size_t num_threads)
+{
+  return static_cast<unsigned int>((num_threads + THREADS_PER_BLOCK - 1) / THREADS_PER_BLOCK);
+}
+
+void check(cudaError_t status, const char * what)
+{
+  if (status != cudaSuccess) {
+    throw std::runtime_error{std::string(what) + ": " + cudaGetErrorString(status)};
+  }
+}
+
+__device__ inline int sign(int x) { return x > 0 ? 1 : (x < 0 ? -1 : 0); }
+
+__device__ inline bool bitsBelowThreshold(unsigned int bits, unsigned int threshold)
+{
+  return static_cast<unsigned int>(__popc(bits)) <= threshold;
+}
+
+/**
+ * @brief VoxelGrid::raytraceLine of one ray, clearing both halves of every voxel on the line
+ *
+ * Every column it passes is flagged, so the costmap cell is decided once all rays are traced.
+ */
+__device__ void clearLine(
+  uint32_t * columns, uint8_t * touched, unsigned int size_x, double x0, double y0, double z0,
+  double x1, double y1, double z1, unsigned int max_length, unsigned int min_length)
+{
+  double dist = sqrt((x0 - x1) * (x0 - x1) + (y0 - y1) * (y0 - y1) + (z0 - z1) * (z0 - z1));
+  if ((unsigned int)(dist) < min_length) {
+    return;
+  }
+  double scale, min_x0, min_y0, min_z0;
+  if (dist > 0.0) {
+    scale = fmin(1.0, max_length / dist);
+
+    // Updating starting point to the point at distance min_length from the initial point
+    min_x0 = x0 + (x1 - x0) / dist * min_length;
+    min_y0 = y0 + (y1 - y0) / dist * min_length;
+    min_z0 = z0 + (z1 - z0) / dist * min_length;
+  } else {
+    // only the voxel of the sensor is cleared
+    scale = 1.0;
+    min_x0 = x0;
+    min_y0 = y0;
+    min_z0 = z0;
+  }
+
+  const int delta[3] = {
+    int(x1) - int(min_x0), int(y1) - int(min_y0), int(z1) - int(min_z0)};  // NOLINT
+  unsigned int pos[3] = {
+    (unsigned int)min_x0, (unsigned int)min_y0, (unsigned int)min_z0};  // NOLINT
+
+  // the dominant axis is picked in the same order as VoxelGrid: x, then y, then z
+  const unsigned int abs_d[3] = {
+    (unsigned int)abs(delta[0]), (unsigned int)abs(delta[1]), (unsigned int)abs(delta[2])};
+  unsigned int a, b, c;
+  if (abs_d[0] >= max(abs_d[1], abs_d[2])) {
+    a = 0, b = 1, c = 2;
+  } else if (abs_d[1] >= abs_d[2]) {
+    a = 1, b = 0, c = 2;
+  } else {
+    a = 2, b = 0, c = 1;
+  }
+
+  auto clear = [&]() {
+    const unsigned int index = pos[1] * size_x + pos[0];
+    atomicAnd(&columns[index], ~(((1u << 16) | 1u) << pos[2]));
+    touched[index] = 1;
+  };
+
+  int error_b = abs_d[a] / 2;
+  int error_c = abs_d[a] / 2;
+  const unsigned int end = min((unsigned int)(scale * abs_d[a]), abs_d[a]);
+  for (unsigned int i = 0; i < end; ++i) {
+    clear();
+    pos[a] += sign(delta[a]);
+    error_b += abs_d[b];
+    error_c += abs_d[c];
+    if ((unsigned int)error_b >= abs_d[a]) {
+      pos[b] += sign(delta[b]);
+      error_b -= abs_d[a];
+    }
+    if ((unsigned int)error_c >= abs_d[a]) {
+      pos[c] += sign(delta[c]);
+      error_c -= abs_d[a];
+    }
+  }
+  clear();
+}
+
+__global__ void clearLinesKernel(
+  uint32_t * columns, uint8_t * touched, unsigned int size_x, double x0, double y0, double z0,
+  const VoxelGpuBackend::Endpoint * endpoints, size_t num_endpoints, unsigned int max_length,
+  unsigned int min_length)
+{
+  const size_t i = static_cast<size_t>(blockIdx.x) * blockDim.x + threadIdx.x;
+  if (i >= num_endpoints) {
+    return;
+  }
+  const VoxelGpuBackend::Endpoint end = endpoints[i];
+  clearLine(columns, touched, size_x, x0, y0, z0, end.x, end.y, end.z, max_length, min_length);
+}
+
+/**
+ * @brief Decide the costmap cells of the traced columns of a band of rows and unflag them
+ */
+__global__ void collectClearedKernel(
+  const uint32_t * columns, uint8_t * touched, unsigned int base, size_t band,
+  unsigned int unknown_threshold, unsigned int mark_threshold, unsigned char free_cost,
+  unsigned char unknown_cost, VoxelGpuBackend::CellUpdate * updates, unsigned int * num_updates)
+{
+  const size_t i = static_cast<size_t>(blockIdx.x) * blockDim.x + threadIdx.x;
+  if (i >= band || !touched[base + i]) {
+    return;
+  }
+  touched[base + i] = 0;
+
+  const uint32_t column = columns[base + i];
+  const unsigned int unknown_bits = uint16_t(column >> 16) ^ uint16_t(column);
+  const unsigned int marked_bits = column >> 16;
+  if (!bitsBelowThreshold(marked_bits, mark_threshold)) {
+    return;
+  }
+  const unsigned int slot = atomicAdd(num_updates, 1u);
+  updates[slot].index = static_cast<uint32_t>(base + i);
+  updates[slot].cost =
+    bitsBelowThreshold(unknown_bits, unknown_threshold) ? free_cost : unknown_cost;
+}
+
+__global__ void markVoxelsKernel(
+  uint32_t * columns, unsigned int size_x, unsigned int size_y, unsigned int size_z,
+  const VoxelMark * voxels, size_t num_voxels)
+{
+  const size_t i = static_cast<size_t>(blockIdx.x) * blockDim.x + threadIdx.x;
+  if (i >= num_voxels) {
+    return;
+  }
+  const VoxelMark voxel = voxels[i];
+  if (voxel.mx >= size_x || voxel.my >= size_y || voxel.mz >= size_z) {
+    return;
+  }
+  atomicOr(&columns[voxel.my * size_x + voxel.mx], ((1u << 16) | 1u) << voxel.mz);
+}
+
+__global__ void checkColumnsKernel(
+  const uint32_t * columns, const unsigned int * indices, size_t num_indices,
+  unsigned int mark_threshold, uint8_t * occupied)
+{
+  const size_t i = static_cast<size_t>(blockIdx.x) * blockDim.x + threadIdx.x;
+  if (i >= num_indices) {
+    return;
+  }
+  occupied[i] = !bitsBelowThreshold(columns[indices[i]] >> 16, mark_threshold);
+}
+
+/**
+ * @brief shiftMapInPlace into a second buffer, one thread per target column
+ */
+__global__ void shiftKernel(
+  const uint32_t * source, uint32_t * target, unsigned int size_x, unsigned int size_y,
+  int shift_x, int shift_y)
+{
+  const size_t i = static_cast<size_t>(blockIdx.x) * blockDim.x + threadIdx.x;
+  if (i >= static_cast<size_t>(size_x) * size_y) {
+    return;
+  }
+  const int x = static_cast<int>(i % size_x) + shift_x;
+  const int y = static_cast<int>(i / size_x) + shift_y;
+  const bool inside =
+    x >= 0 && y >= 0 && x < static_cast<int>(size_x) && y < static_cast<int>(size_y);
+  target[i] = inside ? source[static_cast<size_t>(y) * size_x + x] : UNKNOWN_COLUMN;
+}
+
+/**
+ * @brief Set every column to value, cudaMemset only repeats single bytes
+ */
+__global__ void fillKernel(uint32_t * columns, size_t num_columns, uint32_t value)
+{
+  const size_t i = static_cast<size_t>(blockIdx.x) * blockDim.x + threadIdx.x;
+  if (i < num_columns) {
+    columns[i] = value;
+  }
+}
+
+/**
+ * @brief Device buffer that grows on demand and is freed with its owner
+ */
+template<typename T>
+class DeviceBuffer
+{
+public:
+  DeviceBuffer() = default;
+  DeviceBuffer(const DeviceBuffer &) = delete;
+  DeviceBuffer & operator=(const DeviceBuffer &) = delete;
+  ~DeviceBuffer() { cudaFree(data_); }
+
+  /**
+   * @brief Make room for at least size elements, the contents are lost when it grows
+   */
+  void reserve(size_t size)
+  {
+    if (size <= capacity_) {
+      return;
+    }
+    cudaFree(data_);
+    data_ = nullptr;
+    capacity_ = 0;
+    check(cudaMalloc(&data_, size * sizeof(T)), "cudaMalloc");
+    capacity_ = size;
+  }
+
+  void swap(DeviceBuffer & other)
+  {
+    std::swap(data_, other.data_);
+    std::swap(capacity_, other.capacity_);
+  }
+
+  T * get() const { return data_; }
+
+private:
+  T * data_ = nullptr;
+  size_t capacity_ = 0;
+};
+
+class CudaVoxelBackend : public VoxelGpuBackend
+{
+public:
+  CudaVoxelBackend() { check(cudaStreamCreate(&stream_), "cudaStreamCreate"); }
+  ~CudaVoxelBackend() override { cudaStreamDestroy(stream_); }
+
+  void resize(unsigned int size_x, unsigned int size_y, unsigned int size_z) override
+  {
+    size_x_ = size_x;
+    size_y_ = size_y;
+    size_z_ = size_z;
+    const size_t num_columns = static_cast<size_t>(size_x) * size_y;
+    columns_.reserve(num_columns);
+    shift_scratch_.reserve(num_columns);
+    touched_.reserve(num_columns);
+    updates_.reserve(num_columns);
+    num_updates_.reserve(1);
+    reset();
+    check(
+      cudaMemsetAsync(touched_.get(), 0, num_columns * sizeof(uint8_t), stream_), "cudaMemset");
+    synchronize();
+  }
+
+  void reset() override
+  {
+    const size_t num_columns = static_cast<size_t>(size_x_) * size_y_;
+    if (num_columns == 0) {
+      return;
+    }
+    fillKernel<<<numBlocks(num_columns), THREADS_PER_BLOCK, 0, stream_>>>(
+      columns_.get(), num_columns, UNKNOWN_COLUMN);
+    check(cudaGetLastError(), "fillKernel");
+  }
+
+  void shift(int shift_x, int shift_y) override
+  {
+    const size_t num_columns = static_cast<size_t>(size_x_) * size_y_;
+    if (num_columns == 0) {
+      return;
+    }
+    shiftKernel<<<numBlocks(num_columns), THREADS_PER_BLOCK, 0, stream_>>>(
+      columns_.get(), shift_scratch_.get(), size_x_, size_y_, shift_x, shift_y);
+    check(cudaGetLastError(), "shiftKernel");
+    columns_.swap(shift_scratch_);
+  }
+
+  void markVoxels(
+    const std::vector<VoxelMark> & voxels, const std::vector<unsigned int> & columns,
+    unsigned int mark_threshold, std::vector<uint8_t> & occupied) override
+  {
+    occupied.resize(columns.size());
+    if (!voxels.empty()) {
+      voxels_.reserve(voxels.size());
+      check(
+        cudaMemcpyAsync(
+          voxels_.get(), voxels.data(), voxels.size() * sizeof(VoxelMark), cudaMemcpyHostToDevice,
+          stream_),
+        "cudaMemcpy");
+      markVoxelsKernel<<<numBlocks(voxels.size()), THREADS_PER_BLOCK, 0, stream_>>>(
+        columns_.get(), size_x_, size_y_, size_z_, voxels_.get(), voxels.size());
+      check(cudaGetLastError(), "markVoxelsKernel");
+    }
+    if (columns.empty()) {
+      synchronize();
+      return;
+    }
+
+    indices_.reserve(columns.size());
+    occupied_.reserve(columns.size());
+    check(
+      cudaMemcpyAsync(
+        indices_.get(), columns.data(), columns.size() * sizeof(unsigned int),
+        cudaMemcpyHostToDevice, stream_),
+      "cudaMemcpy");
+    checkColumnsKernel<<<numBlocks(columns.size()), THREADS_PER_BLOCK, 0, stream_>>>(
+      columns_.get(), indices_.get(), columns.size(), mark_threshold, occupied_.get());
+    check(cudaGetLastError(), "checkColumnsKernel");
+    check(
+      cudaMemcpyAsync(
+        occupied.data(), occupied_.get(), columns.size() * sizeof(uint8_t), cudaMemcpyDeviceToHost,
+        stream_),
+      "cudaMemcpy");
+    synchronize();
+  }
+
+  void clearLines(
+    double x0, double y0, double z0, const std::vector<Endpoint> & endpoints,
+    unsigned int unknown_threshold, unsigned int mark_threshold, unsigned char free_cost,
+    unsigned char unknown_cost, unsigned int max_length, unsigned int min_length,
+    std::vector<CellUpdate> & updates) override
+  {
+    updates.clear();
+    if (endpoints.empty()) {
+      return;
+    }
+
+    // every traced column lies within the rows spanned by the origin and the endpoints, only that
+    // band is collected
+    unsigned int min_row = static_cast<unsigned int>(y0), max_row = min_row;
+    for (const Endpoint & end : endpoints) {
+      min_row = std::min(min_row, static_cast<unsigned int>(end.y));
+      max_row = std::max(max_row, static_cast<unsigned int>(end.y));
+    }
+    max_row = std::min(max_row, size_y_ - 1);
+    const unsigned int base = min_row * size_x_;
+    const size_t band = (max_row - min_row + 1) * static_cast<size_t>(size_x_);
+
+    endpoints_.reserve(endpoints.size());
+    check(
+      cudaMemcpyAsync(
+        endpoints_.get(), endpoints.data(), endpoints.size() * sizeof(Endpoint),
+        cudaMemcpyHostToDevice, stream_),
+      "cudaMemcpy");
+    check(cudaMemsetAsync(num_updates_.get(), 0, sizeof(unsigned int), stream_), "cudaMemset");
+    clearLinesKernel<<<numBlocks(endpoints.size()), THREADS_PER_BLOCK, 0, stream_>>>(
+      columns_.get(), touched_.get(), size_x_, x0, y0, z0, endpoints_.get(), endpoints.size(),
+      max_length, min_length);
+    check(cudaGetLastError(), "clearLinesKernel");
+    collectClearedKernel<<<numBlocks(band), THREADS_PER_BLOCK, 0, stream_>>>(
+      columns_.get(), touched_.get(), base, band, unknown_threshold, mark_threshold, free_cost,
+      unknown_cost, updates_.get(), num_updates_.get());
+    check(cudaGetLastError(), "collectClearedKernel");
+
+    unsigned int num_updates = 0;
+    check(
+      cudaMemcpyAsync(
+        &num_updates, num_updates_.get(), sizeof(unsigned int), cudaMemcpyDeviceToHost, stream_),
+      "cudaMemcpy");
+    synchronize();
+    if (num_updates == 0) {
+      return;
+    }
+    updates.resize(num_updates);
+    check(
+      cudaMemcpyAsync(
+        updates.data(), updates_.get(), num_updates * sizeof(CellUpdate), cudaMemcpyDeviceToHost,
+        stream_),
+      "cudaMemcpy");
+    synchronize();
+  }
+
+  void download(
+    uint32_t * data, unsigned int x0, unsigned int y0, unsigned int width,
+    unsigned int height) override
+  {
+    if (width == 0 || height == 0) {
+      return;
+    }
+    check(
+      cudaMemcpy2DAsync(
+        data, width * sizeof(uint32_t), columns_.get() + static_cast<size_t>(y0) * size_x_ + x0,
+        size_x_ * sizeof(uint32_t), width * sizeof(uint32_t), height, cudaMemcpyDeviceToHost,
+        stream_),
+      "cudaMemcpy2D");
+    synchronize();
+  }
+
+  void upload(const uint32_t * data) override
+  {
+    const size_t num_columns = static_cast<size_t>(size_x_) * size_y_;
+    if (num_columns == 0) {
+      return;
+    }
+    check(
+      cudaMemcpyAsync(
+        columns_.get(), data, num_columns * sizeof(uint32_t), cudaMemcpyHostToDevice, stream_),
+      "cudaMemcpy");
+    synchronize();
+  }
+
+private:
+  void synchronize() { check(cudaStreamSynchronize(stream_), "cudaStreamSynchronize"); }
+
+  cudaStream_t stream_ = nullptr;
+  unsigned int size_x_ = 0, size_y_ = 0, size_z_ = 0;
+  DeviceBuffer<uint32_t> columns_, shift_scratch_;
+  /// @brief Columns traced by the running clearing pass, zero in between passes
+  DeviceBuffer<uint8_t> touched_;
+  DeviceBuffer<CellUpdate> updates_;
+  DeviceBuffer<unsigned int> num_updates_;
+  /// @brief Upload buffers, reused between updates
+  DeviceBuffer<Endpoint> endpoints_;
+  DeviceBuffer<VoxelMark> voxels_;
+  DeviceBuffer<unsigned int> indices_;
+  DeviceBuffer<uint8_t> occupied_;
+};
+
+}  // namespace
+
+std::unique_ptr<VoxelGpuBackend> VoxelGpuBackend::create(std::string & error)
+{
+  int num_devices = 0;
+  const cudaError_t status = cudaGetDeviceCount(&num_devices);
+  if (status != cudaSuccess || num_devices == 0) {
+    error = status != cudaSuccess ? cudaGetErrorString(status) : "no CUDA device found";
+    return nullptr;
+  }
+  try {
+    return std::make_unique<CudaVoxelBackend>();
+  } catch (const std::runtime_error & ex) {
+    error = ex.what();
+    return nullptr;
+  }
+}
+
+}  // namespace pb_nav2_costmap_2d
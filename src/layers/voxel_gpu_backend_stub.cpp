@@ -0,0 +1,30 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+#include <string>
+
+#include "pb_nav2_plugins/layers/voxel_gpu_backend.hpp"
+
+namespace pb_nav2_costmap_2d
+{
+
+// built in place of voxel_gpu_backend.cu when PB_NAV2_WITH_CUDA is off
+std::unique_ptr<VoxelGpuBackend> VoxelGpuBackend::create(std::string & error)
+{
+  error = "pb_nav2_plugins was built without PB_NAV2_WITH_CUDA";
+  return nullptr;
+}
+
+}  // namespace pb_nav2_costmap_2d
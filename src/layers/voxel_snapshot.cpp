@@ -0,0 +1,135 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pb_nav2_plugins/layers/voxel_snapshot.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace pb_nav2_costmap_2d
+{
+
+namespace
+{
+
+constexpr char MAGIC[4] = {'P', 'B', 'V', 'S'};
+constexpr uint32_t VERSION = 1;
+/// @brief Largest map a snapshot is read for, guards against allocating for a corrupt header
+constexpr uint64_t MAX_CELLS = uint64_t{1} << 30;
+
+template<typename T>
+void write(std::ofstream & out, const T & value)
+{
+  out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template<typename T>
+bool read(std::ifstream & in, T & value)
+{
+  return static_cast<bool>(in.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+}  // namespace
+
+bool VoxelSnapshot::save(const std::string & path, std::string & error) const
+{
+  // a crash while writing leaves the previous snapshot in place
+  const std::string partial = path + ".partial";
+  {
+    std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      error = "cannot open " + partial;
+      return false;
+    }
+    out.write(MAGIC, sizeof(MAGIC));
+    write(out, VERSION);
+    write(out, static_cast<uint32_t>(global_frame.size()));
+    out.write(global_frame.data(), global_frame.size());
+    write(out, static_cast<uint32_t>(size_x));
+    write(out, static_cast<uint32_t>(size_y));
+    write(out, static_cast<uint32_t>(size_z));
+    write(out, resolution);
+    write(out, z_resolution);
+    write(out, origin_x);
+    write(out, origin_y);
+    write(out, origin_z);
+    out.write(reinterpret_cast<const char *>(costmap.data()), costmap.size());
+    out.write(
+      reinterpret_cast<const char *>(columns.data()), columns.size() * sizeof(uint32_t));
+    if (!out.flush()) {
+      error = "cannot write " + partial;
+      return false;
+    }
+  }
+  if (std::rename(partial.c_str(), path.c_str()) != 0) {
+    error = "cannot replace " + path;
+    std::remove(partial.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool VoxelSnapshot::load(const std::string & path, std::string & error)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    error = "cannot open " + path;
+    return false;
+  }
+
+  char magic[sizeof(MAGIC)];
+  uint32_t version = 0, frame_size = 0;
+  if (
+    !in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), MAGIC) ||
+    !read(in, version) || version != VERSION)
+  {
+    error = path + " is not a voxel snapshot of this version";
+    return false;
+  }
+
+  uint32_t x = 0, y = 0, z = 0;
+  if (!read(in, frame_size) || frame_size > 4096) {
+    error = path + " is truncated";
+    return false;
+  }
+  global_frame.resize(frame_size);
+  if (
+    !in.read(&global_frame[0], frame_size) || !read(in, x) || !read(in, y) || !read(in, z) ||
+    !read(in, resolution) || !read(in, z_resolution) || !read(in, origin_x) ||
+    !read(in, origin_y) || !read(in, origin_z) || static_cast<uint64_t>(x) * y > MAX_CELLS)
+  {
+    error = path + " is truncated";
+    return false;
+  }
+  size_x = x;
+  size_y = y;
+  size_z = z;
+
+  const size_t num_cells = static_cast<size_t>(size_x) * size_y;
+  costmap.resize(num_cells);
+  columns.resize(num_cells);
+  if (
+    !in.read(reinterpret_cast<char *>(costmap.data()), num_cells) ||
+    !in.read(reinterpret_cast<char *>(columns.data()), num_cells * sizeof(uint32_t)))
+  {
+    error = path + " is truncated";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace pb_nav2_costmap_2d
@@ -0,0 +1,93 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pb_nav2_plugins/layers/worker_pool.hpp"
+
+#include <algorithm>
+
+namespace pb_nav2_costmap_2d
+{
+
+WorkerPool::WorkerPool(size_t num_threads)
+{
+  num_threads = std::max<size_t>(num_threads, 1);
+  threads_.reserve(num_threads);
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&WorkerPool::workerLoop, this, i);
+  }
+}
+
+WorkerPool::~WorkerPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_cv_.notify_all();
+  for (auto & thread : threads_) {
+    thread.join();
+  }
+}
+
+void WorkerPool::run(size_t num_tasks, const Task & task)
+{
+  if (num_tasks == 0) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    num_tasks_ = num_tasks;
+    next_task_.store(0, std::memory_order_relaxed);
+    active_workers_ = threads_.size();
+    ++generation_;
+  }
+  start_cv_.notify_all();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this] { return active_workers_ == 0; });
+  task_ = nullptr;
+}
+
+void WorkerPool::workerLoop(size_t worker)
+{
+  size_t seen_generation = 0;
+  while (true) {
+    const Task * task;
+    size_t num_tasks;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_cv_.wait(lock, [&] { return stop_ || generation_ != seen_generation; });
+      if (stop_) {
+        return;
+      }
+      seen_generation = generation_;
+      task = task_;
+      num_tasks = num_tasks_;
+    }
+
+    size_t index;
+    while ((index = next_task_.fetch_add(1, std::memory_order_relaxed)) < num_tasks) {
+      (*task)(index, worker);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--active_workers_ == 0) {
+      done_cv_.notify_one();
+    }
+  }
+}
+
+}  // namespace pb_nav2_costmap_2d
@@ -0,0 +1,118 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "pb_nav2_plugins/behaviors/clearance_direction_solver.hpp"
+
+using pb_nav2_behaviors::ClearanceDirectionSolver;
+using pb_nav2_behaviors::DirectionChoice;
+using pb_nav2_behaviors::DistanceField;
+
+namespace
+{
+
+constexpr unsigned int SIZE = 41;
+constexpr float RESOLUTION = 0.1f;
+
+/**
+ * @brief A corridor along x through the middle of the map, closed by a wall behind the robot
+ */
+nav2_msgs::msg::Costmap makeCorridor()
+{
+  nav2_msgs::msg::Costmap costmap;
+  costmap.metadata.size_x = SIZE;
+  costmap.metadata.size_y = SIZE;
+  costmap.metadata.resolution = RESOLUTION;
+  costmap.data.assign(SIZE * SIZE, 0);
+  for (unsigned int j = 0; j < SIZE; ++j) {
+    for (unsigned int i = 0; i < SIZE; ++i) {
+      if (j < 15 || j > 25 || i < 10) {
+        costmap.data[j * SIZE + i] = 254;
+      }
+    }
+  }
+  return costmap;
+}
+
+geometry_msgs::msg::Pose2D poseAt(unsigned int i, unsigned int j)
+{
+  geometry_msgs::msg::Pose2D pose;
+  pose.x = (i + 0.5) * RESOLUTION;
+  pose.y = (j + 0.5) * RESOLUTION;
+  return pose;
+}
+
+}  // namespace
+
+TEST(ClearanceDirectionSolver, HeadsAlongTheOpenCorridor)
+{
+  const auto costmap = makeCorridor();
+  DistanceField field;
+  field.build(costmap, 253);
+  ClearanceDirectionSolver solver;
+  solver.setHeadings(64);
+
+  const DirectionChoice choice = solver.solve(field, costmap.metadata, poseAt(20, 20), 1.0f);
+  ASSERT_TRUE(choice.found);
+  EXPECT_NEAR(choice.angle, 0.0f, 0.15f);
+  EXPECT_LE(choice.sector_begin, choice.angle);
+  EXPECT_GE(choice.sector_end, choice.angle);
+  EXPECT_GT(choice.clearance, 0.0f);
+}
+
+TEST(ClearanceDirectionSolver, SweptDiscStillHeadsAlongTheCorridor)
+{
+  const auto costmap = makeCorridor();
+  DistanceField field;
+  field.build(costmap, 253);
+  ClearanceDirectionSolver solver;
+  solver.setHeadings(64);
+
+  const DirectionChoice choice = solver.solve(field, costmap.metadata, poseAt(20, 20), 1.0f, 0.3f);
+  ASSERT_TRUE(choice.found);
+  EXPECT_NEAR(choice.angle, 0.0f, 0.15f);
+}
+
+TEST(ClearanceDirectionSolver, NothingIsFoundFromABlockedCell)
+{
+  const auto costmap = makeCorridor();
+  DistanceField field;
+  field.build(costmap, 253);
+  ClearanceDirectionSolver solver;
+  solver.setHeadings(64);
+
+  EXPECT_FALSE(solver.solve(field, costmap.metadata, poseAt(5, 20), 1.0f).found);
+  EXPECT_FALSE(solver.solve(field, costmap.metadata, poseAt(20, 5), 1.0f).found);
+}
+
+TEST(ClearanceDirectionSolver, ClearanceOutsideOfTheMapIsZero)
+{
+  const auto costmap = makeCorridor();
+  DistanceField field;
+  field.build(costmap, 253);
+
+  const auto & metadata = costmap.metadata;
+  EXPECT_FLOAT_EQ(ClearanceDirectionSolver::clearanceAt(field, metadata, -0.05f, 2.0f), 0.0f);
+  EXPECT_FLOAT_EQ(ClearanceDirectionSolver::clearanceAt(field, metadata, 2.0f, 4.2f), 0.0f);
+  EXPECT_GT(ClearanceDirectionSolver::clearanceAt(field, metadata, 2.05f, 2.05f), 0.0f);
+}
+
+TEST(ClearanceDirectionSolver, RequiredClearanceNeverExceedsTheStart)
+{
+  EXPECT_FLOAT_EQ(ClearanceDirectionSolver::requiredClearance(1.0f, 0.3f, 0.1f), 0.25f);
+  EXPECT_FLOAT_EQ(ClearanceDirectionSolver::requiredClearance(0.2f, 0.3f, 0.1f), 0.15f);
+}
@@ -0,0 +1,140 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include "pb_nav2_plugins/layers/dirty_tiles.hpp"
+
+using pb_nav2_costmap_2d::DirtyTiles;
+
+namespace
+{
+
+constexpr unsigned char FREE = 0, LETHAL = 254, UNKNOWN = 255;
+constexpr unsigned int SIZE_X = 53, SIZE_Y = 41;
+
+// CostmapLayer::updateWithMax over the whole window
+void referenceMax(const std::vector<unsigned char> & costmap, std::vector<unsigned char> & master)
+{
+  for (size_t i = 0; i < costmap.size(); ++i) {
+    if (costmap[i] == UNKNOWN) {
+      continue;
+    }
+    if (master[i] == UNKNOWN || master[i] < costmap[i]) {
+      master[i] = costmap[i];
+    }
+  }
+}
+
+// a layer of mostly unknown tiles, some free-only tiles and a few obstacles
+std::vector<unsigned char> makeLayer(std::mt19937 & random)
+{
+  std::vector<unsigned char> costmap(SIZE_X * SIZE_Y, UNKNOWN);
+  for (unsigned int y = 0; y < 16; ++y) {
+    for (unsigned int x = 16; x < 32; ++x) {
+      costmap[y * SIZE_X + x] = FREE;
+    }
+  }
+  // the obstacles stay below the rows of the free-only tile
+  std::uniform_int_distribution<size_t> cell(16 * SIZE_X, costmap.size() - 1);
+  for (int k = 0; k < 20; ++k) {
+    costmap[cell(random)] = k % 2 ? LETHAL : FREE;
+  }
+  return costmap;
+}
+
+std::vector<unsigned char> makeMaster(std::mt19937 & random, unsigned char fill, int unknown_cells)
+{
+  std::vector<unsigned char> master(SIZE_X * SIZE_Y, fill);
+  std::uniform_int_distribution<size_t> cell(0, master.size() - 1);
+  for (int k = 0; k < unknown_cells; ++k) {
+    master[cell(random)] = UNKNOWN;
+  }
+  for (unsigned int x = 16; x < 32; ++x) {
+    master[5 * SIZE_X + x] = UNKNOWN;
+  }
+  return master;
+}
+
+}  // namespace
+
+TEST(DirtyTiles, MaxMergeMatchesUpdateWithMaxOverUnknownMasterCells)
+{
+  std::mt19937 random(3);
+  const auto costmap = makeLayer(random);
+  DirtyTiles tiles;
+  tiles.resize(SIZE_X, SIZE_Y);
+  tiles.refresh(costmap.data(), true);
+
+  // unknown cells written by a layer merged earlier into a master reset to free space
+  for (const unsigned char fill : {FREE, UNKNOWN}) {
+    auto master = makeMaster(random, fill, 200);
+    auto expected = master;
+    referenceMax(costmap, expected);
+    tiles.updateWithMax(costmap.data(), master.data(), 0, 0, SIZE_X, SIZE_Y);
+    EXPECT_EQ(master, expected);
+  }
+}
+
+TEST(DirtyTiles, FreeTilesAreSkippedOnlyOverAKnownMaster)
+{
+  std::mt19937 random(5);
+  const auto costmap = makeLayer(random);
+  DirtyTiles tiles;
+  tiles.resize(SIZE_X, SIZE_Y);
+  tiles.refresh(costmap.data(), false);
+
+  auto master = makeMaster(random, FREE, 0);
+  for (unsigned int x = 16; x < 32; ++x) {
+    master[5 * SIZE_X + x] = FREE;
+  }
+  auto expected = master;
+  referenceMax(costmap, expected);
+  tiles.updateWithMax(costmap.data(), master.data(), 0, 0, SIZE_X, SIZE_Y);
+  EXPECT_EQ(master, expected);
+
+  // the free-only tile leaves unknown master cells behind, which updateWithMax would free
+  master = makeMaster(random, FREE, 0);
+  tiles.updateWithMax(costmap.data(), master.data(), 0, 0, SIZE_X, SIZE_Y);
+  EXPECT_EQ(master[5 * SIZE_X + 20], UNKNOWN);
+
+  // merging free cells again brings the tile back
+  tiles.refresh(costmap.data(), true);
+  tiles.updateWithMax(costmap.data(), master.data(), 0, 0, SIZE_X, SIZE_Y);
+  EXPECT_EQ(master[5 * SIZE_X + 20], FREE);
+}
+
+TEST(DirtyTiles, MergesOnlyTheWindow)
+{
+  std::mt19937 random(11);
+  const auto costmap = makeLayer(random);
+  DirtyTiles tiles;
+  tiles.resize(SIZE_X, SIZE_Y);
+  tiles.refresh(costmap.data(), true);
+
+  auto master = makeMaster(random, UNKNOWN, 0);
+  auto expected = master;
+  referenceMax(costmap, expected);
+  tiles.updateWithMax(costmap.data(), master.data(), 10, 3, 40, 30);
+  for (unsigned int y = 0; y < SIZE_Y; ++y) {
+    for (unsigned int x = 0; x < SIZE_X; ++x) {
+      const bool inside = x >= 10 && x < 40 && y >= 3 && y < 30;
+      ASSERT_EQ(master[y * SIZE_X + x], inside ? expected[y * SIZE_X + x] : UNKNOWN)
+        << "cell " << x << ", " << y;
+    }
+  }
+}
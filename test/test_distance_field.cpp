@@ -0,0 +1,143 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "pb_nav2_plugins/behaviors/clearance_direction_solver.hpp"
+
+using pb_nav2_behaviors::DistanceField;
+
+namespace
+{
+
+nav2_msgs::msg::Costmap makeCostmap(unsigned int size_x, unsigned int size_y, float resolution)
+{
+  nav2_msgs::msg::Costmap costmap;
+  costmap.metadata.size_x = size_x;
+  costmap.metadata.size_y = size_y;
+  costmap.metadata.resolution = resolution;
+  costmap.data.assign(static_cast<size_t>(size_x) * size_y, 0);
+  return costmap;
+}
+
+// distance in cells to the outside of the map, which counts as blocked
+float borderDistance(unsigned int i, unsigned int j, unsigned int size_x, unsigned int size_y)
+{
+  return static_cast<float>(std::min({i + 1, size_x - i, j + 1, size_y - j}));
+}
+
+}  // namespace
+
+TEST(DistanceField, EmptyMapIsBoundedByTheBorder)
+{
+  const auto costmap = makeCostmap(21, 15, 0.1f);
+  DistanceField field;
+  field.build(costmap, 253);
+
+  ASSERT_EQ(field.sizeX(), 21u);
+  ASSERT_EQ(field.sizeY(), 15u);
+  for (unsigned int j = 0; j < 15; ++j) {
+    for (unsigned int i = 0; i < 21; ++i) {
+      EXPECT_NEAR(field.at(i, j), borderDistance(i, j, 21, 15) * 0.1f, 1e-5f);
+    }
+  }
+}
+
+TEST(DistanceField, MeasuresTheEuclideanDistanceToABlockedCell)
+{
+  auto costmap = makeCostmap(41, 41, 0.05f);
+  costmap.data[20 * 41 + 20] = 254;
+  DistanceField field;
+  field.build(costmap, 253);
+
+  for (unsigned int j = 0; j < 41; ++j) {
+    for (unsigned int i = 0; i < 41; ++i) {
+      const float to_cell =
+        std::hypot(static_cast<float>(i) - 20.0f, static_cast<float>(j) - 20.0f);
+      const float expected = std::min(to_cell, borderDistance(i, j, 41, 41)) * 0.05f;
+      EXPECT_NEAR(field.at(i, j), expected, 1e-5f) << "cell " << i << ", " << j;
+    }
+  }
+}
+
+TEST(DistanceField, OnlyCellsAtTheLethalCostAreBlocked)
+{
+  auto costmap = makeCostmap(11, 11, 1.0f);
+  costmap.data[5 * 11 + 5] = 252;
+  DistanceField field;
+  field.build(costmap, 253);
+  EXPECT_FLOAT_EQ(field.at(5, 5), 6.0f);
+
+  costmap.data[5 * 11 + 5] = 253;
+  field.build(costmap, 253);
+  EXPECT_FLOAT_EQ(field.at(5, 5), 0.0f);
+  EXPECT_FLOAT_EQ(field.at(5, 7), 2.0f);
+}
+
+TEST(DistanceField, UpdateWithoutChangesKeepsTheField)
+{
+  auto costmap = makeCostmap(16, 16, 0.1f);
+  costmap.data[3 * 16 + 4] = 254;
+  DistanceField field;
+  field.build(costmap, 253);
+  EXPECT_EQ(field.update(costmap, 253), 0u);
+  EXPECT_FLOAT_EQ(field.at(4, 3), 0.0f);
+}
+
+TEST(DistanceField, UpdateOfAnotherSizeRebuilds)
+{
+  DistanceField field;
+  field.build(makeCostmap(8, 8, 0.1f), 253);
+  auto costmap = makeCostmap(12, 10, 0.1f);
+  costmap.data[0] = 254;
+  EXPECT_EQ(field.update(costmap, 253), 120u);
+  EXPECT_EQ(field.sizeX(), 12u);
+  EXPECT_EQ(field.sizeY(), 10u);
+  EXPECT_FLOAT_EQ(field.at(0, 0), 0.0f);
+}
+
+TEST(DistanceField, UpdateMatchesBuildAfterRandomFlips)
+{
+  constexpr unsigned int size_x = 37, size_y = 29;
+  auto costmap = makeCostmap(size_x, size_y, 0.05f);
+  std::mt19937 random(7);
+  std::uniform_int_distribution<size_t> cell(0, costmap.data.size() - 1);
+  for (int k = 0; k < 60; ++k) {
+    costmap.data[cell(random)] = 254;
+  }
+
+  DistanceField updated, built;
+  updated.build(costmap, 253);
+  for (int round = 0; round < 50; ++round) {
+    // a few cells flip between blocked and free, including some flipped back
+    const int flips = 1 + round % 6;
+    for (int k = 0; k < flips; ++k) {
+      unsigned char & cost = costmap.data[cell(random)];
+      cost = cost >= 253 ? 0 : 254;
+    }
+    updated.update(costmap, 253);
+    built.build(costmap, 253);
+
+    for (unsigned int j = 0; j < size_y; ++j) {
+      for (unsigned int i = 0; i < size_x; ++i) {
+        ASSERT_FLOAT_EQ(updated.at(i, j), built.at(i, j))
+          << "round " << round << ", cell " << i << ", " << j;
+      }
+    }
+  }
+}
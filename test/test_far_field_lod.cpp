@@ -0,0 +1,84 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "pb_nav2_plugins/layers/far_field_lod.hpp"
+
+using pb_nav2_costmap_2d::CellBatch;
+using pb_nav2_costmap_2d::FarFieldLod;
+
+namespace
+{
+
+std::vector<unsigned int> expanded(FarFieldLod & lod, unsigned int size_x, unsigned int size_y)
+{
+  CellBatch batch;
+  batch.resize(size_x, size_y);
+  lod.expandInto(batch);
+  std::vector<unsigned int> cells = batch.cells();
+  std::sort(cells.begin(), cells.end());
+  return cells;
+}
+
+}  // namespace
+
+TEST(FarFieldLod, DisabledAtFactorOne)
+{
+  FarFieldLod lod;
+  lod.configure(1, 3.0);
+  EXPECT_FALSE(lod.enabled());
+  lod.configure(4, 3.0);
+  EXPECT_TRUE(lod.enabled());
+  lod.disable();
+  EXPECT_FALSE(lod.enabled());
+}
+
+TEST(FarFieldLod, ExpandsOnlyTheFineCellsHit)
+{
+  FarFieldLod lod;
+  lod.configure(4, 3.0);
+  lod.resize(10, 10, 0.1);
+  lod.addFar(5 * 10 + 5);
+  lod.addFar(6 * 10 + 7);
+  lod.addFar(6 * 10 + 7);
+  lod.addFar(0);
+
+  EXPECT_EQ(expanded(lod, 10, 10), (std::vector<unsigned int>{0, 55, 67}));
+  // the marks are dropped once expanded
+  EXPECT_TRUE(expanded(lod, 10, 10).empty());
+}
+
+TEST(FarFieldLod, KeepsTheCellsOfPartialCoarseCells)
+{
+  FarFieldLod lod;
+  lod.configure(8, 3.0);
+  lod.resize(10, 9, 0.1);
+  for (const unsigned int index : {9u, 89u, 88u}) {
+    lod.addFar(index);
+  }
+  EXPECT_EQ(expanded(lod, 10, 9), (std::vector<unsigned int>{9, 88, 89}));
+}
+
+TEST(FarFieldLod, ClampsTheFactor)
+{
+  FarFieldLod lod;
+  lod.configure(32, 3.0);
+  lod.resize(20, 20, 0.1);
+  lod.addFar(19 * 20 + 19);
+  EXPECT_EQ(expanded(lod, 20, 20), (std::vector<unsigned int>{399}));
+}
@@ -0,0 +1,113 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "pb_nav2_plugins/layers/hit_counts.hpp"
+
+using pb_nav2_costmap_2d::HitCounts;
+
+TEST(HitCounts, DisabledUntilConfigured)
+{
+  HitCounts counts;
+  EXPECT_FALSE(counts.enabled());
+  EXPECT_EQ(counts.data(), nullptr);
+
+  counts.configure(1, 3, 10);
+  counts.resize(4, 4);
+  EXPECT_TRUE(counts.enabled());
+  EXPECT_NE(counts.data(), nullptr);
+
+  counts.disable();
+  EXPECT_FALSE(counts.enabled());
+  EXPECT_EQ(counts.data(), nullptr);
+}
+
+TEST(HitCounts, OccupiedFromTheThreshold)
+{
+  HitCounts counts;
+  counts.configure(1, 3, 10);
+  counts.resize(4, 4);
+  EXPECT_FALSE(counts.hit(5));
+  EXPECT_FALSE(counts.hit(5));
+  EXPECT_TRUE(counts.hit(5));
+  EXPECT_FALSE(counts.hit(6));
+
+  counts.clear(5);
+  EXPECT_FALSE(counts.hit(5));
+}
+
+TEST(HitCounts, SaturatesAtTheMaximum)
+{
+  HitCounts counts;
+  counts.configure(4, 3, 10);
+  counts.resize(4, 4);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_TRUE(counts.hit(0));
+  }
+  EXPECT_EQ(counts.data()[0], 10);
+}
+
+TEST(HitCounts, ClampsTheSettings)
+{
+  HitCounts counts;
+  counts.configure(0, 0, 1000);
+  counts.resize(2, 2);
+  EXPECT_TRUE(counts.enabled());
+  EXPECT_TRUE(counts.hit(0));
+  for (int i = 0; i < 300; ++i) {
+    counts.hit(1);
+  }
+  EXPECT_EQ(counts.data()[1], 255);
+}
+
+TEST(HitCounts, DecayReleasesCellsBelowTheThreshold)
+{
+  HitCounts counts;
+  counts.configure(1, 2, 10);
+  counts.resize(4, 1);
+  for (int i = 0; i < 4; ++i) {
+    counts.hit(0);
+  }
+  counts.hit(1);
+  counts.hit(1);
+  counts.hit(2);
+
+  std::vector<unsigned int> released;
+  counts.decay(1, [&](unsigned int index) { released.push_back(index); });
+  EXPECT_EQ(released, std::vector<unsigned int>{1});
+  EXPECT_EQ(counts.data()[0], 3);
+  EXPECT_EQ(counts.data()[2], 0);
+
+  released.clear();
+  counts.decay(5, [&](unsigned int index) { released.push_back(index); });
+  EXPECT_EQ(released, std::vector<unsigned int>{0});
+  EXPECT_EQ(counts.data()[0], 0);
+}
+
+TEST(HitCounts, ShiftScrollsEmptyCountsIn)
+{
+  HitCounts counts;
+  counts.configure(1, 1, 10);
+  counts.resize(4, 4);
+  counts.hit(0);
+  counts.hit(3 * 4 + 3);
+  counts.shift(1, 1);
+
+  EXPECT_EQ(counts.data()[2 * 4 + 2], 1);
+  EXPECT_EQ(counts.data()[0], 0);
+  EXPECT_EQ(counts.data()[3 * 4 + 3], 0);
+}
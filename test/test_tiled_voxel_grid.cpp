@@ -0,0 +1,168 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "pb_nav2_plugins/layers/tiled_voxel_grid.hpp"
+
+using pb_nav2_costmap_2d::TiledVoxelGrid;
+using pb_nav2_costmap_2d::VerticalRemap;
+
+namespace
+{
+
+// the column VoxelGrid::reset fills in, with every level unknown
+constexpr uint32_t UNKNOWN_COLUMN = ~0u >> 16;
+constexpr unsigned char FREE = 0, UNKNOWN = 255, LETHAL = 254;
+
+std::vector<uint32_t> columnsOf(const TiledVoxelGrid & grid)
+{
+  std::vector<uint32_t> columns(grid.sizeX() * grid.sizeY());
+  grid.toVoxelGridData(columns.data());
+  return columns;
+}
+
+}  // namespace
+
+TEST(TiledVoxelGrid, StartsUnknownWithoutTiles)
+{
+  TiledVoxelGrid grid;
+  grid.resize(100, 70, 10);
+  EXPECT_EQ(grid.allocatedTiles(), 0u);
+  for (const uint32_t column : columnsOf(grid)) {
+    ASSERT_EQ(column, UNKNOWN_COLUMN);
+  }
+}
+
+TEST(TiledVoxelGrid, MarkingSetsBothHalves)
+{
+  TiledVoxelGrid grid;
+  grid.resize(100, 70, 10);
+  grid.markVoxel(65, 3, 4);
+  grid.markVoxel(65, 3, 6);
+  EXPECT_EQ(grid.allocatedTiles(), 1u);
+  EXPECT_EQ(grid.markedCount(3 * 100 + 65), 2u);
+  EXPECT_EQ(grid.markedCount(3 * 100 + 64), 0u);
+
+  const auto columns = columnsOf(grid);
+  EXPECT_EQ(columns[3 * 100 + 65], ((1u << 4 | 1u << 6) << 16) | 0xffffu);
+  EXPECT_EQ(columns[3 * 100 + 64], UNKNOWN_COLUMN);
+}
+
+TEST(TiledVoxelGrid, ClearingCountsUnknownLevelsLikeVoxelGrid)
+{
+  TiledVoxelGrid grid;
+  grid.resize(8, 8, 10);
+  std::vector<unsigned char> map(64, LETHAL);
+
+  // one level seen free, the other 15 of a VoxelGrid column stay unknown
+  grid.clearVoxelLineInMap(0.5, 0.5, 0.5, 5.5, 0.5, 0.5, map.data(), 15, 0, FREE, UNKNOWN);
+  for (unsigned int x = 0; x < 5; ++x) {
+    EXPECT_EQ(map[x], FREE) << "cell " << x;
+  }
+  EXPECT_EQ(map[7], LETHAL);
+  EXPECT_EQ(columnsOf(grid)[0], UNKNOWN_COLUMN & ~1u);
+
+  std::fill(map.begin(), map.end(), LETHAL);
+  grid.clearVoxelLineInMap(0.5, 2.5, 0.5, 5.5, 2.5, 0.5, map.data(), 14, 0, FREE, UNKNOWN);
+  EXPECT_EQ(map[2 * 8], UNKNOWN);
+}
+
+TEST(TiledVoxelGrid, ClearingKeepsCellsWithEnoughMarks)
+{
+  TiledVoxelGrid grid;
+  grid.resize(8, 8, 10);
+  grid.markVoxel(2, 0, 3);
+  std::vector<unsigned char> map(64, LETHAL);
+
+  grid.clearVoxelLineInMap(0.5, 0.5, 0.5, 5.5, 0.5, 0.5, map.data(), 15, 0, FREE, UNKNOWN);
+  EXPECT_EQ(map[2], LETHAL);
+  EXPECT_EQ(grid.markedCount(2), 1u);
+  EXPECT_EQ(map[1], FREE);
+}
+
+TEST(TiledVoxelGrid, RoundTripsVoxelGridColumns)
+{
+  TiledVoxelGrid grid;
+  grid.resize(80, 80, 16);
+  std::vector<uint32_t> columns(80 * 80, UNKNOWN_COLUMN);
+  columns[0] = 0;
+  columns[1] = (1u << 16) | 1u;
+  columns[79 * 80 + 79] = (0x0f00u << 16) | 0xff00u;
+  grid.fromVoxelGridData(columns.data());
+
+  // the unknown columns of the three other tiles allocate nothing
+  EXPECT_EQ(grid.allocatedTiles(), 2u);
+  EXPECT_EQ(columnsOf(grid), columns);
+  EXPECT_EQ(grid.markedCount(79 * 80 + 79), 4u);
+}
+
+TEST(TiledVoxelGrid, ReleasesTilesBackToUnknown)
+{
+  TiledVoxelGrid grid;
+  grid.resize(80, 80, 10);
+  grid.markVoxel(70, 70, 1);
+  ASSERT_EQ(grid.allocatedTiles(), 1u);
+
+  std::vector<uint32_t> columns(80 * 80, UNKNOWN_COLUMN);
+  grid.fromVoxelGridData(columns.data());
+  grid.releaseEmptyTiles();
+  EXPECT_EQ(grid.allocatedTiles(), 0u);
+  EXPECT_EQ(columnsOf(grid), columns);
+}
+
+TEST(TiledVoxelGrid, ShiftScrollsUnknownColumnsIn)
+{
+  TiledVoxelGrid grid;
+  grid.resize(80, 80, 10);
+  grid.markVoxel(10, 10, 2);
+  grid.shift(5, -3);
+
+  EXPECT_EQ(grid.markedCount(13 * 80 + 5), 1u);
+  EXPECT_EQ(grid.markedCount(10 * 80 + 10), 0u);
+  const auto columns = columnsOf(grid);
+  EXPECT_EQ(columns[0], UNKNOWN_COLUMN);
+  EXPECT_EQ(columns[79 * 80 + 79], UNKNOWN_COLUMN);
+}
+
+TEST(TiledVoxelGrid, HoldsMoreLevelsThanAVoxelGrid)
+{
+  TiledVoxelGrid grid;
+  grid.resize(8, 8, 40);
+  grid.markVoxel(1, 1, 39);
+  grid.markVoxel(1, 1, 3);
+  EXPECT_EQ(grid.markedCount(9), 2u);
+  // only the 16 levels of a VoxelGrid column are written
+  EXPECT_EQ(columnsOf(grid)[9], ((1u << 3) << 16) | 0xffffu);
+}
+
+TEST(TiledVoxelGrid, RemapsSeenLevelsAndLeavesTheRestUnknown)
+{
+  TiledVoxelGrid grid;
+  grid.resize(8, 8, 10);
+  grid.markVoxel(0, 0, 2);
+  std::vector<unsigned char> map(64, LETHAL);
+  // a line of no length still clears the voxel it starts in
+  grid.clearVoxelLineInMap(0.5, 0.5, 0.5, 0.5, 0.5, 0.5, map.data(), 15, 0, FREE, UNKNOWN);
+
+  // the levels move up by two, the two new lowest levels were never seen
+  const VerticalRemap remap(0.0, 0.05, 10, -0.1, 0.05, 10);
+  grid.remapLevels(remap, 10);
+  EXPECT_EQ(grid.markedCount(0), 1u);
+  EXPECT_EQ(columnsOf(grid)[0], ((1u << 4) << 16) | (0xffffu & ~(1u << 2)));
+}
@@ -0,0 +1,86 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+#include "pb_nav2_plugins/layers/vertical_remap.hpp"
+
+using pb_nav2_costmap_2d::VerticalRemap;
+
+namespace
+{
+
+// a VoxelGrid column of 10 levels seen free, the 6 above them unknown
+constexpr uint32_t FREE_10 = 0xfc00u;
+
+uint32_t marked(unsigned int z) { return ((1u << 16) | 1u) << z; }
+
+}  // namespace
+
+TEST(VerticalRemap, SameLevelsAreTheIdentity)
+{
+  const VerticalRemap remap(0.0, 0.05, 10, 0.0, 0.05, 10);
+  EXPECT_TRUE(remap.identity());
+  EXPECT_EQ(remap.remapColumn(FREE_10 | marked(3)), FREE_10 | marked(3));
+  EXPECT_EQ(remap.remapBits(0x2a5u), 0x2a5u);
+}
+
+TEST(VerticalRemap, RaisedOriginMovesTheLevelsDown)
+{
+  // new level z sits where old level z + 2 was, the two new top levels were never seen
+  const VerticalRemap remap(0.0, 0.05, 10, 0.1, 0.05, 10);
+  EXPECT_FALSE(remap.identity());
+  EXPECT_EQ(remap.remapColumn(FREE_10 | marked(5)), 0xff00u | marked(3));
+  // the levels that fall below the new origin are dropped
+  EXPECT_EQ(remap.remapColumn(FREE_10 | marked(1)), 0xff00u);
+}
+
+TEST(VerticalRemap, UncoveredLevelsOfAFreeColumnAreUnknown)
+{
+  const VerticalRemap remap(0.0, 0.05, 10, -0.1, 0.05, 10);
+  EXPECT_EQ(remap.remapColumn(FREE_10), FREE_10 | 0x3u);
+  EXPECT_EQ(remap.remapColumn(0), 0x3u | (0xffffu & ~0x3ffu));
+}
+
+TEST(VerticalRemap, FewerLevelsLeaveTheTopUnknown)
+{
+  const VerticalRemap remap(0.0, 0.05, 10, 0.0, 0.05, 8);
+  EXPECT_EQ(remap.remapColumn(FREE_10 | marked(9) | marked(2)), 0xff00u | marked(2));
+}
+
+TEST(VerticalRemap, CoarserLevelsKeepEveryMark)
+{
+  // every new level takes two old ones
+  const VerticalRemap remap(0.0, 0.05, 10, 0.0, 0.1, 5);
+  EXPECT_EQ(remap.remapColumn(FREE_10 | marked(7)), 0xffe0u | marked(3));
+  EXPECT_EQ(remap.remapBits(0x3u), 0x1u);
+}
+
+TEST(VerticalRemap, FinerLevelsSplitEveryMark)
+{
+  const VerticalRemap remap(0.0, 0.1, 5, 0.0, 0.05, 10);
+  EXPECT_EQ(remap.remapColumn(0xffe0u | marked(1)), FREE_10 | marked(2) | marked(3));
+}
+
+TEST(VerticalRemap, BitsBeyondSixteenLevels)
+{
+  const VerticalRemap remap(0.0, 0.05, 40, 0.0, 0.05, 40);
+  EXPECT_TRUE(remap.identity());
+  EXPECT_EQ(remap.remapBits(uint64_t{1} << 39), uint64_t{1} << 39);
+
+  const VerticalRemap shifted(0.0, 0.05, 40, 0.5, 0.05, 40);
+  EXPECT_EQ(shifted.remapBits(uint64_t{1} << 39), uint64_t{1} << 29);
+}
@@ -0,0 +1,127 @@
+// Copyright 2025 Lihan Chen
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "pb_nav2_plugins/layers/voxel_snapshot.hpp"
+
+using pb_nav2_costmap_2d::VoxelSnapshot;
+
+namespace
+{
+
+std::string tempPath(const std::string & name) { return testing::TempDir() + name; }
+
+VoxelSnapshot makeSnapshot()
+{
+  VoxelSnapshot snapshot;
+  snapshot.global_frame = "map";
+  snapshot.size_x = 7;
+  snapshot.size_y = 5;
+  snapshot.size_z = 10;
+  snapshot.resolution = 0.05;
+  snapshot.z_resolution = 0.2;
+  snapshot.origin_x = -1.5;
+  snapshot.origin_y = 2.25;
+  snapshot.origin_z = 0.1;
+  snapshot.costmap.assign(35, 255);
+  snapshot.costmap[3] = 254;
+  snapshot.columns.assign(35, ~0u >> 16);
+  snapshot.columns[3] = (1u << 20) | 0xffffu;
+  return snapshot;
+}
+
+}  // namespace
+
+TEST(VoxelSnapshot, RoundTrips)
+{
+  const std::string path = tempPath("pb_nav2_plugins_round_trip.pbvs");
+  const VoxelSnapshot saved = makeSnapshot();
+  std::string error;
+  ASSERT_TRUE(saved.save(path, error)) << error;
+
+  VoxelSnapshot loaded;
+  ASSERT_TRUE(loaded.load(path, error)) << error;
+  EXPECT_EQ(loaded.global_frame, saved.global_frame);
+  EXPECT_EQ(loaded.size_x, saved.size_x);
+  EXPECT_EQ(loaded.size_y, saved.size_y);
+  EXPECT_EQ(loaded.size_z, saved.size_z);
+  EXPECT_DOUBLE_EQ(loaded.resolution, saved.resolution);
+  EXPECT_DOUBLE_EQ(loaded.z_resolution, saved.z_resolution);
+  EXPECT_DOUBLE_EQ(loaded.origin_x, saved.origin_x);
+  EXPECT_DOUBLE_EQ(loaded.origin_y, saved.origin_y);
+  EXPECT_DOUBLE_EQ(loaded.origin_z, saved.origin_z);
+  EXPECT_EQ(loaded.costmap, saved.costmap);
+  EXPECT_EQ(loaded.columns, saved.columns);
+  std::remove(path.c_str());
+}
+
+TEST(VoxelSnapshot, SaveReplacesTheOldSnapshot)
+{
+  const std::string path = tempPath("pb_nav2_plugins_replace.pbvs");
+  VoxelSnapshot snapshot = makeSnapshot();
+  std::string error;
+  ASSERT_TRUE(snapshot.save(path, error)) << error;
+  snapshot.origin_x = 4.0;
+  ASSERT_TRUE(snapshot.save(path, error)) << error;
+
+  VoxelSnapshot loaded;
+  ASSERT_TRUE(loaded.load(path, error)) << error;
+  EXPECT_DOUBLE_EQ(loaded.origin_x, 4.0);
+  EXPECT_FALSE(std::ifstream(path + ".partial").good());
+  std::remove(path.c_str());
+}
+
+TEST(VoxelSnapshot, RejectsMissingFiles)
+{
+  VoxelSnapshot loaded;
+  std::string error;
+  EXPECT_FALSE(loaded.load(tempPath("pb_nav2_plugins_missing.pbvs"), error));
+  EXPECT_FALSE(error.empty());
+}
+
+TEST(VoxelSnapshot, RejectsOtherFiles)
+{
+  const std::string path = tempPath("pb_nav2_plugins_other.pbvs");
+  std::ofstream(path) << "not a voxel snapshot";
+  VoxelSnapshot loaded;
+  std::string error;
+  EXPECT_FALSE(loaded.load(path, error));
+  EXPECT_FALSE(error.empty());
+  std::remove(path.c_str());
+}
+
+TEST(VoxelSnapshot, RejectsTruncatedFiles)
+{
+  const std::string path = tempPath("pb_nav2_plugins_truncated.pbvs");
+  std::string error;
+  ASSERT_TRUE(makeSnapshot().save(path, error)) << error;
+
+  std::string contents;
+  {
+    std::ifstream in(path, std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  std::ofstream(path, std::ios::binary | std::ios::trunc)
+    .write(contents.data(), contents.size() - 1);
+
+  VoxelSnapshot loaded;
+  EXPECT_FALSE(loaded.load(path, error));
+  std::remove(path.c_str());
+}